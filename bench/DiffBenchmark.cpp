@@ -0,0 +1,59 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <string>
+#include "Diff.hpp"
+
+// Mide cuanto escala el calculo de la tabla de EDIST por antidiagonales (WAVEFRONT) de 1 a N hilos.
+// Uso: diff-bench [largo de las cadenas] [maximo de hilos]
+int main(int argc, char** argv)
+{
+    const size_t length = argc > 1 ? std::stoul(argv[1]) : 8000;
+    const size_t max_threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+
+    // Dos versiones de un texto aleatorio, con un cambio cada 50 caracteres en promedio
+    std::mt19937 random(42);
+    std::string old_version, new_version;
+    for (size_t i = 0; i < length; i++)
+        old_version += static_cast<char>('a' + random() % 26);
+    new_version = old_version;
+    for (size_t i = 0; i < length / 50; i++)
+        new_version[random() % length] = '#';
+
+    std::cout << "WAVEFRONT, " << length << " x " << length << " (" << (length + 1) * (length + 1) * 4 / (1024 * 1024) << " MiB)\n";
+    std::cout << std::setw(6) << "hilos" << std::setw(12) << "segundos" << std::setw(14) << "aceleracion\n";
+
+    double base_seconds = 0;
+    std::string base_diff;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        DIFF diff(old_version, new_version, WAVEFRONT);
+        diff.set_thread_count(threads);
+        diff.set_memory_budget(static_cast<size_t>(-1));
+
+        auto const start = std::chrono::steady_clock::now();
+        auto const result = diff.compute_diff();
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+        if (threads == 1)
+        {
+            base_seconds = elapsed.count();
+            base_diff = result;
+        }
+        else if (result != base_diff)
+        {
+            std::cerr << "El resultado con " << threads << " hilos no coincide con el de 1 hilo\n";
+            return 1;
+        }
+
+        std::cout << std::setw(6) << threads << std::setw(12) << std::fixed << std::setprecision(3) << elapsed.count() 
+                  << std::setw(12) << std::setprecision(2) << base_seconds / elapsed.count() << "x\n";
+
+        if (threads < max_threads && threads * 2 > max_threads)
+            threads = max_threads / 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "FileSystem.hpp"
+
+// Compara la caja de cambios unica con la bitacora de modificaciones: se crean muchos archivos en un directorio
+// profundo, que se modifica en cada version, y se mide cuantos nodos y memoria se usan, cuanto cuesta cada
+// modificacion y cuanto cuesta cambiar a una version al azar, que lee los hijos de cada ancestro en esa version.
+// Con ramas, cada modificacion parte de una version anterior al azar, y se comprueba que cada version tenga los
+// archivos de la version de la que partio mas uno.
+// Uso: persistence-bench [profundidad] [modificaciones] [lecturas]
+void Run(CELV::PersistenceMode mode, bool branching, size_t depth, size_t modifications, size_t reads)
+{
+    CELV::FileSystem file_system;
+    std::string error_msg;
+    auto const check = [&](STATUS status) {
+        if (status == ERROR)
+        {
+            std::cerr << error_msg << std::endl;
+            std::exit(1);
+        }
+    };
+
+    check(file_system.CreateFile("p", CELV::FileType::DIRECTORY, error_msg));
+    check(file_system.ChangeDirectory("p", error_msg));
+    check(file_system.InitCELV(error_msg));
+    check(file_system.SetPersistenceMode(mode, error_msg));
+    for (size_t i = 0; i < depth; i++)
+    {
+        check(file_system.CreateFile("d", CELV::FileType::DIRECTORY, error_msg));
+        check(file_system.ChangeDirectory("d", error_msg));
+    }
+
+    // Archivos esperados en el directorio profundo en cada version desde la primera modificacion
+    CELV::Version first;
+    check(file_system.GetVersion(first, error_msg));
+    std::vector<size_t> expected_files{0};
+    std::mt19937 random(42);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < modifications; i++)
+    {
+        auto source = expected_files.size() - 1;
+        if (branching)
+        {
+            source = random() % expected_files.size();
+            check(file_system.SetVersion(first + source, error_msg));
+        }
+
+        check(file_system.CreateFile("f" + std::to_string(i), CELV::FileType::DOCUMENT, error_msg));
+        expected_files.push_back(expected_files[source] + 1);
+    }
+    std::chrono::duration<double, std::nano> const writing = std::chrono::steady_clock::now() - start;
+
+    // Antes de las lecturas, que pueden dejar el directorio de trabajo en un ancestro si la version no lo tiene.
+    // Listar cuesta lo que tenga el directorio, asi que solo se comprueban unas 1000 versiones
+    auto const step = std::max<size_t>(1, expected_files.size() / 1000);
+    for (size_t i = 0; i < expected_files.size(); i += step)
+    {
+        size_t files = 0;
+        check(file_system.SetVersion(first + i, error_msg));
+        file_system.List(CELV::ListOptions(), [&files](const CELV::FileEntry&) { files++; });
+        if (files != expected_files[i])
+        {
+            std::cerr << "La version " << first + i << " tiene " << files << " archivos, se esperaban " << expected_files[i] << std::endl;
+            std::exit(1);
+        }
+    }
+
+    CELV::PersistenceStats stats;
+    check(file_system.GetPersistenceStats(stats, error_msg));
+
+    // Versiones al azar, casi nunca en el cache de resoluciones
+    CELV::Version last;
+    check(file_system.GetVersion(last, error_msg));
+    auto const read_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads; i++)
+        check(file_system.SetVersion(random() % (last + 1), error_msg));
+    std::chrono::duration<double, std::nano> const reading = std::chrono::steady_clock::now() - read_start;
+
+    std::cout << std::setw(10) << (branching ? "ramas" : "lineal")
+              << std::setw(10) << (mode == CELV::PersistenceMode::CHANGE_BOX ? "caja" : "bitacora") << std::setw(10) << stats.nodes
+              << std::setw(16) << stats.bytes / 1024 << std::setw(18) << std::fixed << std::setprecision(1) << writing.count() / modifications
+              << std::setw(16) << reading.count() / reads << std::endl;
+
+    file_system.Destroy();
+}
+
+int main(int argc, char** argv)
+{
+    const size_t depth = argc > 1 ? std::stoul(argv[1]) : 16;
+    const size_t modifications = argc > 2 ? std::stoul(argv[2]) : 100000;
+    const size_t reads = argc > 3 ? std::stoul(argv[3]) : 200000;
+
+    std::cout << "profundidad " << depth << ", " << modifications << " modificaciones\n";
+    std::cout << std::setw(10) << "caso" << std::setw(10) << "modo" << std::setw(10) << "nodos" << std::setw(16) << "memoria (KiB)"
+              << std::setw(18) << "escritura (ns)" << std::setw(16) << "lectura (ns)" << std::endl;
+
+    // Solo puede haber un sistema de archivos por proceso, y cada modo se mide sin la memoria del otro
+    for (auto const branching : {false, true})
+    {
+        for (auto const mode : {CELV::PersistenceMode::CHANGE_BOX, CELV::PersistenceMode::MODIFICATION_LOG})
+        {
+            auto const pid = fork();
+            if (pid == 0)
+            {
+                Run(mode, branching, depth, modifications, reads);
+                std::exit(0);
+            }
+
+            int status = 0;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                std::cerr << "No se pudo medir el modo de persistencia\n";
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <functional>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "FileSystem.hpp"
+
+// Mide cuanto tarda `cargar` segun el largo de la historia: se escribe un documento muchas veces, se guarda la sesion
+// y se carga en otro proceso, midiendo la carga y la primera lectura del documento.
+// Uso: snapshot-bench [escrituras maximas] [directorio de trabajo]
+namespace
+{
+    std::string error_msg;
+
+    void Check(STATUS status)
+    {
+        if (status == ERROR)
+        {
+            std::cerr << error_msg << std::endl;
+            std::exit(1);
+        }
+    }
+
+    void Save(size_t writes, const std::string& path)
+    {
+        CELV::FileSystem file_system;
+        Check(file_system.CreateFile("p", CELV::FileType::DIRECTORY, error_msg));
+        Check(file_system.ChangeDirectory("p", error_msg));
+        Check(file_system.InitCELV(error_msg));
+        Check(file_system.CreateFile("f", CELV::FileType::DOCUMENT, error_msg));
+        for (size_t i = 0; i < writes; i++)
+            Check(file_system.WriteFile("f", "contenido " + std::to_string(i), error_msg));
+
+        Check(file_system.Save(path, error_msg));
+        file_system.Destroy();
+    }
+
+    void Load(size_t writes, const std::string& path)
+    {
+        CELV::FileSystem file_system;
+        auto const start = std::chrono::steady_clock::now();
+        Check(file_system.Load(path, error_msg));
+        std::chrono::duration<double, std::milli> const loading = std::chrono::steady_clock::now() - start;
+
+        CELV::BlobRef content;
+        auto const read_start = std::chrono::steady_clock::now();
+        Check(file_system.ReadFile("f", content, error_msg));
+        std::chrono::duration<double, std::milli> const reading = std::chrono::steady_clock::now() - read_start;
+
+        std::cout << std::setw(12) << writes << std::setw(14) << std::fixed << std::setprecision(3) << loading.count()
+                  << std::setw(16) << reading.count() << std::endl;
+        file_system.Destroy();
+    }
+
+    /// @brief Run a function in a new process, since there can only be one file system per process
+    bool RunInChild(const std::function<void()>& function)
+    {
+        auto const pid = fork();
+        if (pid == 0)
+        {
+            function();
+            std::exit(0);
+        }
+
+        int status = 0;
+        return pid >= 0 && waitpid(pid, &status, 0) >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t max_writes = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+
+    std::cout << std::setw(12) << "escrituras" << std::setw(14) << "carga (ms)" << std::setw(16) << "lectura (ms)" << std::endl;
+    for (size_t writes = 10; writes <= max_writes; writes *= 10)
+    {
+        auto const path = directory + "/snapshot-bench-" + std::to_string(writes) + ".celv";
+        auto const measured = RunInChild([&] { Save(writes, path); }) && RunInChild([&] { Load(writes, path); });
+        unlink(path.c_str());
+        if (!measured)
+        {
+            std::cerr << "No se pudo medir la carga\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include "FileSystem.hpp"
+
+// Mide cuanto cuesta `celv_vamos` con el directorio de trabajo a distintas profundidades: la primera vez que se
+// visita cada version (el camino se resuelve desde la raiz) y al alternar entre dos versiones ya visitadas.
+// Uso: version-bench [versiones por profundidad] [cambios de version al alternar]
+int main(int argc, char** argv)
+{
+    const size_t versions = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const size_t switches = argc > 2 ? std::stoul(argv[2]) : 200000;
+
+    CELV::FileSystem file_system;
+    std::string error_msg;
+    auto const check = [&](STATUS status) {
+        if (status == ERROR)
+        {
+            std::cerr << error_msg << std::endl;
+            std::exit(1);
+        }
+    };
+
+    check(file_system.CreateFile("p", CELV::FileType::DIRECTORY, error_msg));
+    check(file_system.ChangeDirectory("p", error_msg));
+    check(file_system.InitCELV(error_msg));
+
+    // Se baja por una sola cadena de directorios, midiendo en cada profundidad
+    std::cout << std::setw(12) << "profundidad" << std::setw(16) << "primera (ns)" << std::setw(17) << "alternando (ns)" << "\n";
+    size_t depth = 0;
+    for (size_t const next_depth : {4, 32, 256, 1024})
+    {
+        for (; depth < next_depth; depth++)
+        {
+            check(file_system.CreateFile("d", CELV::FileType::DIRECTORY, error_msg));
+            check(file_system.ChangeDirectory("d", error_msg));
+        }
+
+        // Versiones que difieren en un documento del directorio mas profundo
+        CELV::Version first;
+        check(file_system.GetVersion(first, error_msg));
+        for (size_t i = 0; i < versions; i++)
+            check(file_system.CreateFile("f" + std::to_string(depth) + "_" + std::to_string(i), CELV::FileType::DOCUMENT, error_msg));
+
+        auto const start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < versions; i++)
+            check(file_system.SetVersion(first + i, error_msg));
+        std::chrono::duration<double, std::nano> const cold = std::chrono::steady_clock::now() - start;
+
+        // Termina en la ultima version, para seguir bajando desde ella
+        auto const ping_pong_start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < switches; i++)
+            check(file_system.SetVersion(i % 2 == 0 ? first : first + versions, error_msg));
+        std::chrono::duration<double, std::nano> const ping_pong = std::chrono::steady_clock::now() - ping_pong_start;
+
+        std::cout << std::setw(12) << depth << std::setw(16) << std::fixed << std::setprecision(1) << cold.count() / versions
+                  << std::setw(17) << ping_pong.count() / switches << "\n";
+    }
+
+    file_system.Destroy();
+    return 0;
+}
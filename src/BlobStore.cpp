@@ -0,0 +1,108 @@
+#include "BlobStore.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace CELV
+{
+    BlobStore::BlobStore()
+        : _blobs()
+        , _deltas()
+        , _requested_bytes(0)
+        , _allocated_bytes(0)
+        , _next_cleanup(1024)
+    { }
+
+    size_t Blob::Hash(std::string_view data)
+    {
+        return std::hash<std::string_view>{}(data);
+    }
+
+    BlobRef BlobStore::Intern(std::string&& data)
+    {
+        _requested_bytes += data.size();
+        auto const hash = Blob::Hash(data);
+
+        auto const existing_blob = Find(data, hash);
+        if (existing_blob != nullptr)
+            return existing_blob;
+
+        if (_blobs.size() >= _next_cleanup)
+            RemoveExpired();
+
+        auto const blob = std::make_shared<const Blob>(std::move(data), hash);
+        _blobs.emplace(hash, blob);
+        _allocated_bytes += blob->Size();
+        return blob;
+    }
+
+    BlobRef BlobStore::Find(std::string_view data) const
+    {
+        return Find(data, Blob::Hash(data));
+    }
+
+    BlobRef BlobStore::Find(std::string_view data, size_t hash) const
+    {
+        // Different contents might share the same hash, so compare actual bytes
+        auto [it, end] = _blobs.equal_range(hash);
+        for (; it != end; ++it)
+        {
+            auto blob = it->second.lock();
+            if (blob != nullptr && blob->GetData() == data)
+                return blob;
+        }
+
+        return nullptr;
+    }
+
+    void BlobStore::AddDelta(const ContentRef& delta, size_t encoded_bytes)
+    {
+        _requested_bytes += delta->Size();
+        _allocated_bytes += encoded_bytes;
+
+        if (_blobs.size() + _deltas.size() >= _next_cleanup)
+            RemoveExpired();
+
+        _deltas.emplace_back(delta, encoded_bytes);
+    }
+
+    BlobStore::Stats BlobStore::GetStats() const
+    {
+        Stats stats{0, 0, _requested_bytes, _allocated_bytes};
+        for (auto const& [hash, possible_blob] : _blobs)
+        {
+            auto const blob = possible_blob.lock();
+            if (blob == nullptr)
+                continue;
+
+            stats.blobs++;
+            stats.stored_bytes += blob->Size();
+        }
+
+        for (auto const& [delta, encoded_bytes] : _deltas)
+        {
+            if (delta.expired())
+                continue;
+
+            stats.blobs++;
+            stats.stored_bytes += encoded_bytes;
+        }
+
+        return stats;
+    }
+
+    void BlobStore::RemoveExpired()
+    {
+        for (auto it = _blobs.begin(); it != _blobs.end();)
+        {
+            if (it->second.expired())
+                it = _blobs.erase(it);
+            else
+                ++it;
+        }
+
+        _deltas.erase(std::remove_if(_deltas.begin(), _deltas.end(), [](auto const& delta) { return delta.first.expired(); }), _deltas.end());
+
+        // Amortize cost of cleanup over the next insertions
+        _next_cleanup = 2 * (_blobs.size() + _deltas.size()) + 1024;
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef BLOB_STORE_HPP
+#define BLOB_STORE_HPP
+#include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Content.hpp"
+
+namespace CELV
+{
+    /// @brief Content stored as plain bytes. Blobs are shared by every file with the same content. Bytes are usually
+    /// owned by the blob, but might live in external memory, like a file mapped to memory
+    class Blob : public Content, public std::enable_shared_from_this<Blob>
+    {
+        public:
+        /// @brief Create a new blob
+        /// @param data bytes stored in this blob
+        /// @param hash hash of `data`
+        Blob(std::string&& data, size_t hash) : _storage(std::move(data)), _data(_storage), _owner(nullptr), _hash(hash) { }
+
+        /// @brief Create a new blob
+        /// @param data bytes stored in this blob
+        Blob(std::string&& data) : _storage(std::move(data)), _data(_storage), _owner(nullptr), _hash(Hash(_data)) { }
+
+        /// @brief Create a new blob referring to bytes in external memory
+        /// @param data bytes of this blob
+        /// @param owner object keeping `data` alive, released with this blob
+        Blob(std::string_view data, std::shared_ptr<const void> owner) : _storage(), _data(data), _owner(std::move(owner)), _hash(0) { }
+
+        Blob(const Blob&) = delete;
+        Blob& operator=(const Blob&) = delete;
+
+        /// @brief Hash function used to index contents
+        /// @param data bytes to hash
+        /// @return hash of data
+        static size_t Hash(std::string_view data);
+
+        /// @brief Get bytes stored in this blob
+        /// @return content of this blob
+        std::string_view GetData() const { return _data; }
+
+        /// @brief Get size in bytes of this blob
+        /// @return size of this blob
+        size_t Size() const override { return _data.size(); }
+
+        /// @brief Blobs already store their full content
+        /// @return this blob
+        BlobRef Materialize() const override { return shared_from_this(); }
+
+        /// @brief Get hash of content of this blob. Blobs in external memory are hashed on demand, to avoid touching
+        /// their bytes until needed
+        /// @return hash of content
+        size_t GetHash() const { return _owner == nullptr ? _hash : Hash(_data); }
+
+        private:
+        std::string _storage; // Bytes owned by this blob, if any
+        std::string_view _data;
+        std::shared_ptr<const void> _owner; // Owner of external memory, if any
+        size_t _hash; // Only for bytes owned by this blob
+    };
+
+    using BlobRef = std::shared_ptr<const Blob>;
+
+    /// @brief Content addressed storage for document contents. Contents are indexed by their hash, so storing the same
+    /// bytes twice returns the same blob instead of a copy. The store doesn't own blobs, a blob is released when
+    /// no file refers to it anymore.
+    class BlobStore
+    {
+        public:
+        /// @brief Stats about deduplication performed by this store
+        struct Stats
+        {
+            size_t blobs; // Amount of blobs and deltas currently alive
+            size_t stored_bytes; // Bytes currently stored in blobs and deltas alive
+            size_t requested_bytes; // Bytes requested to be stored so far
+            size_t allocated_bytes; // Bytes actually stored so far, after deduplication
+        };
+
+        BlobStore();
+
+        /// @brief Get a blob with the specified content, reusing an existing one if some blob already has it
+        /// @param data content of blob
+        /// @return blob with such content
+        BlobRef Intern(std::string&& data);
+
+        /// @brief Get a blob with the specified content, reusing an existing one if some blob already has it
+        /// @param data content of blob
+        /// @return blob with such content
+        BlobRef Intern(std::string_view data) { return Intern(std::string(data)); }
+
+        /// @brief Search a blob alive with the specified content, without storing it if there's none
+        /// @param data content to search
+        /// @return blob with such content, or nullptr if no blob has it
+        BlobRef Find(std::string_view data) const;
+
+        /// @brief Account a content stored as a delta somewhere else, so stats include it
+        /// @param delta content stored as delta
+        /// @param encoded_bytes bytes actually used to store such delta
+        void AddDelta(const ContentRef& delta, size_t encoded_bytes);
+
+        /// @brief Get stats about this store
+        /// @return Stats about stored blobs and deduplication
+        Stats GetStats() const;
+
+        private:
+        /// @brief Search a blob alive with the specified content and hash
+        BlobRef Find(std::string_view data, size_t hash) const;
+
+        /// @brief Remove entries whose blob was already released
+        void RemoveExpired();
+
+        private:
+        std::unordered_multimap<size_t, std::weak_ptr<const Blob>> _blobs;
+        std::vector<std::pair<std::weak_ptr<const Content>, size_t>> _deltas; // Deltas alive and their encoded size
+        size_t _requested_bytes;
+        size_t _allocated_bytes;
+        size_t _next_cleanup; // Size of index that triggers next removal of expired entries
+    };
+}
+
+#endif
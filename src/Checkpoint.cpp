@@ -0,0 +1,412 @@
+#include "Checkpoint.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <unordered_map>
+
+namespace CELV
+{
+    namespace
+    {
+        constexpr char SEGMENT_PREFIX[] = "segmento-";
+        constexpr char SEGMENT_EXTENSION[] = ".celv";
+    }
+
+    CheckpointStore::CheckpointStore()
+        : _next_segment(0)
+        , _compacting(false)
+        , _has_compaction_stats(false)
+    {
+
+    }
+
+    STATUS CheckpointStore::Open(const std::string& directory, std::vector<std::shared_ptr<const MappedSnapshot>>& out_chain, std::string& out_error_msg)
+    {
+        // Segments of this store might be being merged
+        WaitCompaction();
+
+        auto const segments = ListSegments(directory);
+        if (segments.empty())
+        {
+            out_error_msg = "'" + directory + "' has no checkpoints";
+            return ERROR;
+        }
+
+        // The last state starts at the last full segment, segments before it are not needed anymore
+        std::vector<std::shared_ptr<const MappedSnapshot>> chain;
+        std::vector<uint64_t> numbers;
+        for (auto segment = segments.rbegin(); segment != segments.rend(); ++segment)
+        {
+            auto snapshot = MappedSnapshot::Open(SegmentPath(directory, *segment), out_error_msg);
+            if (snapshot == nullptr)
+                return ERROR;
+
+            auto const is_full = snapshot->GetHeader().incremental == 0;
+            chain.push_back(std::move(snapshot));
+            numbers.push_back(*segment);
+            if (is_full)
+                break;
+        }
+
+        std::reverse(chain.begin(), chain.end());
+        std::reverse(numbers.begin(), numbers.end());
+        if (!IsValidChain(chain))
+        {
+            out_error_msg = "Checkpoints in '" + directory + "' are incomplete or corrupt";
+            return ERROR;
+        }
+
+        std::error_code error;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _directory = std::filesystem::absolute(directory, error).string();
+        _next_segment = segments.back() + 1;
+        _chain = std::move(numbers);
+        out_chain = std::move(chain);
+        return SUCCESS;
+    }
+
+    STATUS CheckpointStore::Create(const std::string& directory, std::string& out_error_msg)
+    {
+        WaitCompaction();
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (!std::filesystem::is_directory(directory, error))
+        {
+            out_error_msg = "Could not create checkpoint directory '" + directory + "'";
+            return ERROR;
+        }
+
+        // Segments already there are left untouched, new ones go after them
+        auto const segments = ListSegments(directory);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _directory = std::filesystem::absolute(directory, error).string();
+        _next_segment = segments.empty() ? 0 : segments.back() + 1;
+        _chain.clear();
+        return SUCCESS;
+    }
+
+    void CheckpointStore::Close()
+    {
+        WaitCompaction();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _directory.clear();
+        _chain.clear();
+        _next_segment = 0;
+    }
+
+    size_t CheckpointStore::Commit(bool incremental)
+    {
+        std::vector<uint64_t> segments;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!incremental)
+                _chain.clear();
+            _chain.push_back(_next_segment++);
+
+            if (_compacting || _chain.size() < COMPACTION_THRESHOLD)
+                return 0;
+
+            segments = _chain;
+            _compacting = true;
+        }
+
+        // A previous compaction already finished, its thread only needs to be released
+        if (_compaction.joinable())
+            _compaction.join();
+
+        _compaction = std::thread(&CheckpointStore::Compact, this, _directory, segments);
+        return segments.size();
+    }
+
+    bool CheckpointStore::TakeCompactionStats(CompactionStats& out_stats)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_has_compaction_stats)
+            return false;
+
+        out_stats = _compaction_stats;
+        _has_compaction_stats = false;
+        return true;
+    }
+
+    void CheckpointStore::WaitCompaction()
+    {
+        if (_compaction.joinable())
+            _compaction.join();
+    }
+
+    void CheckpointStore::Compact(std::string directory, std::vector<uint64_t> segments)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        CompactionStats stats;
+        stats.segments = segments.size();
+
+        std::vector<std::shared_ptr<const MappedSnapshot>> chain;
+        for (auto const segment : segments)
+        {
+            auto snapshot = MappedSnapshot::Open(SegmentPath(directory, segment), stats.error);
+            if (snapshot == nullptr)
+                break;
+            chain.push_back(std::move(snapshot));
+        }
+
+        // The merged segment replaces the last one, which stores the same state. Readers of the store start from
+        // the last full segment, so older segments are ignored even if removing them fails
+        auto const path = SegmentPath(directory, segments.back());
+        auto const merged = chain.size() == segments.size() && Merge(chain, path, stats.error) == SUCCESS;
+        chain.clear();
+        if (merged)
+        {
+            for (size_t i = 0; i + 1 < segments.size(); i++)
+                std::remove(SegmentPath(directory, segments[i]).c_str());
+
+            std::error_code error;
+            stats.bytes = std::filesystem::file_size(path, error);
+        }
+
+        std::chrono::duration<double> const seconds = std::chrono::steady_clock::now() - start;
+        stats.seconds = seconds.count();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (merged && directory == _directory)
+        {
+            auto const last = std::find(_chain.begin(), _chain.end(), segments.back());
+            _chain.erase(_chain.begin(), last);
+        }
+        _compaction_stats = std::move(stats);
+        _has_compaction_stats = true;
+        _compacting = false;
+    }
+
+    bool CheckpointStore::IsValidChain(const std::vector<std::shared_ptr<const MappedSnapshot>>& chain)
+    {
+        if (chain.empty() || chain.front()->GetHeader().incremental != 0)
+            return false;
+
+        for (size_t i = 1; i < chain.size(); i++)
+        {
+            auto const& header = chain[i]->GetHeader();
+            auto const& previous_header = chain[i - 1]->GetHeader();
+            if (header.incremental == 0)
+                return false;
+
+            auto const celvs = chain[i]->Array<CelvRecord>(header.celvs);
+            auto const previous_celvs = chain[i - 1]->Array<CelvRecord>(previous_header.celvs);
+            for (size_t j = 0; j < header.celvs.count; j++)
+            {
+                auto const& celv = celvs[j];
+                if (celv.previous == SNAPSHOT_NONE)
+                    continue;
+
+                // Every table continues where the same table of the previous segment ended
+                if (celv.previous >= previous_header.celvs.count)
+                    return false;
+
+                auto const end = GetTableEnd(previous_celvs[celv.previous]);
+                auto const& origin = celv.origin;
+                if (origin.node != end.node || origin.file != end.file || origin.version != end.version
+                    || origin.action != end.action || origin.change_box != end.change_box)
+                    return false;
+
+                auto const patches = chain[i]->Array<NodePatchRecord>(celv.node_patches);
+                for (size_t k = 0; k < celv.node_patches.count; k++)
+                    if (patches[k].node >= origin.node || patches[k].change_box >= origin.node + celv.nodes.count)
+                        return false;
+            }
+        }
+
+        return true;
+    }
+
+    STATUS CheckpointStore::Merge(const std::vector<std::shared_ptr<const MappedSnapshot>>& chain, const std::string& path, std::string& out_error_msg)
+    {
+        if (!IsValidChain(chain))
+        {
+            out_error_msg = "Can't merge an invalid chain of segments";
+            return ERROR;
+        }
+
+        SnapshotWriter writer(path);
+
+        // Contents are copied once per segment. They're kept alive until the end, since the writer recognizes
+        // contents already written by address
+        std::vector<std::vector<uint64_t>> content_indices(chain.size());
+        std::vector<ContentRef> contents;
+        auto const copy_content = [&](size_t segment, uint64_t index) {
+            auto& indices = content_indices[segment];
+            if (indices.empty())
+                indices.assign(chain[segment]->GetHeader().contents.count, SNAPSHOT_NONE);
+
+            if (indices[index] == SNAPSHOT_NONE)
+            {
+                contents.push_back(chain[segment]->GetContent(index));
+                indices[index] = writer.WriteContent(contents.back());
+            }
+            return indices[index];
+        };
+
+        // Corrupt data is never rewritten into a full segment that would look valid
+        auto const copy_files = [&](size_t segment, const SnapshotRange& range, std::vector<FileRecord>& out_files) {
+            auto const& snapshot = *chain[segment];
+            auto const files = snapshot.Array<FileRecord>(range);
+            auto const content_count = snapshot.GetHeader().contents.count;
+            for (size_t i = 0; i < range.count; i++)
+            {
+                auto const& file = files[i];
+                auto const is_document = file.type == FileRecord::DOCUMENT;
+                if (!is_document && file.type != FileRecord::DIRECTORY)
+                {
+                    out_error_msg = "File " + std::to_string(i) + " of segment " + std::to_string(segment) + " has an unknown type";
+                    return false;
+                }
+                if (is_document && file.content >= content_count)
+                {
+                    out_error_msg = "File " + std::to_string(i) + " of segment " + std::to_string(segment) + " refers to a missing content";
+                    return false;
+                }
+
+                out_files.push_back(FileRecord{writer.WriteBytes(snapshot.Bytes(file.name)), file.type, is_document ? copy_content(segment, file.content) : SNAPSHOT_NONE});
+            }
+            return true;
+        };
+
+        std::vector<ChildRecord> childs;
+        auto const copy_nodes = [&](size_t segment, const SnapshotRange& range, const std::unordered_map<uint64_t, uint64_t>& patches,
+                                    uint64_t first, std::vector<NodeRecord>& out_nodes) {
+            auto const& snapshot = *chain[segment];
+            auto const nodes = snapshot.Array<NodeRecord>(range);
+            for (size_t i = 0; i < range.count; i++)
+            {
+                auto node = nodes[i];
+                auto const records = snapshot.Array<ChildRecord>(node.childs);
+                childs.assign(records, records + node.childs.count);
+                node.childs = writer.WriteArray(childs);
+
+                auto const patch = patches.find(first + i);
+                if (patch != patches.end())
+                    node.change_box = patch->second;
+                out_nodes.push_back(node);
+            }
+        };
+
+        // Nodes not managed by any celv are fully stored in every segment, the last one is up to date
+        auto const last = chain.size() - 1;
+        auto const& last_header = chain[last]->GetHeader();
+        SnapshotHeader header{};
+        header.root = last_header.root;
+        header.working_directory = last_header.working_directory;
+
+        std::vector<FileRecord> files;
+        if (!copy_files(last, last_header.files, files))
+            return ERROR;
+        header.files = writer.WriteArray(files);
+
+        std::vector<NodeRecord> nodes;
+        copy_nodes(last, last_header.nodes, {}, 0, nodes);
+        header.nodes = writer.WriteArray(nodes);
+
+        std::vector<CelvRecord> celvs;
+        auto const last_celvs = chain[last]->Array<CelvRecord>(last_header.celvs);
+        for (size_t i = 0; i < last_header.celvs.count; i++)
+        {
+            // Find the layer of this celv in every segment storing it, oldest first
+            std::vector<std::pair<size_t, const CelvRecord*>> layers;
+            size_t segment = last;
+            const CelvRecord* record = &last_celvs[i];
+            layers.emplace_back(segment, record);
+            while (record->previous != SNAPSHOT_NONE)
+            {
+                auto const& header = chain[--segment]->GetHeader();
+                record = &chain[segment]->Array<CelvRecord>(header.celvs)[record->previous];
+                layers.emplace_back(segment, record);
+            }
+            std::reverse(layers.begin(), layers.end());
+
+            std::unordered_map<uint64_t, uint64_t> patches;
+            for (auto const& [layer_segment, layer] : layers)
+            {
+                auto const layer_patches = chain[layer_segment]->Array<NodePatchRecord>(layer->node_patches);
+                for (size_t j = 0; j < layer->node_patches.count; j++)
+                    patches[layer_patches[j].node] = layer_patches[j].change_box;
+            }
+
+            files.clear();
+            nodes.clear();
+            std::vector<uint64_t> versions;
+            std::vector<ActionRecord> actions;
+            std::vector<ChangeBoxRecord> change_boxes;
+            std::vector<SnapshotRange> args;
+            for (auto const& [layer_segment, layer] : layers)
+            {
+                auto const& snapshot = *chain[layer_segment];
+                if (!copy_files(layer_segment, layer->files, files))
+                    return ERROR;
+                copy_nodes(layer_segment, layer->nodes, patches, layer->origin.node, nodes);
+
+                auto const layer_versions = snapshot.Array<uint64_t>(layer->versions);
+                versions.insert(versions.end(), layer_versions, layer_versions + layer->versions.count);
+
+                auto const layer_actions = snapshot.Array<ActionRecord>(layer->history);
+                for (size_t j = 0; j < layer->history.count; j++)
+                {
+                    auto action = layer_actions[j];
+                    auto const action_args = snapshot.Array<SnapshotRange>(action.args);
+                    args.clear();
+                    for (size_t k = 0; k < action.args.count; k++)
+                        args.push_back(writer.WriteBytes(snapshot.Bytes(action_args[k])));
+                    action.args = writer.WriteArray(args);
+                    actions.push_back(action);
+                }
+
+                auto const layer_change_boxes = snapshot.Array<ChangeBoxRecord>(layer->change_boxes);
+                change_boxes.insert(change_boxes.end(), layer_change_boxes, layer_change_boxes + layer->change_boxes.count);
+            }
+
+            CelvRecord merged = *layers.back().second;
+            merged.files = writer.WriteArray(files);
+            merged.nodes = writer.WriteArray(nodes);
+            merged.versions = writer.WriteArray(versions);
+            merged.history = writer.WriteArray(actions);
+            merged.change_boxes = writer.WriteArray(change_boxes);
+            merged.node_patches = SnapshotRange{0, 0};
+            merged.origin = CelvOrigin{};
+            merged.previous = SNAPSHOT_NONE;
+            celvs.push_back(merged);
+        }
+        header.celvs = writer.WriteArray(celvs);
+
+        return writer.Finish(header, out_error_msg);
+    }
+
+    std::string CheckpointStore::SegmentPath(const std::string& directory, uint64_t segment)
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "%s%06llu%s", SEGMENT_PREFIX, static_cast<unsigned long long>(segment), SEGMENT_EXTENSION);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    std::vector<uint64_t> CheckpointStore::ListSegments(const std::string& directory)
+    {
+        std::vector<uint64_t> segments;
+        std::error_code error;
+        for (auto const& entry : std::filesystem::directory_iterator(directory, error))
+        {
+            // Only complete segments, temporary files of unfinished writes are ignored
+            auto const name = entry.path().filename().string();
+            std::string const prefix = SEGMENT_PREFIX, extension = SEGMENT_EXTENSION;
+            if (name.size() <= prefix.size() + extension.size() || name.compare(0, prefix.size(), prefix) != 0
+                || name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+                continue;
+
+            auto const number = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+            if (number.find_first_not_of("0123456789") == std::string::npos)
+                segments.push_back(std::stoull(number));
+        }
+
+        std::sort(segments.begin(), segments.end());
+        return segments;
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include "Core.hpp"
+#include "Snapshot.hpp"
+
+namespace CELV
+{
+    /// @brief Stats about the last compaction of a checkpoint store
+    struct CompactionStats
+    {
+        size_t segments = 0; // Segments merged
+        uint64_t bytes = 0; // Size of the merged segment
+        double seconds = 0;
+        std::string error; // Empty if compaction succeeded
+    };
+
+    /// @brief A directory storing checkpoints of a file system as a sequence of segments. The first segment of a
+    /// chain is a full snapshot, every following one is an incremental snapshot that only stores what was added
+    /// after the previous one, so the state of the file system is the whole chain. When a chain gets long, its
+    /// segments are merged in the background into a single full segment, which replaces the last of them.
+    class CheckpointStore
+    {
+        public:
+        CheckpointStore();
+
+        /// @brief Wait for a compaction in progress, if any
+        ~CheckpointStore() { WaitCompaction(); }
+
+        CheckpointStore(const CheckpointStore&) = delete;
+        CheckpointStore& operator=(const CheckpointStore&) = delete;
+
+        /// @brief Open an existing store and map the segments of the last state it stores
+        /// @param directory directory of the store
+        /// @param out_chain segments from the last full segment to the last segment
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Open(const std::string& directory, std::vector<std::shared_ptr<const MappedSnapshot>>& out_chain, std::string& out_error_msg);
+
+        /// @brief Start writing checkpoints to a directory, creating it if needed. The next segment must be full
+        /// @param directory directory of the store
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Create(const std::string& directory, std::string& out_error_msg);
+
+        /// @brief Stop using the current store
+        void Close();
+
+        bool IsOpen() const { return !_directory.empty(); }
+
+        /// @brief Get absolute path of directory of this store
+        const std::string& GetDirectory() const { return _directory; }
+
+        /// @brief Get path where the next segment should be written
+        std::string GetNextSegmentPath() const { return SegmentPath(_directory, _next_segment); }
+
+        /// @brief Register that the next segment was written. Starts merging the current chain in the background if
+        /// it's long enough and no compaction is running
+        /// @param incremental if the segment only adds to the previous one
+        /// @return amount of segments being merged, 0 if no compaction was started
+        size_t Commit(bool incremental);
+
+        /// @brief Get stats of the last compaction finished since the last call to this function
+        /// @param out_stats stats of compaction
+        /// @return if a compaction finished since the last call
+        bool TakeCompactionStats(CompactionStats& out_stats);
+
+        /// @brief Block until the compaction in progress, if any, finishes
+        void WaitCompaction();
+
+        /// @brief Merge a chain of segments into a single full snapshot
+        /// @param chain segments to merge, starting with a full one
+        /// @param path where to write the merged snapshot
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        static STATUS Merge(const std::vector<std::shared_ptr<const MappedSnapshot>>& chain, const std::string& path, std::string& out_error_msg);
+
+        /// @brief Check that every segment of a chain continues the previous one
+        /// @param chain chain to check, starting with a full segment
+        /// @return if chain is valid
+        static bool IsValidChain(const std::vector<std::shared_ptr<const MappedSnapshot>>& chain);
+
+        /// @brief Chains with this many segments are merged
+        static constexpr size_t COMPACTION_THRESHOLD = 8;
+
+        private:
+        /// @brief Path to a segment of a store
+        static std::string SegmentPath(const std::string& directory, uint64_t segment);
+
+        /// @brief List numbers of segments in a store, sorted
+        static std::vector<uint64_t> ListSegments(const std::string& directory);
+
+        /// @brief Merge segments of a chain into the last of them, removing the others. Runs in the background
+        /// @param directory directory of the store
+        /// @param segments numbers of segments to merge
+        void Compact(std::string directory, std::vector<uint64_t> segments);
+
+        private:
+        std::string _directory;
+        uint64_t _next_segment;
+        std::vector<uint64_t> _chain; // Segments of the current chain, starting with a full one
+        std::thread _compaction;
+        std::mutex _mutex; // Protects chain and stats, shared with the compaction thread
+        bool _compacting;
+        CompactionStats _compaction_stats;
+        bool _has_compaction_stats;
+    };
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include <filesystem>
 #include <stdio.h>
 #include <fstream>
+#include <chrono>
+#include <vector>
 #include "Core.hpp"
 
 namespace CELV
@@ -18,7 +20,7 @@ namespace CELV
     {
         std::cout << "Consola CELV iniciada!" << std::endl;
         std::cout << "Escribe `ayuda` para la lista de comandos disponibles" << std::endl;
-        std::cout << "Escribe `salir` para terminar esta sesión. Recuerda que los cambios serán descartados al salir" << std::endl;
+        std::cout << "Escribe `salir` para terminar esta sesión. Recuerda que los cambios que no guardes con `guardar` o registres con `diario` serán descartados al salir" << std::endl;
 
         _running = true;
         // Parse first word of terminal, as a command
@@ -55,6 +57,9 @@ namespace CELV
 
         std::string command; 
         ss >> command;
+
+        ReportBackgroundSave();
+        ReportCompaction();
         
         if (command == "ayuda")
             Help();
@@ -107,6 +112,32 @@ namespace CELV
             else 
                 std::cerr << "Missing argument for command: " << command << std::endl;
         }
+        else if (command == "anexar")
+        {
+            std::string name;
+            std::string content;
+            ss >> name >> std::ws;
+            std::getline(ss, content);
+
+            if (name != "")
+                Append(name, content); 
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "escribir_en")
+        {
+            std::string name;
+            size_t offset;
+            std::string content;
+            if ((ss >> name) && (ss >> offset))
+            {
+                ss >> std::ws;
+                std::getline(ss, content);
+                WriteRange(name, offset, content);
+            }
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
         else if (command == "ir")
         {
             std::string dir_to_go;
@@ -115,14 +146,14 @@ namespace CELV
             else 
                 Go();
         }
-        else if (command == "celv_importar")
+        else if (command == "celv_importar" || command == "celv_importar_perezoso")
         {
             ss >> std::ws;
             std::string content;
             std::getline(ss, content);
 
             if (content != "")
-                Import(content); 
+                Import(content, command == "celv_importar_perezoso"); 
             else 
                 std::cerr << "Missing argument for command: " << command << std::endl;
         }
@@ -146,6 +177,26 @@ namespace CELV
         {
             CELVVersion();
         }
+        else if (command == "celv_modo_almacenamiento")
+        {
+            std::string mode;
+            if (ss >> mode)
+                CELVStorageMode(mode);
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "celv_modo_persistencia")
+        {
+            std::string mode;
+            if (ss >> mode)
+                CELVPersistenceMode(mode);
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "celv_nodos")
+        {
+            CELVNodes();
+        }
         else if (command == "celv_fusion")
         {
             Version version1;
@@ -155,9 +206,94 @@ namespace CELV
             else 
                 std::cerr << "Missing argument for command: " << command << std::endl;
         }
+        else if (command == "celv_diff")
+        {
+            Version version1;
+            Version version2;
+            if ((ss >> version1) && (ss >> version2)) 
+                CELVDiff(version1, version2); 
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
         else if (command == "ls")
         {
-            List();
+            ListOptions options;
+            std::vector<std::string> arguments;
+            for (std::string argument; ss >> argument;)
+                arguments.push_back(argument);
+
+            auto it = arguments.begin();
+            if (it != arguments.end() && *it == "ordenado")
+            {
+                options.sorted = true;
+                ++it;
+            }
+
+            // Optional page: position of first entry and amount of entries
+            auto const parse_number = [](const std::string& argument, size_t& out_number) {
+                std::stringstream number(argument);
+                return argument.find_first_not_of("0123456789") == std::string::npos && (number >> out_number);
+            };
+
+            size_t offset, limit;
+            bool valid = arguments.end() - it <= 2;
+            if (valid && it != arguments.end() && (valid = parse_number(*it++, offset)))
+                options.offset = offset;
+            if (valid && it != arguments.end() && (valid = parse_number(*it++, limit)))
+                options.limit = limit;
+
+            if (valid)
+                List(options);
+            else
+                std::cerr << RED << "Invalid argument for command: " << command << RESET << std::endl;
+        }
+        else if (command == "almacenamiento")
+        {
+            StorageStats();
+        }
+        else if (command == "guardar")
+        {
+            std::string path;
+            if (ss >> path)
+                Save(path);
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "guardar_fondo")
+        {
+            std::string path;
+            if (ss >> path)
+                SaveInBackground(path);
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "cargar")
+        {
+            std::string path;
+            if (ss >> path)
+                Load(path);
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "diario")
+        {
+            std::string path;
+            std::string sync_policy = "siempre";
+            if (ss >> path)
+            {
+                ss >> sync_policy;
+                Journal(path, sync_policy);
+            }
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
+        }
+        else if (command == "punto_control")
+        {
+            std::string directory;
+            if (ss >> directory)
+                Checkpoint(directory);
+            else 
+                std::cerr << "Missing argument for command: " << command << std::endl;
         }
         else 
         {
@@ -189,7 +325,8 @@ namespace CELV
 
     void Client::Read(const std::string& filename)
     {
-        std::string error, content;
+        std::string error;
+        BlobRef content;
 
         if(_filesystem.ReadFile(filename, content, error) == ERROR)
         {
@@ -197,7 +334,9 @@ namespace CELV
             return;
         }
         
-        std::cout << content << std::endl;
+        // Write straight from the stored buffer, without copying it
+        auto const& data = content->GetData();
+        std::cout.write(data.data(), data.size()) << std::endl;
     }
 
     void Client::Write(const std::string& filename, const std::string& content)
@@ -207,6 +346,20 @@ namespace CELV
             std::cerr << RED << error << RESET << std::endl;
     }
 
+    void Client::Append(const std::string& filename, const std::string& content)
+    {
+        std::string error;
+        if(_filesystem.AppendFile(filename, content, error) == ERROR)
+            std::cerr << RED << error << RESET << std::endl;
+    }
+
+    void Client::WriteRange(const std::string& filename, size_t offset, const std::string& content)
+    {
+        std::string error;
+        if(_filesystem.WriteFileRange(filename, offset, content, error) == ERROR)
+            std::cerr << RED << error << RESET << std::endl;
+    }
+
     void Client::Go(const std::string& filename)
     {
         std::string error;
@@ -221,22 +374,171 @@ namespace CELV
             std::cerr << RED << error << RESET << std::endl;
     }
 
-    void Client::List()
+    void Client::List(const ListOptions& options)
+    {
+        _filesystem.List(options, [](const FileEntry& entry) {
+            std::cout << (entry.type == FileType::DIRECTORY ? BLUE : GREEN) << entry.name  << RESET << std::endl;
+        });
+    }
+
+    void Client::Import(const std::string& local_filepath, bool lazy)
     {
-        auto const &files = _filesystem.List();
-        for (auto const& my_file : files)
+        std::string error_msg;
+        ImportStats stats;
+        bool reported_progress = false;
+        ImportOptions options;
+        options.lazy = lazy;
+        options.on_progress = [&reported_progress](const ImportStats& progress) {
+            std::cerr << "\rImportando: " << progress.documents << " archivos, " << progress.directories << " directorios, "
+                      << progress.bytes / (1024 * 1024) << " MiB (" << progress.GetThroughput() / (1024 * 1024) << " MiB/s)" << std::flush;
+            reported_progress = true;
+        };
+
+        auto const status = _filesystem.Import(local_filepath, error_msg, stats, options);
+        if (reported_progress)
+            std::cerr << std::endl;
+
+        if(status == ERROR)
         {
-            std::cout << (my_file.GetFileType() == FileType::DIRECTORY ? BLUE : GREEN) << my_file.GetName()  << RESET << std::endl;
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return;
         }
+
+        std::cout << "Importados " << stats.documents << " archivos y " << stats.directories << " directorios (" << stats.bytes << " bytes) en "
+                  << stats.seconds << " s (" << stats.GetThroughput() / (1024 * 1024) << " MiB/s)" << std::endl;
+        if (stats.skipped > 0)
+            std::cerr << YELLOW << "Omitidos " << stats.skipped << " archivos que no se pudieron leer" << RESET << std::endl;
     }
 
-    void Client::Import(const std::string& local_filepath)
+    void Client::StorageStats() const
+    {
+        auto const stats = _filesystem.GetStorageStats();
+        auto const ratio = stats.allocated_bytes == 0 ? 1.0 : static_cast<double>(stats.requested_bytes) / stats.allocated_bytes;
+
+        std::cout << "Contenidos almacenados: " << stats.blobs << " (" << stats.stored_bytes << " bytes)" << std::endl;
+        std::cout << "Bytes escritos: " << stats.requested_bytes << std::endl;
+        std::cout << "Bytes reservados: " << stats.allocated_bytes << std::endl;
+        std::cout << "Tasa de deduplicación: " << ratio << "x" << std::endl;
+    }
+
+    void Client::Save(const std::string& path)
     {
         std::string error_msg;
-        if(_filesystem.Import(local_filepath, error_msg) == ERROR)
+        auto const start = std::chrono::steady_clock::now();
+        if (_filesystem.Save(path, error_msg) == ERROR)
         {
             std::cerr << RED << error_msg << RESET << std::endl;
+            return;
         }
+
+        std::chrono::duration<double> const seconds = std::chrono::steady_clock::now() - start;
+        std::error_code error;
+        std::cout << "Sesión guardada en '" << path << "' (" << std::filesystem::file_size(path, error) << " bytes) en " << seconds.count() << " s" << std::endl;
+    }
+
+    void Client::SaveInBackground(const std::string& path)
+    {
+        std::string error_msg;
+        double pause_seconds;
+        if (_filesystem.SaveInBackground(path, pause_seconds, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return;
+        }
+
+        std::cout << "Guardando la sesión en '" << path << "' en segundo plano (pausa de " << pause_seconds << " s)" << std::endl;
+    }
+
+    STATUS Client::Load(const std::string& path)
+    {
+        std::string error_msg;
+        auto const start = std::chrono::steady_clock::now();
+        if (_filesystem.Load(path, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return ERROR;
+        }
+
+        std::chrono::duration<double> const seconds = std::chrono::steady_clock::now() - start;
+        std::cout << "Sesión cargada de '" << path << "' en " << seconds.count() << " s" << std::endl;
+        return SUCCESS;
+    }
+
+    STATUS Client::Journal(const std::string& path, const std::string& sync_policy)
+    {
+        JournalOptions options;
+        size_t interval;
+        std::stringstream interval_stream(sync_policy);
+        if (sync_policy == "siempre")
+            options.sync = SyncPolicy::ALWAYS;
+        else if (sync_policy == "nunca")
+            options.sync = SyncPolicy::NEVER;
+        else if ((interval_stream >> interval) && interval_stream.eof() && interval > 0)
+        {
+            options.sync = SyncPolicy::PERIODIC;
+            options.interval = std::chrono::milliseconds(interval);
+        }
+        else
+        {
+            std::cerr << RED << "Invalid sync policy: " << sync_policy << ". Expected `siempre`, `nunca` or milliseconds between syncs" << RESET << std::endl;
+            return ERROR;
+        }
+
+        std::string error_msg;
+        JournalReplayStats stats;
+        if (_filesystem.OpenJournal(path, options, stats, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return ERROR;
+        }
+
+        if (stats.applied > 0 || stats.failed > 0)
+            std::cout << "Recuperadas " << stats.applied << " operaciones de '" << path << "' en " << stats.seconds << " s" << std::endl;
+        if (stats.discarded_bytes > 0)
+            std::cerr << YELLOW << "Descartados " << stats.discarded_bytes << " bytes incompletos al final del diario" << RESET << std::endl;
+
+        std::cout << "Registrando operaciones en '" << path << "'" << std::endl;
+        return SUCCESS;
+    }
+
+    void Client::Checkpoint(const std::string& directory)
+    {
+        std::string error_msg;
+        CheckpointStats stats;
+        if (_filesystem.Checkpoint(directory, stats, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return;
+        }
+
+        std::cout << "Punto de control " << (stats.incremental ? "incremental" : "completo") << " guardado en '" << stats.path << "' (" 
+                  << stats.bytes << " bytes, " << stats.nodes << " nodos y " << stats.versions << " versiones nuevas) en " << stats.seconds << " s" << std::endl;
+        if (stats.compacting_segments > 0)
+            std::cout << "Compactando " << stats.compacting_segments << " segmentos en segundo plano" << std::endl;
+    }
+
+    void Client::ReportBackgroundSave()
+    {
+        BackgroundSaveStats stats;
+        if (!_filesystem.TakeBackgroundSaveStats(stats))
+            return;
+
+        if (stats.error.empty())
+            std::cout << "Sesión guardada en segundo plano en '" << stats.path << "' (" << stats.bytes << " bytes) en " << stats.seconds << " s" << std::endl;
+        else
+            std::cerr << RED << "No se pudo guardar la sesión en segundo plano: " << stats.error << RESET << std::endl;
+    }
+
+    void Client::ReportCompaction()
+    {
+        CompactionStats stats;
+        if (!_filesystem.TakeCompactionStats(stats))
+            return;
+
+        if (stats.error.empty())
+            std::cout << "Compactados " << stats.segments << " segmentos (" << stats.bytes << " bytes) en " << stats.seconds << " s" << std::endl;
+        else
+            std::cerr << YELLOW << "No se pudieron compactar los puntos de control: " << stats.error << RESET << std::endl;
     }
 
     void Client::CELVInit()
@@ -270,7 +572,50 @@ namespace CELV
 
     void Client::CELVFusion(const Version& version1, const Version& version2)
     {
-        std::cout << "Function not yet implemented" << std::endl;
+        std::string error_msg;
+        MergeStats stats;
+        if (_filesystem.Merge(version1, version2, stats, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return;
+        }
+
+        std::cout << "Creada la versión " << stats.version << ": " << stats.merged_directories << " directorios fusionados, " 
+                  << stats.shared_subtrees << " archivos compartidos, " << stats.conflicts << " conflictos" << std::endl;
+    }
+
+    void Client::CELVDiff(const Version& version1, const Version& version2)
+    {
+        std::string error_msg;
+        std::vector<VersionChange> changes;
+        if (_filesystem.Diff(version1, version2, changes, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return;
+        }
+
+        size_t added = 0, removed = 0, modified = 0;
+        for (auto const& change : changes)
+        {
+            auto const suffix = change.file_type == FileType::DIRECTORY ? "/" : "";
+            switch (change.type)
+            {
+            case ChangeType::ADDED:
+                added++;
+                std::cout << GREEN << "+ " << change.path << suffix << RESET << std::endl;
+                break;
+            case ChangeType::REMOVED:
+                removed++;
+                std::cout << RED << "- " << change.path << suffix << RESET << std::endl;
+                break;
+            case ChangeType::MODIFIED:
+                modified++;
+                std::cout << YELLOW << "~ " << change.path << suffix << RESET << std::endl;
+                break;
+            }
+        }
+
+        std::cout << added << " añadidos, " << removed << " eliminados, " << modified << " modificados" << std::endl;
     }
 
     void Client::CELVVersion() const
@@ -287,6 +632,58 @@ namespace CELV
         std::cout << version << std::endl;
     }
 
+    void Client::CELVStorageMode(const std::string& mode)
+    {
+        StorageMode storage_mode;
+        if (mode == "completo")
+            storage_mode = StorageMode::FULL;
+        else if (mode == "delta")
+            storage_mode = StorageMode::DELTA;
+        else
+        {
+            std::cerr << RED << "Invalid storage mode: " << mode << ". Expected `completo` or `delta`" << RESET << std::endl;
+            return;
+        }
+
+        std::string error_msg;
+        if (_filesystem.SetStorageMode(storage_mode, error_msg) == ERROR)
+            std::cerr << RED << error_msg << RESET << std::endl;
+    }
+
+    void Client::CELVPersistenceMode(const std::string& mode)
+    {
+        PersistenceMode persistence_mode;
+        if (mode == "caja")
+            persistence_mode = PersistenceMode::CHANGE_BOX;
+        else if (mode == "bitacora")
+            persistence_mode = PersistenceMode::MODIFICATION_LOG;
+        else
+        {
+            std::cerr << RED << "Invalid persistence mode: " << mode << ". Expected `caja` or `bitacora`" << RESET << std::endl;
+            return;
+        }
+
+        std::string error_msg;
+        if (_filesystem.SetPersistenceMode(persistence_mode, error_msg) == ERROR)
+            std::cerr << RED << error_msg << RESET << std::endl;
+    }
+
+    void Client::CELVNodes() const
+    {
+        std::string error_msg;
+        PersistenceStats stats;
+        if (_filesystem.GetPersistenceStats(stats, error_msg) == ERROR)
+        {
+            std::cerr << RED << error_msg << RESET << std::endl;
+            return;
+        }
+
+        std::cout << "Modo de persistencia: " << (stats.mode == PersistenceMode::CHANGE_BOX ? "caja" : "bitacora") << std::endl;
+        std::cout << "Nodos: " << stats.nodes << std::endl;
+        std::cout << "Modificaciones: " << stats.modifications << std::endl;
+        std::cout << "Memoria de nodos: " << stats.bytes << " bytes" << std::endl;
+    }
+
     void Client::Help()
     {
         std::cout << "Para correr un comando, usa: \n";
@@ -299,13 +696,27 @@ namespace CELV
         std::cout << "\t- eliminar nombre_archivo : Elimina el archivo especificado por nombre_archivo. Si es un directorio, elimina recursivamente.\n";
         std::cout << "\t- leer nombre_archivo : Lee el contenido del archivo y lo imprime en la terminal.\n";
         std::cout << "\t- escribir nombre_archivo contenido : Lee el contenido del archivo y lo imprime en la terminal.\n";
+        std::cout << "\t- anexar nombre_archivo contenido : Agrega el contenido al final del archivo.\n";
+        std::cout << "\t- escribir_en nombre_archivo posicion contenido : Sobreescribe el archivo con el contenido a partir del byte `posicion`.\n";
         std::cout << "\t- ir nombre_archivo : navega al directorio llamado `nombre_archivo`\n";
         std::cout << "\t- ir : navega al directorio padre del nodo actual\n";
+        std::cout << "\t- ls [ordenado] [inicio [cantidad]] : Lista los archivos del directorio actual, opcionalmente ordenados por nombre y a partir de la posición `inicio`\n";
         std::cout << "\t- celv_iniciar : Inicializa control de versiones en el subarbol representado por el directorio actual\n";
         std::cout << "\t- celv_historia : Muestra el historial de cambios para el control de versiones actualmente activo\n";
         std::cout << "\t- celv_vamos version: cambia la version actual a la version especificada\n";
         std::cout << "\t- celv_fusion version1 version2: Trata de fusionar las dos versiones especificadas\n";
+        std::cout << "\t- celv_diff version1 version2: Muestra los archivos añadidos (+), eliminados (-) y modificados (~) de la primera versión a la segunda\n";
         std::cout << "\t- celv_importar camino_directorio: Imita la estructura de archivos del directorio especificado\n";
+        std::cout << "\t- celv_importar_perezoso camino_directorio: Como celv_importar, pero el contenido de los documentos solo se carga de disco la primera vez que se lee\n";
         std::cout << "\t- celv_version: Retorna la version actualmente activa en el control de versiones\n";
+        std::cout << "\t- celv_modo_almacenamiento completo|delta: Indica si las nuevas versiones de documentos se guardan completas o como diferencias contra la versión anterior\n";
+        std::cout << "\t- celv_modo_persistencia caja|bitacora: Indica si cada nodo guarda una sola caja de cambios o una bitácora de hasta 8 modificaciones antes de duplicarse\n";
+        std::cout << "\t- celv_nodos: Muestra cuántos nodos y modificaciones guarda el control de versiones y cuánta memoria ocupan\n";
+        std::cout << "\t- almacenamiento: Muestra estadísticas del almacenamiento de contenidos y la tasa de deduplicación\n";
+        std::cout << "\t- guardar camino_archivo: Guarda toda la sesión, con todas sus versiones, en el archivo especificado\n";
+        std::cout << "\t- guardar_fondo camino_archivo: Como guardar, pero la sesión se escribe desde un proceso hijo y se pueden seguir ejecutando comandos mientras tanto. Se guarda la sesión tal como estaba al ejecutar este comando\n";
+        std::cout << "\t- cargar camino: Reemplaza la sesión actual por la guardada en el archivo especificado, o por el último punto de control del directorio especificado\n";
+        std::cout << "\t- punto_control directorio: Guarda la sesión en el directorio especificado. Tras el primero, cada punto de control solo escribe lo añadido desde el anterior, y los segmentos se compactan en segundo plano. `cargar directorio` recupera el último\n";
+        std::cout << "\t- diario camino_archivo [siempre|nunca|milisegundos]: Registra cada operación en el archivo especificado para recuperar la sesión tras un fallo, sincronizando con el disco en cada operación, nunca, o cada tantos milisegundos. Si el archivo existe, primero recupera la sesión que registra\n";
     }
 }
\ No newline at end of file
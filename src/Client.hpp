@@ -12,7 +12,7 @@ namespace CELV
         public:
             Client();
 
-            ~Client() { _filesystem.Destroy(); }
+            ~Client() { _filesystem.Destroy(); ReportBackgroundSave(); }
 
             // -- < Filesystem API > ------------------------------------------------------------------------------------------
 
@@ -37,6 +37,17 @@ namespace CELV
             /// @param content 
             void Write(const std::string& filename, const std::string& content);
 
+            /// @brief Try to add content at the end of the specified file. Report error if not possible
+            /// @param filename name of file to write
+            /// @param content content to add
+            void Append(const std::string& filename, const std::string& content);
+
+            /// @brief Try to overwrite the specified file starting at byte `offset`. Report error if not possible
+            /// @param filename name of file to write
+            /// @param offset position of first byte to overwrite
+            /// @param content content to write
+            void WriteRange(const std::string& filename, size_t offset, const std::string& content);
+
             /// @brief try to go to the directory specified by `filename`. Report error if not possible.
             /// @param filename name of dir to go
             void Go(const std::string& filename);
@@ -44,13 +55,44 @@ namespace CELV
             /// @brief Try to go to the parent directory of the current directory. Report error if not possible.
             void Go();
 
-            /// @brief List content of current working directory
-            void List();
+            /// @brief List a page of the content of current working directory
+            /// @param options which page to list and in which order
+            void List(const ListOptions& options);
 
             /// @brief Import the directory structure specified by `local_filepath` and mirror it in memory, only considers dirs and files. 
             /// Report error if not possible.
             /// @param local_filepath file path in the actual disk to mirror
-            void Import(const std::string& local_filepath);
+            /// @param lazy if documents should only be loaded from disk when first read
+            void Import(const std::string& local_filepath, bool lazy = false);
+
+            /// @brief Print stats about storage of document contents, including the deduplication ratio
+            void StorageStats() const;
+
+            /// @brief Save the whole session to a snapshot file. Report error if not possible
+            /// @param path where to store the snapshot
+            void Save(const std::string& path);
+
+            /// @brief Replace the current session with the one stored in a snapshot file. Report error if not possible
+            /// @param path path to snapshot
+            /// @return Success status
+            STATUS Load(const std::string& path);
+
+            /// @brief Record every operation in a journal, recovering the session it stores if it already exists. 
+            /// Report error if not possible
+            /// @param path path to journal
+            /// @param sync_policy when to sync operations: `siempre`, `nunca` or an interval in milliseconds
+            /// @return Success status
+            STATUS Journal(const std::string& path, const std::string& sync_policy = "siempre");
+
+            /// @brief Save the whole session to a snapshot file from a child process, so commands can keep running 
+            /// meanwhile. Report error if not possible
+            /// @param path where to store the snapshot
+            void SaveInBackground(const std::string& path);
+
+            /// @brief Store a checkpoint of the session in a directory, only writing what changed since the previous 
+            /// checkpoint in the same directory. Report error if not possible
+            /// @param directory directory storing checkpoints
+            void Checkpoint(const std::string& directory);
 
             // -- < CELV Version control API > ---------------------------------------------------------------------------------------------
             
@@ -69,8 +111,24 @@ namespace CELV
             /// @param version2 Version 2 to fuse
             void CELVFusion(const Version& version1, const Version& version2);
 
+            /// @brief Print paths added, removed or modified from a version to another. Report error if not possible
+            /// @param version1 Version to compare from
+            /// @param version2 Version to compare to
+            void CELVDiff(const Version& version1, const Version& version2);
+
             void CELVVersion() const;
 
+            /// @brief Set how new versions of documents are stored by the active version control system. Report error if not possible
+            /// @param mode name of storage mode, `completo` or `delta`
+            void CELVStorageMode(const std::string& mode);
+
+            /// @brief Set how new versions of nodes are stored by the active version control system. Report error if not possible
+            /// @param mode name of persistence mode, `caja` or `bitacora`
+            void CELVPersistenceMode(const std::string& mode);
+
+            /// @brief Print stats about the nodes of the active version control system. Report error if not possible
+            void CELVNodes() const;
+
             // -- < Client logic > ---------------------------------------------------------------------------------------------------------
             
             /// @brief Execute main loop
@@ -89,6 +147,12 @@ namespace CELV
             /// @param user_prompt command provided by user, from terminal or from file
             STATUS ExecPrompt(std::istream& user_prompt);
 
+            /// @brief Report the result of a merge of checkpoints finished in the background, if any
+            void ReportCompaction();
+
+            /// @brief Report the result of a snapshot saved in the background, if any
+            void ReportBackgroundSave();
+
         private:
             bool _running;
             FileSystem _filesystem;
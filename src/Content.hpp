@@ -0,0 +1,35 @@
+#ifndef CONTENT_HPP
+#define CONTENT_HPP
+#include <memory>
+#include <cstddef>
+
+namespace CELV
+{
+    class Blob;
+    using BlobRef = std::shared_ptr<const Blob>;
+
+    /// @brief Immutable content of a document. Contents might be stored in different representations, 
+    /// but all of them can produce their full bytes as a blob
+    class Content
+    {
+        public:
+        virtual ~Content() = default;
+
+        /// @brief Get size in bytes of this content
+        /// @return size of this content
+        virtual size_t Size() const = 0;
+
+        /// @brief Get full bytes of this content, reconstructing them if necessary
+        /// @return blob with every byte of this content
+        virtual BlobRef Materialize() const = 0;
+
+        /// @brief Check if the bytes of this content can still be produced. Contents referring to external data might
+        /// lose them
+        /// @return if Materialize returns the actual bytes of this content
+        virtual bool IsAvailable() const { return true; }
+    };
+
+    using ContentRef = std::shared_ptr<const Content>;
+}
+
+#endif
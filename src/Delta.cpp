@@ -0,0 +1,226 @@
+#include "Delta.hpp"
+#include "BlobStore.hpp"
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace CELV
+{
+    namespace
+    {
+        /// @brief Least recently used cache of contents rebuilt from deltas, limited by amount of bytes
+        class ReconstructionCache
+        {
+            public:
+            static ReconstructionCache& Get()
+            {
+                static ReconstructionCache cache;
+                return cache;
+            }
+
+            BlobRef Find(const DeltaContent* delta)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto const possible_entry = _entries.find(delta);
+                if (possible_entry == _entries.end())
+                    return nullptr;
+
+                // Mark as most recently used
+                _lru.splice(_lru.begin(), _lru, possible_entry->second);
+                return possible_entry->second->second;
+            }
+
+            void Add(const DeltaContent* delta, BlobRef blob)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (blob->Size() > MAX_BYTES || _entries.find(delta) != _entries.end())
+                    return;
+
+                _lru.emplace_front(delta, blob);
+                _entries[delta] = _lru.begin();
+                _bytes += blob->Size();
+
+                while (_bytes > MAX_BYTES)
+                {
+                    auto const& [oldest_delta, oldest_blob] = _lru.back();
+                    _bytes -= oldest_blob->Size();
+                    _entries.erase(oldest_delta);
+                    _lru.pop_back();
+                }
+            }
+
+            void Remove(const DeltaContent* delta)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto const possible_entry = _entries.find(delta);
+                if (possible_entry == _entries.end())
+                    return;
+
+                _bytes -= possible_entry->second->second->Size();
+                _lru.erase(possible_entry->second);
+                _entries.erase(possible_entry);
+            }
+
+            private:
+            ReconstructionCache() : _bytes(0) { }
+
+            static constexpr size_t MAX_BYTES = 64 * 1024 * 1024;
+
+            using Entry = std::pair<const DeltaContent*, BlobRef>;
+            std::list<Entry> _lru; // most recently used first
+            std::unordered_map<const DeltaContent*, std::list<Entry>::iterator> _entries;
+            size_t _bytes;
+            std::mutex _mutex;
+        };
+
+        /// @brief Adler style rolling checksum over a window of fixed size
+        class RollingHash
+        {
+            public:
+            RollingHash(const char* window, size_t size) : _a(0), _b(0), _size(size)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    _a += static_cast<uint8_t>(window[i]);
+                    _b += static_cast<uint32_t>(size - i) * static_cast<uint8_t>(window[i]);
+                }
+            }
+
+            /// @brief Move window one byte forward
+            void Roll(char out, char in)
+            {
+                _a += static_cast<uint8_t>(in) - static_cast<uint32_t>(static_cast<uint8_t>(out));
+                _b += _a - static_cast<uint32_t>(_size) * static_cast<uint8_t>(out);
+            }
+
+            uint32_t Value() const { return (_b << 16) ^ _a; }
+
+            private:
+            uint32_t _a;
+            uint32_t _b;
+            size_t _size;
+        };
+    }
+
+    DeltaContent::DeltaContent(ContentRef base, size_t size, size_t chain_length)
+        : _base(std::move(base))
+        , _operations()
+        , _literals()
+        , _size(size)
+        , _chain_length(chain_length)
+    { }
+
+    DeltaContent::~DeltaContent()
+    {
+        ReconstructionCache::Get().Remove(this);
+    }
+
+    std::shared_ptr<const DeltaContent> DeltaContent::Encode(const ContentRef& base, std::string_view target)
+    {
+        // Take a full copy every now and then, so rebuilding a content never applies too many deltas
+        auto const base_delta = dynamic_cast<const DeltaContent*>(base.get());
+        auto const chain_length = base_delta == nullptr ? 1 : base_delta->GetChainLength() + 1;
+        if (chain_length > MAX_CHAIN_LENGTH)
+            return nullptr;
+
+        auto const base_blob = base->Materialize();
+        std::string_view const source = base_blob->GetData();
+        auto const block_size = std::clamp<size_t>(static_cast<size_t>(std::sqrt(source.size())), 16, 1024);
+        if (source.size() < block_size || target.size() < block_size)
+            return nullptr; // Too small to be worth it
+
+        // Index every block of base by its checksum
+        std::unordered_map<uint32_t, size_t> blocks;
+        for (size_t offset = 0; offset + block_size <= source.size(); offset += block_size)
+            blocks.emplace(RollingHash(source.data() + offset, block_size).Value(), offset);
+
+        std::shared_ptr<DeltaContent> delta(new DeltaContent(base, target.size(), chain_length));
+        size_t literal_start = 0;
+        size_t i = 0;
+        RollingHash hash(target.data(), block_size);
+        while (i + block_size <= target.size())
+        {
+            auto const possible_block = blocks.find(hash.Value());
+            if (possible_block == blocks.end() || std::memcmp(source.data() + possible_block->second, target.data() + i, block_size) != 0)
+            {
+                if (i + block_size < target.size())
+                    hash.Roll(target[i], target[i + block_size]);
+                i++;
+                continue;
+            }
+
+            // Extend match as much as possible
+            auto const source_offset = possible_block->second;
+            auto length = block_size;
+            while (source_offset + length < source.size() && i + length < target.size() && source[source_offset + length] == target[i + length])
+                length++;
+
+            if (literal_start < i)
+            {
+                delta->AddOperation(delta->_literals.size(), i - literal_start, false);
+                delta->_literals.append(target.substr(literal_start, i - literal_start));
+            }
+            delta->AddOperation(source_offset, length, true);
+
+            i += length;
+            literal_start = i;
+            if (i + block_size <= target.size())
+                hash = RollingHash(target.data() + i, block_size);
+        }
+
+        if (literal_start < target.size())
+        {
+            delta->AddOperation(delta->_literals.size(), target.size() - literal_start, false);
+            delta->_literals.append(target.substr(literal_start));
+        }
+
+        // Only worth it if delta is considerably smaller than a full copy
+        if (delta->GetEncodedSize() * 2 > target.size())
+            return nullptr;
+
+        delta->_literals.shrink_to_fit();
+        delta->_operations.shrink_to_fit();
+        return delta;
+    }
+
+    BlobRef DeltaContent::Materialize() const
+    {
+        auto& cache = ReconstructionCache::Get();
+        auto blob = cache.Find(this);
+        if (blob != nullptr)
+            return blob;
+
+        auto const base_blob = _base->Materialize();
+        auto const& source = base_blob->GetData();
+        std::string content;
+        content.reserve(_size);
+        for (auto const& operation : _operations)
+        {
+            auto const& data = operation.from_base ? source : _literals;
+            content.append(data, operation.offset, operation.length);
+        }
+
+        blob = std::make_shared<const Blob>(std::move(content));
+        cache.Add(this, blob);
+        return blob;
+    }
+
+    void DeltaContent::AddOperation(size_t offset, size_t length, bool from_base)
+    {
+        if (!_operations.empty())
+        {
+            auto& last = _operations.back();
+            if (last.from_base == from_base && last.offset + last.length == offset)
+            {
+                last.length += length;
+                return;
+            }
+        }
+
+        _operations.push_back(Operation{offset, length, from_base});
+    }
+}
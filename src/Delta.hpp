@@ -0,0 +1,66 @@
+#ifndef DELTA_HPP
+#define DELTA_HPP
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Content.hpp"
+
+namespace CELV
+{
+    /// @brief Content stored as a binary delta against a previous content. The delta is computed rsync style: the base
+    /// is split in blocks indexed by a rolling hash, and the new content is scanned looking for those blocks, so
+    /// it works with any kind of file, not only text. Reconstructed contents are kept in a small cache shared by
+    /// every delta, so reading recent versions again doesn't need to rebuild them.
+    class DeltaContent : public Content
+    {
+        public:
+        /// @brief Try to encode `target` as a delta against `base`
+        /// @param base content to use as base for the delta
+        /// @param target content to encode
+        /// @return new delta content, or nullptr if a delta is not worth it, for example when both contents are too
+        /// different, or when the chain of deltas to rebuild `base` is already too long and a full copy should be stored
+        static std::shared_ptr<const DeltaContent> Encode(const ContentRef& base, std::string_view target);
+
+        ~DeltaContent();
+
+        size_t Size() const override { return _size; }
+
+        /// @brief Rebuild full content from base and this delta. Results are cached
+        /// @return blob with full content
+        BlobRef Materialize() const override;
+
+        /// @brief Get amount of deltas that have to be applied to rebuild this content
+        /// @return length of delta chain, 1 if base is a full content
+        size_t GetChainLength() const { return _chain_length; }
+
+        /// @brief Get amount of bytes required to store this delta
+        /// @return size of this delta
+        size_t GetEncodedSize() const { return _literals.size() + _operations.size() * sizeof(Operation); }
+
+        /// @brief Max amount of deltas to apply in order to rebuild a content. Longer chains start with a full copy
+        static constexpr size_t MAX_CHAIN_LENGTH = 16;
+
+        private:
+        /// @brief Operation used to rebuild content. Copy a range of bytes from base or from literals of this delta
+        struct Operation
+        {
+            size_t offset;
+            size_t length;
+            bool from_base;
+        };
+
+        DeltaContent(ContentRef base, size_t size, size_t chain_length);
+
+        /// @brief Add an operation to this delta, merging it with the previous one if possible
+        void AddOperation(size_t offset, size_t length, bool from_base);
+
+        private:
+        ContentRef _base;
+        std::vector<Operation> _operations;
+        std::string _literals;
+        size_t _size;
+        size_t _chain_length;
+    };
+}
+
+#endif
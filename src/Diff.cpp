@@ -4,23 +4,622 @@
 #include<cassert>
 #include<sstream>
 #include<stdexcept>
+#include<string_view>
+#include<unordered_map>
+#include<cctype>
+#include<cstdint>
+#include<array>
+#include<limits>
+#include<atomic>
+#include<functional>
+
+// El kernel vectorizado se compila para AVX2 aunque el resto no, y solo se usa si el procesador lo soporta
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIFF_AVX2_KERNEL
+#include<immintrin.h>
+#endif
 
 #include"Diff.hpp"
+#include"ThreadPool.hpp"
+
+namespace 
+{
+    // Filas y columnas de cada bloque de WAVEFRONT, 256 KiB de celdas compactas
+    constexpr size_t WAVEFRONT_TILE = 256;
+
+    // Los costos de WAVEFRONT deben ser menores a esto para caber en 30 bits
+    constexpr size_t WAVEFRONT_MAX_COST = size_t(1) << 30;
+
+    /// @brief Implementacion del algoritmo O(ND) de Myers en espacio lineal. Recorta prefijos y sufijos comunes,
+    /// busca la "serpiente media" del camino de edicion avanzando desde ambos extremos, y resuelve recursivamente
+    /// las dos mitades. Funciona sobre cualquier secuencia de elementos comparables.
+    template<typename T>
+    class MYERS_MATCHER {
+    public:
+        MYERS_MATCHER(const T *a, size_t n, const T *b, size_t m) 
+            : _a(a), _b(b), _n(n), _m(m)
+        { }
+
+        std::vector<MATCH> matches() 
+        {
+            _matches.clear();
+            diff(0, _n, 0, _m);
+            return _matches;
+        }
+
+    private:
+        void add_match(size_t a, size_t b, size_t length) 
+        {
+            if (length == 0)
+                return;
+
+            // Une bloques contiguos
+            if (!_matches.empty()) 
+            {
+                auto &last = _matches.back();
+                if (last.a + last.length == a && last.b + last.length == b) 
+                {
+                    last.length += length;
+                    return;
+                }
+            }
+
+            _matches.push_back(MATCH{a, b, length});
+        }
+
+        void diff(size_t a0, size_t a1, size_t b0, size_t b1) 
+        {
+            // Recorta prefijo comun
+            size_t prefix = 0;
+            while (a0 + prefix < a1 && b0 + prefix < b1 && _a[a0 + prefix] == _b[b0 + prefix])
+                prefix++;
+            add_match(a0, b0, prefix);
+            a0 += prefix; b0 += prefix;
+
+            // Recorta sufijo comun, se agrega al final para mantener el orden
+            size_t suffix = 0;
+            while (a0 < a1 - suffix && b0 < b1 - suffix && _a[a1 - suffix - 1] == _b[b1 - suffix - 1])
+                suffix++;
+            a1 -= suffix; b1 -= suffix;
+
+            if (a0 < a1 && b0 < b1) 
+            {
+                size_t x, y;
+                if (middle_snake(a0, a1, b0, b1, x, y)) 
+                {
+                    diff(a0, x, b0, y);
+                    diff(x, a1, y, b1);
+                }
+            }
+
+            add_match(a1, b1, suffix);
+        }
+
+        /// @brief Busca un punto (x, y) por donde pasa un camino de edicion minimo entre _a[a0, a1) y _b[b0, b1)
+        /// @return false si los rangos no tienen ningun elemento en comun
+        bool middle_snake(size_t a0, size_t a1, size_t b0, size_t b1, size_t &out_x, size_t &out_y) 
+        {
+            const T *a = _a + a0, *b = _b + b0;
+            const long n = a1 - a0, m = b1 - b0;
+            const long max_d = (n + m + 1) / 2;
+            const long offset = max_d;
+            const long delta = n - m;
+            const bool front = (delta % 2) != 0;
+
+            // forward[k] y backward[k] guardan el x mas lejano alcanzado en la diagonal k desde cada extremo
+            _forward.assign(2 * max_d + 2, -1);
+            _backward.assign(2 * max_d + 2, -1);
+            _forward[offset + 1] = 0;
+            _backward[offset + 1] = 0;
+
+            // Diagonales que ya salieron de la tabla, no vale la pena seguirlas
+            long k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+            for (long d = 0; d < max_d; d++) 
+            {
+                for (long k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) 
+                {
+                    const long k1_offset = offset + k1;
+                    long x1 = (k1 == -d || (k1 != d && _forward[k1_offset - 1] < _forward[k1_offset + 1])) 
+                        ? _forward[k1_offset + 1] 
+                        : _forward[k1_offset - 1] + 1;
+                    long y1 = x1 - k1;
+                    while (x1 < n && y1 < m && a[x1] == b[y1]) 
+                    {
+                        x1++; y1++;
+                    }
+                    _forward[k1_offset] = x1;
+
+                    if (x1 > n)
+                        k1_end += 2;
+                    else if (y1 > m)
+                        k1_start += 2;
+                    else if (front) 
+                    {
+                        const long k2_offset = offset + delta - k1;
+                        if (k2_offset >= 0 && k2_offset < static_cast<long>(_backward.size()) && _backward[k2_offset] != -1 && x1 >= n - _backward[k2_offset]) 
+                        {
+                            out_x = a0 + x1; out_y = b0 + y1;
+                            return true;
+                        }
+                    }
+                }
+
+                for (long k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) 
+                {
+                    const long k2_offset = offset + k2;
+                    long x2 = (k2 == -d || (k2 != d && _backward[k2_offset - 1] < _backward[k2_offset + 1])) 
+                        ? _backward[k2_offset + 1] 
+                        : _backward[k2_offset - 1] + 1;
+                    long y2 = x2 - k2;
+                    while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1]) 
+                    {
+                        x2++; y2++;
+                    }
+                    _backward[k2_offset] = x2;
+
+                    if (x2 > n)
+                        k2_end += 2;
+                    else if (y2 > m)
+                        k2_start += 2;
+                    else if (!front) 
+                    {
+                        const long k1_offset = offset + delta - k2;
+                        if (k1_offset >= 0 && k1_offset < static_cast<long>(_forward.size()) && _forward[k1_offset] != -1) 
+                        {
+                            const long x1 = _forward[k1_offset];
+                            const long y1 = offset + x1 - k1_offset;
+                            if (x1 >= n - x2) 
+                            {
+                                out_x = a0 + x1; out_y = b0 + y1;
+                                return true;
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Los caminos solo no se cruzan si hay que eliminar todo u e insertar todo v
+            return false;
+        }
+
+        const T *_a, *_b;
+        size_t _n, _m;
+        std::vector<MATCH> _matches;
+        std::vector<long> _forward, _backward;
+    };
+}
+
+namespace 
+{
+    /// @brief Implementacion del algoritmo de Hirschberg. Divide `a` por la mitad, calcula la ultima fila de la tabla 
+    /// de edist de cada mitad contra `b` (la primera mitad hacia adelante y la segunda hacia atras), y busca el punto 
+    /// de `b` donde la suma es minima: por ahi pasa un alineamiento optimo, y se resuelve recursivamente cada lado.
+    /// Los costos son los mismos que en EDIST: insertar, eliminar y modificar cuestan 1.
+    template<typename T>
+    class HIRSCHBERG_MATCHER {
+    public:
+        HIRSCHBERG_MATCHER(const T *a, size_t n, const T *b, size_t m) 
+            : _a(a), _b(b), _n(n), _m(m)
+        { }
+
+        std::vector<MATCH> matches() 
+        {
+            _matches.clear();
+            align(0, _n, 0, _m);
+            return _matches;
+        }
+
+    private:
+        void add_match(size_t a, size_t b, size_t length) 
+        {
+            if (length == 0)
+                return;
+
+            if (!_matches.empty()) 
+            {
+                auto &last = _matches.back();
+                if (last.a + last.length == a && last.b + last.length == b) 
+                {
+                    last.length += length;
+                    return;
+                }
+            }
+
+            _matches.push_back(MATCH{a, b, length});
+        }
+
+        void align(size_t a0, size_t a1, size_t b0, size_t b1) 
+        {
+            // Un prefijo o sufijo comun siempre es parte de algun alineamiento optimo
+            size_t prefix = 0;
+            while (a0 + prefix < a1 && b0 + prefix < b1 && _a[a0 + prefix] == _b[b0 + prefix])
+                prefix++;
+            add_match(a0, b0, prefix);
+            a0 += prefix; b0 += prefix;
+
+            size_t suffix = 0;
+            while (a0 < a1 - suffix && b0 < b1 - suffix && _a[a1 - suffix - 1] == _b[b1 - suffix - 1])
+                suffix++;
+            a1 -= suffix; b1 -= suffix;
+
+            if (a0 == a1 || b0 == b1) 
+            {
+                // Solo quedan inserciones o eliminaciones
+            }
+            else if (a1 - a0 == 1) 
+            {
+                // Un solo elemento: coincide con alguno de b o se modifica
+                for (size_t j = b0; j < b1; j++)
+                    if (_a[a0] == _b[j]) 
+                    {
+                        add_match(a0, j, 1);
+                        break;
+                    }
+            }
+            else 
+            {
+                auto const mid = a0 + (a1 - a0) / 2;
+                auto const split = best_split(a0, mid, a1, b0, b1);
+                align(a0, mid, b0, split);
+                align(mid, a1, split, b1);
+            }
+
+            add_match(a1, b1, suffix);
+        }
+
+        /// @brief Busca el punto de b por donde pasa un alineamiento optimo que divide a en `mid`
+        size_t best_split(size_t a0, size_t mid, size_t a1, size_t b0, size_t b1) 
+        {
+            const size_t m = b1 - b0;
+            _forward.resize(m + 1);
+            _backward.resize(m + 1);
+
+            // _forward[j]: costo de a[a0, mid) contra b[b0, b0 + j)
+            for (size_t j = 0; j <= m; j++)
+                _forward[j] = j;
+            for (size_t i = a0; i < mid; i++) 
+            {
+                unsigned diagonal = _forward[0];
+                _forward[0]++;
+                for (size_t j = 1; j <= m; j++) 
+                {
+                    auto const above = _forward[j];
+                    _forward[j] = _a[i] == _b[b0 + j - 1] 
+                        ? diagonal 
+                        : 1 + std::min({diagonal, above, _forward[j - 1]});
+                    diagonal = above;
+                }
+            }
+
+            // _backward[j]: costo de a[mid, a1) contra b[b1 - j, b1)
+            for (size_t j = 0; j <= m; j++)
+                _backward[j] = j;
+            for (size_t i = a1; i-- > mid;) 
+            {
+                unsigned diagonal = _backward[0];
+                _backward[0]++;
+                for (size_t j = 1; j <= m; j++) 
+                {
+                    auto const above = _backward[j];
+                    _backward[j] = _a[i] == _b[b1 - j] 
+                        ? diagonal 
+                        : 1 + std::min({diagonal, above, _backward[j - 1]});
+                    diagonal = above;
+                }
+            }
+
+            size_t best = 0;
+            for (size_t j = 1; j <= m; j++)
+                if (_forward[j] + _backward[m - j] < _forward[best] + _backward[m - best])
+                    best = j;
+
+            return b0 + best;
+        }
+
+        const T *_a, *_b;
+        size_t _n, _m;
+        std::vector<MATCH> _matches;
+        std::vector<unsigned> _forward, _backward;
+    };
+
+    /// @brief Calcula con HIRSCHBERG_MATCHER, indexando las filas de la tabla por la secuencia mas corta
+    template<typename T>
+    std::vector<MATCH> hirschberg(const T *a, size_t n, const T *b, size_t m) 
+    {
+        if (m <= n)
+            return HIRSCHBERG_MATCHER<T>(a, n, b, m).matches();
+
+        auto matches = HIRSCHBERG_MATCHER<T>(b, m, a, n).matches();
+        for (auto &match : matches)
+            std::swap(match.a, match.b);
+        return matches;
+    }
+
+    // Unidad de texto: s[offset, offset + length)
+    struct UNIT {
+        size_t offset, length;
+    };
+
+    /// @brief Divide un texto en lineas, o en palabras y espacios intercalados. Las unidades cubren todo el texto.
+    std::vector<UNIT> tokenize(const std::string &text, GRANULARITY granularity) 
+    {
+        std::vector<UNIT> units;
+        size_t start = 0;
+        while (start < text.size()) 
+        {
+            size_t end = start;
+            if (granularity == LINES) 
+            {
+                end = text.find('\n', start);
+                end = end == std::string::npos ? text.size() : end + 1;
+            }
+            else 
+            {
+                auto const is_space = [&](size_t i) { return std::isspace(static_cast<unsigned char>(text[i])) != 0; };
+                auto const space = is_space(start);
+                while (end < text.size() && is_space(end) == space)
+                    end++;
+            }
+
+            units.push_back(UNIT{start, end - start});
+            start = end;
+        }
+
+        return units;
+    }
+
+    /// @brief Distancia de edicion con vectores de bits (Myers 1999, extendido a varias palabras por Hyyrö). El patron
+    /// se divide en bloques de 64 filas; por cada columna del texto, cada bloque guarda en que filas la distancia sube 
+    /// (pv) o baja (mv) respecto a la fila anterior, y la diferencia horizontal de su ultima fila entra al siguiente 
+    /// bloque. Solo se guarda, por cada simbolo del patron, en que filas aparece: O(|alfabeto| * m / 64) memoria.
+    class BIT_PARALLEL_EDIST {
+    public:
+        explicit BIT_PARALLEL_EDIST(std::string_view pattern) 
+            : _length(pattern.size())
+            , _blocks((pattern.size() + WORD_BITS - 1) / WORD_BITS)
+        {
+            // El simbolo 0 representa a los que no aparecen en el patron
+            _symbols.fill(0);
+            size_t symbols = 1;
+            for (unsigned char const c : pattern)
+                if (_symbols[c] == 0)
+                    _symbols[c] = symbols++;
+
+            // Con relleno al final para que los lanes sin bloque de la ultima banda lean memoria valida
+            _peq.assign(symbols * _blocks + LANES, 0);
+            for (size_t i = 0; i < _length; i++)
+                _peq[symbol(pattern[i]) * _blocks + i / WORD_BITS] |= uint64_t(1) << (i % WORD_BITS);
+        }
+
+        /// @brief Distancia entre el patron y text, o algun valor mayor a max_distance si la supera
+        size_t distance(std::string_view text, size_t max_distance) const 
+        {
+            if (_length == 0)
+                return text.size();
+
+#ifdef DIFF_AVX2_KERNEL
+            static const bool has_avx2 = __builtin_cpu_supports("avx2");
+            if (has_avx2 && _blocks >= LANES)
+                return distance_avx2(text, max_distance);
+#endif
+            return distance_scalar(text, max_distance);
+        }
+
+    private:
+        static constexpr size_t WORD_BITS = 64;
+        static constexpr size_t LANES = 4; // Bloques por registro de AVX2
+
+        size_t symbol(char c) const { return _symbols[static_cast<unsigned char>(c)]; }
+
+        /// @brief Bit de la ultima fila de un bloque
+        size_t last_row(size_t block) const 
+        {
+            return block + 1 == _blocks ? (_length - 1) % WORD_BITS : WORD_BITS - 1;
+        }
 
-DIFF::DIFF(const std::string &u, const std::string &v) 
+        /// @brief Avanza un bloque una columna, dada la diferencia horizontal en su borde superior
+        /// @return Diferencia horizontal en la ultima fila del bloque: -1, 0 o 1
+        static int advance_block(uint64_t &pv, uint64_t &mv, uint64_t eq, int carry, size_t last_row) 
+        {
+            uint64_t const carry_up = carry > 0, carry_down = carry < 0;
+            uint64_t const xv = eq | mv;
+            eq |= carry_down;
+            uint64_t const xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+
+            int const out = static_cast<int>((ph >> last_row) & 1) - static_cast<int>((mh >> last_row) & 1);
+
+            ph = (ph << 1) | carry_up;
+            mh = (mh << 1) | carry_down;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+            return out;
+        }
+
+        size_t distance_scalar(std::string_view text, size_t max_distance) const 
+        {
+            std::vector<uint64_t> pv(_blocks, ~uint64_t(0)), mv(_blocks, 0);
+            size_t score = _length;
+
+            for (size_t j = 0; j < text.size(); j++) 
+            {
+                const uint64_t *eq = &_peq[symbol(text[j]) * _blocks];
+
+                // En la fila 0 la distancia siempre sube en 1
+                int carry = 1;
+                for (size_t block = 0; block < _blocks; block++)
+                    carry = advance_block(pv[block], mv[block], eq[block], carry, last_row(block));
+
+                if (carry > 0) 
+                    score++;
+                else if (carry < 0)
+                    score--;
+
+                // Cada columna restante puede bajar la distancia en a lo sumo 1
+                auto const remaining = text.size() - j - 1;
+                if (score > max_distance && score - max_distance > remaining)
+                    return score - remaining;
+            }
+
+            return score;
+        }
+
+#ifdef DIFF_AVX2_KERNEL
+        /// @brief Procesa bandas de LANES bloques consecutivos. En cada paso, el bloque i de la banda avanza la columna
+        /// t - i, asi recibe la diferencia horizontal que el bloque anterior produjo en el paso previo. Lo que sale 
+        /// por el ultimo bloque de una banda se guarda por columna y entra por el primero de la siguiente. La distancia
+        /// solo se conoce en la ultima banda, asi que recien ahi se puede terminar antes si supera max_distance.
+        __attribute__((target("avx2")))
+        size_t distance_avx2(std::string_view text, size_t max_distance) const 
+        {
+            const size_t n = text.size();
+
+            // Fila de _peq de cada columna, con LANES columnas de relleno a cada lado que no coinciden con nada
+            std::vector<size_t> rows(n + 2 * LANES, 0);
+            for (size_t j = 0; j < n; j++)
+                rows[j + LANES] = symbol(text[j]) * _blocks;
+
+            std::vector<int8_t> carries(n, 1);
+            size_t score = _length;
+
+            __m256i const ones = _mm256_set1_epi64x(-1);
+            __m256i const one = _mm256_set1_epi64x(1);
+
+            for (size_t band = 0; band < _blocks; band += LANES) 
+            {
+                auto const used = std::min(LANES, _blocks - band);
+                auto const output_lane = used - 1; // Lane del ultimo bloque de la banda
+                auto const last_band = band + used == _blocks;
+                const uint64_t *peq = _peq.data() + band;
+
+                alignas(32) int64_t last_rows[LANES];
+                for (size_t lane = 0; lane < LANES; lane++)
+                    last_rows[lane] = lane < used ? last_row(band + lane) : WORD_BITS - 1;
+                __m256i const shifts = _mm256_load_si256(reinterpret_cast<const __m256i*>(last_rows));
+                __m256i const output_index = _mm256_set1_epi32(static_cast<int>(2 * output_lane));
+
+                __m256i pv = ones, mv = _mm256_setzero_si256();
+                __m256i out_up = _mm256_setzero_si256(), out_down = _mm256_setzero_si256();
+
+                for (size_t t = 0; t < n + output_lane; t++) 
+                {
+                    // Bloques que aun no llegan a la primera columna usan el relleno
+                    const size_t *column = &rows[t + LANES];
+                    __m256i eq = _mm256_set_epi64x(
+                        static_cast<int64_t>(peq[column[-3] + 3]), static_cast<int64_t>(peq[column[-2] + 2]), 
+                        static_cast<int64_t>(peq[column[-1] + 1]), static_cast<int64_t>(peq[column[0]]));
+
+                    // Cada bloque recibe lo que produjo el anterior, el primero lo que produjo la banda anterior
+                    int const carry = t < n ? carries[t] : 0;
+                    __m256i carry_up = _mm256_permute4x64_epi64(out_up, _MM_SHUFFLE(2, 1, 0, 3));
+                    __m256i carry_down = _mm256_permute4x64_epi64(out_down, _MM_SHUFFLE(2, 1, 0, 3));
+                    carry_up = _mm256_blend_epi32(carry_up, _mm256_set1_epi64x(carry > 0), 0x03);
+                    carry_down = _mm256_blend_epi32(carry_down, _mm256_set1_epi64x(carry < 0), 0x03);
+
+                    __m256i const xv = _mm256_or_si256(eq, mv);
+                    eq = _mm256_or_si256(eq, carry_down);
+                    __m256i const sum = _mm256_add_epi64(_mm256_and_si256(eq, pv), pv);
+                    __m256i const xh = _mm256_or_si256(_mm256_xor_si256(sum, pv), eq);
+                    __m256i ph = _mm256_or_si256(mv, _mm256_andnot_si256(_mm256_or_si256(xh, pv), ones));
+                    __m256i mh = _mm256_and_si256(pv, xh);
+
+                    out_up = _mm256_and_si256(_mm256_srlv_epi64(ph, shifts), one);
+                    out_down = _mm256_and_si256(_mm256_srlv_epi64(mh, shifts), one);
+
+                    ph = _mm256_or_si256(_mm256_slli_epi64(ph, 1), carry_up);
+                    mh = _mm256_or_si256(_mm256_slli_epi64(mh, 1), carry_down);
+                    __m256i next_pv = _mm256_or_si256(mh, _mm256_andnot_si256(_mm256_or_si256(xv, ph), ones));
+                    __m256i next_mv = _mm256_and_si256(ph, xv);
+
+                    if (t + 1 < LANES) 
+                    {
+                        // Los bloques que aun no empiezan no cambian ni producen nada
+                        __m256i const started = _mm256_cmpgt_epi64(_mm256_set1_epi64x(static_cast<int64_t>(t) + 1), _mm256_set_epi64x(3, 2, 1, 0));
+                        next_pv = _mm256_blendv_epi8(pv, next_pv, started);
+                        next_mv = _mm256_blendv_epi8(mv, next_mv, started);
+                        out_up = _mm256_and_si256(out_up, started);
+                        out_down = _mm256_and_si256(out_down, started);
+                    }
+                    pv = next_pv;
+                    mv = next_mv;
+
+                    if (t < output_lane)
+                        continue;
+
+                    auto const out = _mm256_sub_epi64(out_up, out_down);
+                    auto const value = _mm256_cvtsi256_si32(_mm256_permutevar8x32_epi32(out, output_index));
+                    auto const j = t - output_lane;
+                    if (!last_band)
+                    {
+                        carries[j] = static_cast<int8_t>(value);
+                        continue;
+                    }
+
+                    score += value;
+
+                    // Cada columna restante puede bajar la distancia en a lo sumo 1
+                    auto const remaining = n - j - 1;
+                    if (score > max_distance && score - max_distance > remaining)
+                        return score - remaining;
+                }
+            }
+
+            return score;
+        }
+#endif
+
+        size_t _length; // Filas del patron
+        size_t _blocks; // Palabras de 64 bits por columna
+        std::array<size_t, 256> _symbols; // Indice de cada caracter en _peq
+        std::vector<uint64_t> _peq; // Por simbolo, en que filas de cada bloque aparece
+    };
+}
+
+DIFF::DIFF(const std::string &u, const std::string &v, ALGORITHM algorithm, GRANULARITY granularity) 
         : _A(u)
         , _B(v)
-        , _memo(u.size() + 1) 
+        , _algorithm(algorithm)
+        , _granularity(granularity)
+        , _memory_budget(DEFAULT_MEMORY_BUDGET)
+        , _threads(0)
+        , _memo() 
 {
     assert( (u.size() > 0 || v.size() > 0) && "Both strings are empty!");
+}
+
+ALGORITHM DIFF::effective_algorithm() const 
+{
+    if (_algorithm != EDIST && _algorithm != WAVEFRONT)
+        return _algorithm;
+
+    // El costo de WAVEFRONT debe caber en 30 bits
+    if (_algorithm == WAVEFRONT && std::max(_A.size(), _B.size()) >= WAVEFRONT_MAX_COST)
+        return HIRSCHBERG;
 
-    // Initialize table size
-    for (size_t i=0; i<_memo.size(); ++i)
-        _memo[i].resize(_B.size() + 1);
+    // La tabla completa no cabe, se recupera el mismo script minimo en espacio lineal
+    auto const cell_size = _algorithm == EDIST ? sizeof(CELL) : sizeof(uint32_t);
+    auto const table_size = static_cast<double>(_A.size() + 1) * (_B.size() + 1) * cell_size;
+    return table_size > _memory_budget ? HIRSCHBERG : _algorithm;
 }
 
 std::string DIFF::compute_diff() 
 {
+    if (_granularity != CHARACTERS)
+        return render_matches(unit_matches());
+
+    switch (effective_algorithm()) 
+    {
+        case MYERS:
+            return render_matches(myers_matches());
+        case HIRSCHBERG:
+            return render_matches(hirschberg_matches());
+        case WAVEFRONT:
+            return render_matches(wavefront_matches());
+        default:
+            break;
+    }
+
     // Precalcula la edist para recuperar camino
     edist_pdist();
 
@@ -28,8 +627,210 @@ std::string DIFF::compute_diff()
     return produce_diff();
 }
 
+size_t DIFF::edit_distance() const 
+{
+    return bounded_distance(std::numeric_limits<size_t>::max());
+}
+
+bool DIFF::is_within(size_t max_distance) const 
+{
+    return bounded_distance(max_distance) <= max_distance;
+}
+
+size_t DIFF::bounded_distance(size_t max_distance) const 
+{
+    std::string_view a = _A, b = _B;
+
+    // Los extremos comunes no cambian la distancia
+    size_t prefix = 0;
+    while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix])
+        prefix++;
+    a.remove_prefix(prefix);
+    b.remove_prefix(prefix);
+
+    size_t suffix = 0;
+    while (suffix < a.size() && suffix < b.size() && a[a.size() - suffix - 1] == b[b.size() - suffix - 1])
+        suffix++;
+    a.remove_suffix(suffix);
+    b.remove_suffix(suffix);
+
+    // El patron es la cadena mas corta, asi la tabla de simbolos es mas chica
+    if (a.size() > b.size())
+        std::swap(a, b);
+
+    if (b.size() - a.size() > max_distance)
+        return b.size() - a.size();
+
+    return BIT_PARALLEL_EDIST(a).distance(b, max_distance);
+}
+
+std::vector<MATCH> DIFF::myers_matches() const 
+{
+    return MYERS_MATCHER<char>(_A.data(), _A.size(), _B.data(), _B.size()).matches();
+}
+
+std::vector<MATCH> DIFF::hirschberg_matches() const 
+{
+    return hirschberg(_A.data(), _A.size(), _B.data(), _B.size());
+}
+
+std::vector<MATCH> DIFF::unit_matches() const 
+{
+    auto const units_a = tokenize(_A, _granularity);
+    auto const units_b = tokenize(_B, _granularity);
+
+    // Unidades iguales reciben el mismo identificador. La tabla compara el texto, asi que no hay colisiones
+    std::unordered_map<std::string_view, uint64_t> interned;
+    auto const intern = [&](const std::string &text, const std::vector<UNIT> &units) {
+        std::vector<uint64_t> ids;
+        ids.reserve(units.size());
+        for (auto const &unit : units) 
+            ids.push_back(interned.emplace(std::string_view(text).substr(unit.offset, unit.length), interned.size()).first->second);
+        return ids;
+    };
+    auto const ids_a = intern(_A, units_a);
+    auto const ids_b = intern(_B, units_b);
+
+    auto const matches = _algorithm == MYERS 
+        ? MYERS_MATCHER<uint64_t>(ids_a.data(), ids_a.size(), ids_b.data(), ids_b.size()).matches()
+        : hirschberg(ids_a.data(), ids_a.size(), ids_b.data(), ids_b.size());
+
+    // Traduce bloques de unidades a bloques de caracteres; unidades iguales tienen el mismo largo
+    std::vector<MATCH> result;
+    result.reserve(matches.size());
+    for (auto const &match : matches) 
+    {
+        auto const &first = units_a[match.a];
+        auto const &last = units_a[match.a + match.length - 1];
+        result.push_back(MATCH{first.offset, units_b[match.b].offset, last.offset + last.length - first.offset});
+    }
+
+    return result;
+}
+
+std::vector<MATCH> DIFF::wavefront_matches() const 
+{
+    const size_t n = _A.size(), m = _B.size();
+    const size_t width = m + 1;
+
+    // Celda compacta: costo en los 30 bits altos, estado en los 2 bajos
+    auto const pack = [](uint32_t cost, STATE state) { return cost << 2 | static_cast<uint32_t>(state); };
+    std::vector<uint32_t> table((n + 1) * width);
+
+    table[0] = pack(0, NOTHING);
+    for (size_t i = 1; i <= n; i++)
+        table[i * width] = pack(i, DELETE);
+    for (size_t j = 1; j <= m; j++)
+        table[j] = pack(j, INSERT);
+
+    // Mismas reglas de desempate que edist_pdist
+    auto const compute_tile = [&](size_t tile_row, size_t tile_column) {
+        auto const i_end = std::min(n, (tile_row + 1) * WAVEFRONT_TILE);
+        auto const j_end = std::min(m, (tile_column + 1) * WAVEFRONT_TILE);
+        for (size_t i = tile_row * WAVEFRONT_TILE + 1; i <= i_end; i++) 
+        {
+            auto *row = &table[i * width];
+            const auto *above = row - width;
+            for (size_t j = tile_column * WAVEFRONT_TILE + 1; j <= j_end; j++) 
+            {
+                auto const diagonal = above[j - 1] >> 2;
+                if (_A[i - 1] == _B[j - 1]) 
+                {
+                    row[j] = pack(diagonal, NOTHING);
+                    continue;
+                }
+
+                auto const left = row[j - 1] >> 2, up = above[j] >> 2;
+                if (left < up)
+                    row[j] = left < diagonal ? pack(left + 1, INSERT) : pack(diagonal + 1, MODIFY);
+                else
+                    row[j] = up < diagonal ? pack(up + 1, DELETE) : pack(diagonal + 1, MODIFY);
+            }
+        }
+    };
+
+    // Un bloque se agenda cuando terminan el de arriba y el de la izquierda
+    const size_t rows = (n + WAVEFRONT_TILE - 1) / WAVEFRONT_TILE;
+    const size_t columns = (m + WAVEFRONT_TILE - 1) / WAVEFRONT_TILE;
+    if (rows > 0 && columns > 0) 
+    {
+        std::vector<std::atomic<uint8_t>> dependencies(rows * columns);
+        for (size_t r = 0; r < rows; r++)
+            for (size_t c = 0; c < columns; c++)
+                dependencies[r * columns + c] = (r > 0) + (c > 0);
+
+        CELV::ThreadPool pool(_threads);
+        std::function<void(size_t, size_t)> run_tile = [&](size_t r, size_t c) {
+            compute_tile(r, c);
+            auto const release = [&](size_t next_r, size_t next_c) {
+                if (dependencies[next_r * columns + next_c].fetch_sub(1) == 1)
+                    pool.Submit([&run_tile, next_r, next_c]() { run_tile(next_r, next_c); });
+            };
+            if (r + 1 < rows)
+                release(r + 1, c);
+            if (c + 1 < columns)
+                release(r, c + 1);
+        };
+
+        pool.Submit([&run_tile]() { run_tile(0, 0); });
+        pool.Wait();
+    }
+
+    // Recupera el camino desde la esquina inferior derecha, las coincidencias son las diagonales sin costo
+    std::vector<MATCH> matches;
+    size_t i = n, j = m;
+    while (i > 0 || j > 0) 
+    {
+        auto const state = static_cast<STATE>(table[i * width + j] & 3);
+        if (state != NOTHING) 
+        {
+            if (i > 0 && state != INSERT) i--;
+            if (j > 0 && state != DELETE) j--;
+            continue;
+        }
+
+        size_t length = 0;
+        while (i > 0 && j > 0 && static_cast<STATE>(table[i * width + j] & 3) == NOTHING) 
+        {
+            i--; j--; length++;
+        }
+        matches.push_back(MATCH{i, j, length});
+    }
+
+    std::reverse(matches.begin(), matches.end());
+    return matches;
+}
+
+std::string DIFF::render_matches(const std::vector<MATCH> &matches) const 
+{
+    std::string result;
+    size_t a = 0, b = 0;
+
+    // Agrega lo eliminado y lo insertado antes de las posiciones indicadas
+    auto const render_changes = [&](size_t a_end, size_t b_end) {
+        if (a < a_end)
+            result.append(OPENING_OLD_VER).append(_A, a, a_end - a).append(CLOSING_OLD_VER);
+        if (b < b_end)
+            result.append(OPENING_NEW_VER).append(_B, b, b_end - b).append(CLOSING_NEW_VER);
+    };
+
+    for (auto const &match : matches) 
+    {
+        render_changes(match.a, match.b);
+        result.append(_A, match.a, match.length);
+        a = match.a + match.length;
+        b = match.b + match.length;
+    }
+    render_changes(_A.size(), _B.size());
+
+    return result;
+}
+
 int DIFF::edist_pdist() 
 {
+    // Inicializa tamaño de la tabla
+    _memo.assign(_A.size() + 1, std::vector<CELL>(_B.size() + 1));
+
     // Esquina superior izquierda actua como caso base 
     _memo[0][0] = CELL{0, 0, 0, NOTHING};
 
@@ -80,7 +881,7 @@ std::string DIFF::produce_diff()
                 while (_memo[u][v].state == current_state && (_memo[u][v].i != u || _memo[u][v].j != v)) 
                 {
                     ss << _B[v-1]; 
-                    u = _memo[u][v].i; v = _memo[u][v].j;
+                    auto const cell = _memo[u][v]; u = cell.i; v = cell.j;
                 } 
                 ss << OPENING_NEW_VER;
                 break;
@@ -91,7 +892,7 @@ std::string DIFF::produce_diff()
                 while (_memo[u][v].state == current_state && (_memo[u][v].i != u || _memo[u][v].j != v))
                 {
                     ss << _A[u-1]; 
-                    u = _memo[u][v].i; v = _memo[u][v].j;
+                    auto const cell = _memo[u][v]; u = cell.i; v = cell.j;
                 }
                 ss << OPENING_OLD_VER;
                 break;
@@ -106,7 +907,7 @@ std::string DIFF::produce_diff()
                 {
                     ss << _B[v-1]; 
                     temp_ss << _A[u-1]; 
-                    u = _memo[u][v].i; v = _memo[u][v].j;
+                    auto const cell = _memo[u][v]; u = cell.i; v = cell.j;
                 }
                 temp_ss << OPENING_OLD_VER;
                 ss << OPENING_NEW_VER;
@@ -118,7 +919,7 @@ std::string DIFF::produce_diff()
                 while (_memo[u][v].state == current_state &&  (_memo[u][v].i != u || _memo[u][v].j != v)) 
                 {
                     ss << _A[u-1];
-                    u = _memo[u][v].i; v = _memo[u][v].j;
+                    auto const cell = _memo[u][v]; u = cell.i; v = cell.j;
                 }
                 break;
             }
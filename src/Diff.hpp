@@ -18,6 +18,26 @@ struct CELL {
     STATE state; 
 };
 
+// Algoritmos disponibles para calcular las diferencias
+enum ALGORITHM { 
+    EDIST, // Tabla completa de edist, O(nm) en tiempo y memoria. Considera modificaciones como un solo cambio
+    MYERS, // Algoritmo O(ND) de Myers, casi lineal cuando las cadenas son parecidas. Solo inserta y elimina
+    HIRSCHBERG, // Mismo costo minimo que EDIST por divide y venceras, O(nm) en tiempo pero O(min(n, m)) en memoria
+    WAVEFRONT // Tabla de EDIST compacta, calculada en bloques por antidiagonales en varios hilos
+};
+
+// Unidades que se comparan
+enum GRANULARITY { 
+    CHARACTERS, // Caracter por caracter
+    LINES, // Lineas completas, incluyendo el salto de linea
+    WORDS // Palabras y los espacios entre ellas
+};
+
+// Bloque de elementos comunes: u[a, a + length) == v[b, b + length)
+struct MATCH {
+    size_t a, b, length;
+};
+
 /// @brief Implementacion de un `diff` para distinguir cambios minimos en cadenas de caracteres.
 class DIFF {
 public:
@@ -25,12 +45,41 @@ public:
     /// Incurre en error si ambas cadenas estan vacias .
     /// @param u string de origen
     /// @param v string de destino
-    DIFF(const std::string &u, const std::string &v);
+    /// @param algorithm algoritmo a usar para calcular las diferencias
+    /// @param granularity unidades que se comparan. Con lineas o palabras, EDIST se calcula con HIRSCHBERG
+    DIFF(const std::string &u, const std::string &v, ALGORITHM algorithm = MYERS, GRANULARITY granularity = CHARACTERS);
 
     /// @brief Realiza las operaciones necesarias para producir el string de diferencias minimas entre u y v.
+    /// Si se pidio EDIST pero la tabla no cabe en el presupuesto de memoria, se usa HIRSCHBERG.
     /// @return String que indica diferencias mínimas entre u y v.
     std::string compute_diff() ;
 
+    /// @brief Indica cuanta memoria puede usar la tabla de EDIST antes de cambiar a HIRSCHBERG.
+    /// @param bytes presupuesto de memoria en bytes
+    void set_memory_budget(size_t bytes) { _memory_budget = bytes; }
+
+    /// @brief Indica cuantos hilos usar con WAVEFRONT.
+    /// @param threads cantidad de hilos, 0 para usar uno por hilo de hardware
+    void set_thread_count(size_t threads) { _threads = threads; }
+
+    /// @brief Algoritmo que se usara para calcular las diferencias, segun el pedido y el presupuesto de memoria.
+    /// @return Algoritmo efectivo
+    ALGORITHM effective_algorithm() const ;
+
+    /// @brief Calcula solo la distancia de edicion entre u y v (insertar, eliminar y modificar cuestan 1), sin 
+    /// recuperar los cambios. Usa el algoritmo de vectores de bits de Myers e Hyyrö: cada columna de la tabla se 
+    /// representa con sus diferencias verticales en palabras de 64 bits, con AVX2 si el procesador lo soporta.
+    /// @return Distancia minima de edicion.
+    size_t edit_distance() const ;
+
+    /// @brief Indica si u y v estan a lo sumo a cierta distancia de edicion. Termina apenas se sabe que no.
+    /// @param max_distance distancia maxima aceptada
+    /// @return Si la distancia de edicion es menor o igual a max_distance.
+    bool is_within(size_t max_distance) const ;
+
+    /// @brief Presupuesto de memoria por defecto para la tabla de EDIST o WAVEFRONT
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
 private:
     /// @brief A partir de edist, calcula el string de diferencias mínimas entre u y v.
     /// @return String que indica diferencias mínimas entre u y v.
@@ -40,11 +89,46 @@ private:
     /// @return Distancia mínima de edición. 
     int edist_pdist() ;
 
+    /// @brief Calcula los bloques comunes entre u y v con el algoritmo O(ND) de Myers, en espacio lineal.
+    /// @return Bloques comunes, ordenados y sin solaparse.
+    std::vector<MATCH> myers_matches() const ;
+
+    /// @brief Calcula los bloques comunes de un alineamiento de costo minimo (como EDIST) con el algoritmo de 
+    /// Hirschberg, que solo guarda dos filas de la tabla a la vez.
+    /// @return Bloques comunes, ordenados y sin solaparse.
+    std::vector<MATCH> hirschberg_matches() const ;
+
+    /// @brief Calcula la tabla de EDIST en bloques que caben en cache. Cada bloque depende solo del de arriba y el de 
+    /// la izquierda, asi que los bloques de una misma antidiagonal se calculan en paralelo. Cada celda ocupa 4 bytes:
+    /// 30 bits de costo y 2 bits de estado, en lugar de los 16 bytes de CELL.
+    /// @return Bloques comunes del camino de costo minimo, ordenados y sin solaparse.
+    std::vector<MATCH> wavefront_matches() const ;
+
+    /// @brief Produce el string de diferencias a partir de los bloques comunes entre u y v. Lo que queda entre
+    /// dos bloques se marca como eliminado de u, seguido de lo insertado en v.
+    /// @param matches Bloques comunes, ordenados y sin solaparse.
+    /// @return String que indica diferencias entre u y v.
+    std::string render_matches(const std::vector<MATCH> &matches) const ;
+
+    /// @brief Divide u y v en lineas o palabras, reemplaza cada unidad por un identificador de 64 bits y calcula los
+    /// bloques comunes sobre esas secuencias, que son mucho mas cortas que las originales.
+    /// @return Bloques comunes en posiciones de caracteres, ordenados y sin solaparse.
+    std::vector<MATCH> unit_matches() const ;
+
+    /// @brief Distancia de edicion entre u y v, dejando de calcular apenas se sabe que supera max_distance.
+    /// @param max_distance distancia a partir de la cual no importa el valor exacto
+    /// @return Distancia de edicion si es a lo sumo max_distance, o algun valor mayor si no.
+    size_t bounded_distance(size_t max_distance) const ;
+
     void DBG() ;
     void navigate_ancestors(int u, int v) ;
 
     std::string _A, _B; 
-    std::vector<std::vector<CELL>> _memo;
+    ALGORITHM _algorithm;
+    GRANULARITY _granularity;
+    size_t _memory_budget;
+    size_t _threads;
+    std::vector<std::vector<CELL>> _memo; // Solo se reserva para EDIST
 };
 
 #endif
\ No newline at end of file
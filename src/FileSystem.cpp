@@ -9,72 +9,265 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <deque>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "NodeArena.hpp"
+#include "Delta.hpp"
+#include "Diff.hpp"
+#include "ThreadPool.hpp"
+#include "Checkpoint.hpp"
 
 namespace CELV
 {
+    static_assert(FileRecord::DOCUMENT == static_cast<uint64_t>(FileType::DOCUMENT) && FileRecord::DIRECTORY == static_cast<uint64_t>(FileType::DIRECTORY),
+        "File records store file types as they are");
 
-    File::File(const std::string& name, FileID id, const std::string& content)
+    namespace
+    {
+        /// @brief Write name and content of every file to a snapshot, starting from file `first`
+        SnapshotRange WriteFiles(SnapshotWriter& writer, const FileTable& files, size_t first = 0)
+        {
+            std::vector<FileRecord> records;
+            records.reserve(files.size() - first);
+            for (size_t i = first; i < files.size(); i++)
+            {
+                auto const& file = files[i];
+                auto const is_document = file.GetFileType() == FileType::DOCUMENT;
+                records.push_back(FileRecord{
+                    writer.WriteBytes(file.GetName()), 
+                    static_cast<uint64_t>(file.GetFileType()), 
+                    is_document ? writer.WriteContent(file.GetContentRef()) : SNAPSHOT_NONE
+                });
+            }
+
+            return writer.WriteArray(records);
+        }
+    }
+
+    BlobStore File::_blob_store;
+    std::mutex File::_snapshot_mutex;
+
+    File::File(const std::string& name, FileID id, std::string content)
+        : _name(name)
+        , _content(_blob_store.Intern(std::move(content)))
+        , _snapshot(nullptr)
+        , _content_index(SNAPSHOT_NONE)
+        , _type(FileType::DOCUMENT)
+        , _id(id)
+    { }
+
+    File::File(const std::string& name, FileID id, ContentRef content)
         : _name(name)
         , _content(content)
+        , _snapshot(nullptr)
+        , _content_index(SNAPSHOT_NONE)
         , _type(FileType::DOCUMENT)
         , _id(id)
     { }
 
     File::File(const std::string& name, FileID id)
         : _name(name)
-        , _content("")
+        , _content(nullptr)
+        , _snapshot(nullptr)
+        , _content_index(SNAPSHOT_NONE)
         , _type(FileType::DIRECTORY)
         , _id(id)
     { }
 
-    std::string File::GetContent() const
+    File::File(const std::string& name, FileID id, std::shared_ptr<const MappedSnapshot> snapshot, uint64_t content_index)
+        : _name(name)
+        , _content(nullptr)
+        , _snapshot(std::move(snapshot))
+        , _content_index(content_index)
+        , _type(FileType::DOCUMENT)
+        , _id(id)
+    { }
+
+    BlobRef File::GetBlob() const
+    {
+        return GetContentRef()->Materialize();
+    }
+
+    const ContentRef& File::GetContentRef() const
     {
         // Return conent only if type is document
         assert(_type == FileType::DOCUMENT && "Can't get content of folder");
 
+        // Merges and diffs read files from several threads. Once built, the content doesn't change until set again
+        if (_snapshot != nullptr && std::atomic_load(&_content) == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(_snapshot_mutex);
+            if (_content == nullptr)
+                std::atomic_store(&_content, _snapshot->GetContent(_content_index));
+        }
+
         return _content;
     }
 
     void File::SetContent(const std::string& new_content)
     {
         assert(_type == FileType::DOCUMENT && "Can't set content of directory");
-        _content = new_content;
+        _content = _blob_store.Intern(new_content);
+        _snapshot = nullptr;
+    }
+
+    void File::SetContent(ContentRef new_content)
+    {
+        assert(_type == FileType::DOCUMENT && "Can't set content of directory");
+        _content = std::move(new_content);
+        _snapshot = nullptr;
+    }
+
+    const File& FileTable::operator[](FileID id) const
+    {
+        if (id >= _snapshot_file_count)
+            return _files[id - _snapshot_file_count];
+
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        auto const loaded = _loaded_files.find(id);
+        if (loaded != _loaded_files.end())
+            return loaded->second;
+
+        // Ranges are few, newest files are usually the most requested
+        auto files = _snapshot_files.rbegin();
+        while (files->first > id)
+            ++files;
+
+        auto const& snapshot = files->snapshot;
+        auto const& record = snapshot->Array<FileRecord>(files->range)[id - files->first];
+        assert((record.type == FileRecord::DIRECTORY || record.content < snapshot->GetHeader().contents.count) && "File records are checked when mapping a snapshot");
+        std::string name(snapshot->Bytes(record.name));
+        auto const file = record.type == FileRecord::DIRECTORY ? File(name, id) : File(name, id, snapshot, record.content);
+        return _loaded_files.emplace(id, file).first->second;
     }
 
-    std::vector<File> FileTree::_files;
+    void FileTable::AddSnapshotFiles(std::shared_ptr<const MappedSnapshot> snapshot, const SnapshotRange& range)
+    {
+        assert(_files.empty() && "Files of a snapshot go before files added later");
+        _snapshot_files.push_back(SnapshotFiles{std::move(snapshot), range, _snapshot_file_count});
+        _snapshot_file_count += range.count;
+    }
+
+    void FileTable::clear()
+    {
+        _snapshot_files.clear();
+        _snapshot_file_count = 0;
+        _files.clear();
+        _loaded_files.clear();
+    }
+
+    ChildMap::const_iterator ChildMap::FindByName(const std::string& name) const
+    {
+        auto const possible_id = _by_name.find(name);
+        if (possible_id == _by_name.end())
+            return _by_id.end();
+
+        return _by_id.find(possible_id->second);
+    }
+
+    void ChildMap::List(const FileTable& files, const ListOptions& options, const ListCallback& callback) const
+    {
+        auto const list_file = [&files, &callback](FileID id) {
+            auto const& file = files[id];
+            callback(FileEntry{file.GetName(), file.GetFileType(), id, file.GetSize()});
+        };
+
+        size_t listed = 0;
+        if (options.sorted)
+        {
+            for (auto it = _by_name.Seek(options.offset); it != _by_name.end() && listed < options.limit; ++it, listed++)
+                list_file(it->second);
+        }
+        else
+        {
+            for (auto it = _by_id.Seek(options.offset); it != _by_id.end() && listed < options.limit; ++it, listed++)
+                list_file(it->first);
+        }
+    }
+
+    void ChildMap::Insert(FileID id, const std::string& name, Node node)
+    {
+        _by_id.Insert(id, node);
+        _by_name.Insert(name, id);
+    }
+
+    void ChildMap::Erase(FileID id, const std::string& name)
+    {
+        _by_id.Erase(id);
+
+        // Only remove name entry if it still refers to this file
+        auto const possible_id = _by_name.find(name);
+        if (possible_id != _by_name.end() && possible_id->second == id)
+            _by_name.Erase(name);
+    }
+
+    void ChildMap::SetNode(FileID id, Node node)
+    {
+        assert(_by_id.find(id) != _by_id.end() && "Can't set node of a child that doesn't exists");
+        _by_id.Insert(id, node);
+    }
 
-    FileTree::FileTree(FileID id, std::shared_ptr<FileTree> parent,  Version version, std::shared_ptr<CELV> _version_control)
+    FileTable FileTree::_files;
+    NodeArena FileTree::_nodes;
+
+    FileTree::FileTree(FileID id, FileTree* parent,  Version version, CELV* _version_control)
         : _contained_files()
         , _parent(parent)
         , _change_box(nullptr)
+        , _log(nullptr)
         , _file_id(id)
         , _version(version)
+        , _is_celv_root(false)
         , _celv(_version_control)
+        , _snapshot_index(SNAPSHOT_NONE)
+        , _childs_pending(false)
     { }
 
-    std::shared_ptr<FileTree> FileTree::MakeRootFileTree()
+    FileTree* FileTree::MakeNode(FileID id, FileTree* parent, Version version, CELV* celv)
+    {
+        // Nodes managed by a celv are stored in its own arena, so they can be released all together
+        if (celv != nullptr)
+            return celv->NewNode(id, parent, version);
+
+        return _nodes.New<FileTree>(id, parent, version, nullptr);
+    }
+
+    FileTree* FileTree::MakeRootFileTree()
     {
         assert(_files.empty() && "Can't create filesystem root, already exists");
         _files.push_back(File{"/", 0});
 
-        return std::make_shared<FileTree>(0, nullptr, 0, nullptr);
+        return MakeNode(0, nullptr, 0, nullptr);
+    }
+
+    const File& FileTree::GetFileData() const
+    {
+        return FileData(_file_id);
     }
 
-    File FileTree::GetFileData() const
+    const File& FileTree::FileData(FileID id) const
     {
         if (CELVActive())
-            return _celv->GetFiles()[_file_id];
+            return _celv->GetFiles()[id];
 
-        return _files[_file_id];
+        return _files[id];
     }
 
-    STATUS FileTree::FromLocalFileSystem(const std::string& src_path, std::shared_ptr<FileTree>& out_tree, std::string& out_error_msg, std::vector<File>& files, Version version, std::shared_ptr<CELV> celv)
+    STATUS FileTree::FromLocalFileSystem(const std::string& src_path, FileTree*& out_tree, std::string& out_error_msg, FileTable& files, ImportStats& out_stats, const ImportOptions& options, Version version, CELV* celv)
     {
         
         std::filesystem::path p(src_path);
 
         // Guarantee that path exists
-        if (!std::filesystem::exists(p) || !std::filesystem::is_directory(p))
+        std::error_code error;
+        if (!std::filesystem::is_directory(p, error))
         {
             std::stringstream ss;
             ss <<"Path to a directory '"<<src_path<<"' does not exists\n";
@@ -82,77 +275,46 @@ namespace CELV
             return ERROR;
         }
 
-        // Root of the entire filesystem
-        auto root_file_id = files.size();
-        files.emplace_back(p.filename().string(), root_file_id);
-        auto overall_root = std::make_shared<FileTree>(root_file_id, nullptr, version, celv);
+        // Files are loaded in other threads, while nodes are created in this one as soon as their files are ready
+        LocalScanner scanner(p, options);
+        out_tree = BuildImportedTree(scanner, scanner.GetRoot(), nullptr, files, version, celv);
+        out_stats = scanner.Finish();
+        return SUCCESS;
+    }
 
-        // Iterate through whole filesystem subtree rooted at path
-        auto it = std::filesystem::directory_iterator(p);
-        while (it != end(it))
+    FileTree* FileTree::BuildImportedTree(LocalScanner& scanner, ScannedFile& scanned, FileTree* parent, FileTable& files, Version version, CELV* celv)
+    {
+        scanner.WaitUntilLoaded(scanned);
+
+        FileID new_id = files.size();
+        if (scanned.is_directory)
+            files.emplace_back(scanned.name, new_id);
+        else if (scanned.lazy_content != nullptr)
+            files.emplace_back(scanned.name, new_id, scanned.lazy_content);
+        else
+            files.emplace_back(scanned.name, new_id, std::move(scanned.content));
+
+        auto node = MakeNode(new_id, parent, version, celv);
+        for (auto& child : scanned.children)
         {
-            
-            //Check permissions. Need a way to check I have ownership 
-            auto perms = it->status().permissions();
-            if ( ( (perms & std::filesystem::perms::owner_read) != std::filesystem::perms::none 
-                    && (perms & std::filesystem::perms::owner_write) != std::filesystem::perms::none
-                 ) || (
-                    (perms & std::filesystem::perms::others_read) != std::filesystem::perms::none 
-                    && (perms & std::filesystem::perms::others_write) != std::filesystem::perms::none 
-                 )
-                )
-            {
-                if (std::filesystem::is_directory(it->path()))
-                {
-                    FileID new_id = files.size();
-                    files.push_back(File(it->path().filename().string(), new_id));
-
-                    std::shared_ptr<FileTree> child_dir;
-                    if (FromLocalFileSystem(it->path().string(), child_dir, out_error_msg, files, version, celv) == ERROR)
-                        return ERROR;
-                    
-                    overall_root->AddFile(child_dir);
-                    child_dir->SetParent(child_dir);
-                }
-                else if (std::filesystem::is_regular_file(it->path()))
-                {
-                    std::ifstream  input_str(it->path().string());
-                    std::stringstream buff;
-                    buff << input_str.rdbuf();
-
-                    // Create actual node
-                    FileID new_id = files.size();
-                    files.push_back(File(it->path().filename().string(), new_id, buff.str()));
-
-                    auto child = std::make_shared<FileTree>(new_id, overall_root, version, celv);
-                    overall_root->AddFile(child);
-                }
-                else 
-                    std::cerr<<" Ignoring '"<<it->path().string()<<"'. Not regular file nor directory\n";
-            }
-            else 
-                std::cerr<<" Ignoring '"<<it->path().string()<<"'. Not enough permissions\n";
+            scanner.WaitUntilLoaded(*child);
+            if (!child->skipped)
+                node->AddFile(BuildImportedTree(scanner, *child, node, files, version, celv));
+            child.reset(); // Release scanned data as soon as possible
+        }
 
-            //Move to next directory entry
-            ++it;
-        } 
-        out_tree = overall_root;
-        return SUCCESS;
+        return node;
     }
 
-    const std::vector<File> FileTree::List() const
+    void FileTree::List(const ListOptions& options, const ListCallback& callback) const
     {
         if (CELVActive())
-            return _celv->List();
+            return _celv->List(options, callback);
         
-        std::vector<File> results;
-        for(auto const& [file_id, file_ref] : _contained_files)
-            results.emplace_back(_files[file_id]);
-        
-        return results;
+        _contained_files.List(_files, options, callback);
     }
 
-    STATUS FileTree::ChangeDirectory(const std::string& directory_name, std::shared_ptr<FileTree>& out_new_dir, std::string& out_error_msg)
+    STATUS FileTree::ChangeDirectory(const std::string& directory_name, FileTree*& out_new_dir, std::string& out_error_msg)
     {
         if (CELVActive())
         {
@@ -164,31 +326,25 @@ namespace CELV
             out_new_dir = _celv->GetCurrentWorkingDirectoryRef();
             return SUCCESS;
         }
-        auto const& files = _contained_files;
-
-        // Iterate over files searching for a file matching this name
-        for(auto const& [file_id, file] : files)
+        auto const possible_dir = _contained_files.FindByName(directory_name);
+        if (possible_dir == _contained_files.end())
         {
-            const bool name_match = _files[file_id].GetName() == directory_name;
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
 
-            // If match and is directory...
-            if ( name_match && _files[file_id].GetFileType() == FileType::DIRECTORY)
-            {
-                out_new_dir = file;
-                return SUCCESS;
-            }
-            else if(name_match) // if match but not dir...
-            {
-                out_error_msg = "Specified file is not a directory";
-                return ERROR;
-            }
+        // If match but not dir...
+        if (_files[possible_dir->first].GetFileType() != FileType::DIRECTORY)
+        {
+            out_error_msg = "Specified file is not a directory";
+            return ERROR;
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        out_new_dir = possible_dir->second;
+        return SUCCESS;
     }
 
-    STATUS FileTree::ChangeDirectory(std::shared_ptr<FileTree>& out_new_dir, std::string& out_error_msg)
+    STATUS FileTree::ChangeDirectory(FileTree*& out_new_dir, std::string& out_error_msg)
     {
         // Redirect to celv if active
         if (CELVActive() && _celv->GetCurrentWorkingDirectoryRef()->IsRoot())
@@ -225,20 +381,17 @@ namespace CELV
         return SUCCESS;
     }
 
-    STATUS FileTree::CreateFile(const std::string& filename, FileType type, std::string& out_error_msg, std::shared_ptr<FileTree> new_parent)
+    STATUS FileTree::CreateFile(const std::string& filename, FileType type, std::string& out_error_msg, FileTree* new_parent)
     {
         // Check if CELV if necessary
         if (CELVActive())
             return _celv->CreateFile(filename, type, out_error_msg);
 
         // Check if any files has this name already
-        for(auto const& [file_id, file] : _contained_files)
+        if (_contained_files.FindByName(filename) != _contained_files.end())
         {
-            if (_files[file_id].GetName() == filename)
-            {
-                out_error_msg = "File already exists";
-                return ERROR;
-            }
+            out_error_msg = "File already exists";
+            return ERROR;
         }
 
         // Create new file now that we know we can
@@ -255,7 +408,7 @@ namespace CELV
             break;
         }
 
-        _contained_files[new_file_id] = std::make_shared<FileTree>(new_file_id, new_parent);
+        _contained_files.Insert(new_file_id, filename, MakeNode(new_file_id, new_parent, 0, nullptr));
         return SUCCESS;
     }
 
@@ -264,49 +417,47 @@ namespace CELV
         if(CELVActive())
             return _celv->RemoveFile(filename, out_error_msg);
         
-        for (auto const& [file_id, file_ref] : _contained_files)
+        auto const possible_file = _contained_files.FindByName(filename);
+        if (possible_file == _contained_files.end())
         {
-            auto const name_match = filename == _files[file_id].GetName();
-            if (name_match && _files[file_id].GetFileType() == FileType::DOCUMENT)
-            {
-                _contained_files.erase(file_id);
-                return SUCCESS;
-            }
-            else if (name_match)
-            {
-                file_ref->Destroy();
-                _contained_files.erase(file_id);
-                return SUCCESS;
-            }
-
+            out_error_msg = "No such file or directory";
+            return ERROR;
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        auto const file_id = possible_file->first;
+        auto const file_ref = possible_file->second;
+        _contained_files.Erase(file_id, filename);
+        DestroyTree(file_ref);
+        return SUCCESS;
     }
 
-    STATUS FileTree::ReadFile(const std::string& filename, std::string& out_content, std::string& out_error_msg) const
+    STATUS FileTree::ReadFile(const std::string& filename, BlobRef& out_content, std::string& out_error_msg) const
     {
         if(CELVActive())
             return _celv->ReadFile(filename, out_content, out_error_msg);
         
-        for (auto const& [file_id, file_ref] : _contained_files)
+        auto const possible_file = _contained_files.FindByName(filename);
+        if (possible_file == _contained_files.end())
         {
-            auto const name_match = filename == _files[file_id].GetName();
-            if (name_match && _files[file_id].GetFileType() == FileType::DOCUMENT)
-            {
-                out_content = _files[file_id].GetContent();
-                return SUCCESS;
-            }
-            else if (name_match)
-            {
-                out_error_msg = "Can't read content from directory";
-                return ERROR;
-            }
+            out_error_msg = "No such file or directory";
+            return ERROR;
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        auto const& file = _files[possible_file->first];
+        if (file.GetFileType() != FileType::DOCUMENT)
+        {
+            out_error_msg = "Can't read content from directory";
+            return ERROR;
+        }
+
+        if (!file.GetContentRef()->IsAvailable())
+        {
+            out_error_msg = "Local file of this document changed or was removed after being imported, its content is no longer available";
+            return ERROR;
+        }
+
+        out_content = file.GetBlob();
+        return SUCCESS;
     }
 
     STATUS FileTree::WriteFile(const std::string& filename,const std::string& content, std::string& out_error_msg)
@@ -314,23 +465,74 @@ namespace CELV
         if (CELVActive())
             return _celv->WriteFile(filename, content, out_error_msg);
         
-        for (auto const& [file_id, file_ref] : _contained_files)
+        auto const possible_file = _contained_files.FindByName(filename);
+        if (possible_file == _contained_files.end())
         {
-            auto const name_match = filename == _files[file_id].GetName();
-            if (name_match && _files[file_id].GetFileType() == FileType::DOCUMENT)
-            {
-                _files[file_id].SetContent(content);
-                return SUCCESS;
-            }
-            else if (name_match)
-            {
-                out_error_msg = "Can't write content to directory";
-                return ERROR;
-            }
+            out_error_msg = "No such file or directory";
+            return ERROR;
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        auto& file = _files[possible_file->first];
+        if (file.GetFileType() != FileType::DOCUMENT)
+        {
+            out_error_msg = "Can't write content to directory";
+            return ERROR;
+        }
+
+        file.SetContent(content);
+        return SUCCESS;
+    }
+
+    STATUS FileTree::AppendFile(const std::string& filename, std::string_view content, std::string& out_error_msg)
+    {
+        if (CELVActive())
+            return _celv->AppendFile(filename, content, out_error_msg);
+        
+        auto const possible_file = _contained_files.FindByName(filename);
+        if (possible_file == _contained_files.end())
+        {
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
+
+        auto& file = _files[possible_file->first];
+        if (file.GetFileType() != FileType::DOCUMENT)
+        {
+            out_error_msg = "Can't write content to directory";
+            return ERROR;
+        }
+
+        file.SetContent(RopeContent::FromContent(file.GetContentRef())->Append(content));
+        return SUCCESS;
+    }
+
+    STATUS FileTree::WriteFileRange(const std::string& filename, size_t offset, std::string_view content, std::string& out_error_msg)
+    {
+        if (CELVActive())
+            return _celv->WriteFileRange(filename, offset, content, out_error_msg);
+        
+        auto const possible_file = _contained_files.FindByName(filename);
+        if (possible_file == _contained_files.end())
+        {
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
+
+        auto& file = _files[possible_file->first];
+        if (file.GetFileType() != FileType::DOCUMENT)
+        {
+            out_error_msg = "Can't write content to directory";
+            return ERROR;
+        }
+
+        if (offset > file.GetSize())
+        {
+            out_error_msg = "Offset out of range, document has only " + std::to_string(file.GetSize()) + " bytes";
+            return ERROR;
+        }
+
+        file.SetContent(RopeContent::FromContent(file.GetContentRef())->Write(offset, content));
+        return SUCCESS;
     }
 
     STATUS FileTree::SetVersion(Version version, std::string& out_error_msg)
@@ -354,6 +556,42 @@ namespace CELV
         return ERROR;
     }
 
+    STATUS FileTree::SetStorageMode(StorageMode mode, std::string& out_error_msg)
+    {
+        if (CELVActive())
+        {
+            _celv->SetStorageMode(mode);
+            return SUCCESS;
+        }
+
+        out_error_msg = "CELV not initialized, can't change storage mode";
+        return ERROR;
+    }
+
+    STATUS FileTree::SetPersistenceMode(PersistenceMode mode, std::string& out_error_msg)
+    {
+        if (CELVActive())
+        {
+            _celv->SetPersistenceMode(mode);
+            return SUCCESS;
+        }
+
+        out_error_msg = "CELV not initialized, can't change persistence mode";
+        return ERROR;
+    }
+
+    STATUS FileTree::GetPersistenceStats(PersistenceStats& out_stats, std::string& out_error_msg) const
+    {
+        if (CELVActive())
+        {
+            out_stats = _celv->GetPersistenceStats();
+            return SUCCESS;
+        }
+
+        out_error_msg = "CELV not initialized, can't get persistence stats";
+        return ERROR;
+    }
+
     STATUS  FileTree::GetHistory(std::vector<Action>& out_history, std::string& out_error_msg)
     {
         if (CELVActive())
@@ -366,227 +604,169 @@ namespace CELV
         return ERROR;
     }
 
-    STATUS FileTree::InitCELV(std::string& out_error_msg, std::shared_ptr<FileTree> celv_parent)
+    STATUS FileTree::Merge(Version version1, Version version2, MergeStats& out_stats, std::string& out_error_msg)
+    {
+        if (CELVActive())
+            return _celv->Merge(version1, version2, out_stats, out_error_msg);
+
+        out_error_msg = "CELV not initialized, can't merge versions";
+        return ERROR;
+    }
+
+    STATUS FileTree::Diff(Version version1, Version version2, std::vector<VersionChange>& out_changes, std::string& out_error_msg)
+    {
+        if (CELVActive())
+            return _celv->Diff(version1, version2, out_changes, out_error_msg);
+
+        out_error_msg = "CELV not initialized, can't compare versions";
+        return ERROR;
+    }
+
+    STATUS FileTree::InitCELV(std::string& out_error_msg, FileTree* celv_parent)
     {
         if (IsCelvInitInSubtree())
         {
             out_error_msg = "Can't init celv in this directory. Already initialized in subdirectory.";            return ERROR;
         }
         
-        auto cloned_tree = CloneTree();
-        auto const& new_celv = CELV::FromTree(cloned_tree);
+        auto const& new_celv = CELV::FromTree(*this);
         _celv = new_celv;
+        _is_celv_root = true;
         _celv->SetParentDir(celv_parent);
         _file_id = _celv->GetCurrentWorkingDirectoryRef()->GetFileID();
         return SUCCESS;
     }
 
-    STATUS FileTree::ImportLocalPath(const std::string& path, std::string& out_error_msg, std::shared_ptr<FileTree> parent)
+    STATUS FileTree::ImportLocalPath(const std::string& path, std::string& out_error_msg, FileTree* parent, ImportStats& out_stats, const ImportOptions& options)
     {
         if (CELVActive())
         {
-            return _celv->ImportLocalPath(path, out_error_msg, _celv);
+            return _celv->ImportLocalPath(path, out_error_msg, out_stats, options);
         }
 
         std::filesystem::path p(path);
         auto filename = p.filename().string();
 
-        for (auto const& [file_id, file_ref] : _contained_files)
+        if (_contained_files.FindByName(filename) != _contained_files.end())
         {
-            if (filename == _files[file_id].GetName())
-            {
-                out_error_msg = "File already exists";
-                return ERROR;
-            }
+            out_error_msg = "File already exists";
+            return ERROR;
         }
 
-        std::shared_ptr<FileTree> new_child;
-        if (FromLocalFileSystem(path, new_child, out_error_msg, _files) == ERROR)
+        FileTree* new_child;
+        if (FromLocalFileSystem(path, new_child, out_error_msg, _files, out_stats, options) == ERROR)
             return ERROR;
         new_child->SetParent(parent);
         AddFile(new_child);
         return SUCCESS;
     }
 
-    std::shared_ptr<FileTree> FileTree::AddFile(std::shared_ptr<FileTree> file, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_possible_new_parent)
+    void FileTree::RemoveFile(FileID file_id)
     {
-        ChildMap new_contained(GetChilds(current_version));
-        new_contained[file->GetFileID()] = file;
-        return UpdateNode(new_contained, current_version, new_version, out_possible_new_parent);
+        _contained_files.Erase(file_id, FileData(file_id).GetName());
     }
 
-    void FileTree::RemoveFile(FileID file_id)
+    bool FileTree::ContainsFile(FileID id)
     {
-        _contained_files.erase(file_id);
+        auto const& childs = LoadedChilds();
+        return childs.find(id) != childs.end();
     }
 
-    std::shared_ptr<FileTree> FileTree::RemoveFile(FileID file_id, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_possible_new_parent)
+    void FileTree::DestroyTree(FileTree* tree)
     {
-        // Create a new map with corresponding childs
-        auto const& old_childs = GetChilds(current_version);
-        if (old_childs.find(file_id) == old_childs.end())
-            return nullptr; // If node does not contains the specified file, do nothing
-
-        ChildMap new_childs(old_childs);
+        assert((!tree->CELVActive() || tree->_is_celv_root) && "Nodes managed by a celv are released by the celv");
+        for (auto const& [file_id, child] : tree->_contained_files)
+            DestroyTree(child);
 
-        // Erase corresponding node
-        new_childs.erase(file_id);
+        // Release version control if it was initialized in this node
+        if (tree->_is_celv_root)
+        {
+            tree->_celv->Destroy();
+            delete tree->_celv;
+        }
 
-        // Update node by deleting this
-        return UpdateNode(new_childs, current_version, new_version, out_possible_new_parent);
+        _nodes.Delete(tree);
     }
 
-    std::shared_ptr<FileTree> FileTree::ReplaceFileId(FileID old_file_id, FileID new_file_id, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_possible_new_parent)
+    FileTree* FileTree::UpdateNode(const ChildMap& new_contained_files, Version version, Version new_version, FileTree* parent)
     {
-        auto const& old_childs = GetChilds(current_version);
-        auto const& possible_old_child = old_childs.find(old_file_id);
+        // If changebox is empty, update it and and return nothing
+        if (_change_box == nullptr)
+        {
+            _change_box = MakeNode(_file_id, parent, new_version, _celv);
+            _change_box->SetNewChilds(new_contained_files);
+            if (CELVActive())
+                _celv->RegisterChangeBox(this, new_version);
+            return nullptr;
+        }
 
-        if (old_childs.find(old_file_id) == old_childs.end())
-            return nullptr; // Nothing to do if nothing to replace
+        // With a modification log, the new modification becomes the change box of the last one. That's only valid
+        // when the modified version reads the last one: a version branched from an older modification must not see
+        // later modifications of other branches, so it gets a copy instead
+        if (CELVActive() && _celv->GetPersistenceMode() == PersistenceMode::MODIFICATION_LOG)
+        {
+            auto& log = LoadLog();
+            auto const last = log.entries[log.size - 1];
+            if (log.size < ModificationLog::CAPACITY && ModificationAt(version) == last)
+            {
+                auto const modification = MakeNode(_file_id, parent, new_version, _celv);
+                modification->SetNewChilds(new_contained_files);
+                last->_change_box = modification;
+                log.entries[log.size++] = modification;
+                _celv->RegisterChangeBox(last, new_version);
+                return nullptr;
+            }
+        }
 
-        ChildMap new_childs(old_childs);
-        new_childs.erase(old_file_id);
+        // If changebox if full, we need to create a new node, and the parent has to be updated to refer to it
+        auto new_node = MakeNode(_file_id, parent, new_version, _celv);
+        new_node->SetNewChilds(new_contained_files);
+        return new_node;
+    }
 
-        auto const& old_node = possible_old_child->second;
-        auto const new_node = std::make_shared<FileTree>(new_file_id, old_node->GetParent(), new_version, _celv);
-        new_childs[new_file_id] = new_node;
+    ModificationLog& FileTree::LoadLog()
+    {
+        assert(_change_box != nullptr && "Only nodes with a change box have a modification log");
+        if (_log == nullptr)
+        {
+            // Nodes loaded from a snapshot only have the chain, it never has more modifications than a log
+            _log = _celv->NewModificationLog();
+            for (auto modification = _change_box; modification != nullptr && _log->size < ModificationLog::CAPACITY; modification = modification->_change_box)
+                _log->entries[_log->size++] = modification;
+        }
 
-        return UpdateNode(new_childs, current_version, new_version, out_possible_new_parent);
+        return *_log;
     }
 
-    std::vector<std::shared_ptr<FileTree>> FileTree::ContainedFiles(Version version) const
+    bool FileTree::IsCelvInitInSubtree() const
     {
-        auto const& contained_files = UseChangeBox(version) ? _change_box->_contained_files :  _contained_files;
+        if (CELVActive())
+            return true;
 
-        std::vector<std::shared_ptr<FileTree>> files(contained_files.size());
-        size_t i = 0;
-        for (auto const& [id, file_ptr] : contained_files)
-            files[i++] = file_ptr;
+        for (auto const& [file_id, file_ref] : _contained_files)
+            if (file_ref->IsCelvInitInSubtree())
+                return true;
         
-        return files;
+        return false;
     }
 
-    bool FileTree::ContainsFile(FileID id)
+    FileTree* FileTree::CloneTree(CELV* celv) const
     {
-        return _contained_files.find(id) != _contained_files.end();
-    }
+        auto const new_root = MakeNode(_file_id, nullptr, _version, celv);
+        ChildMap new_child_map;
 
-    void FileTree::Destroy()
-    {
-        // Set every pointer to null recursively
-        _parent = nullptr;
-        for (auto &[k, child] : _contained_files)
+        for (auto const& [file_id, file_ref] : _contained_files)
         {
-            child->Destroy();
-            _contained_files[k] = nullptr; // break all references to this child
+            auto const new_tree = file_ref->CloneTree(celv);
+            new_child_map.Insert(file_id, FileData(file_id).GetName(), new_tree);
+            new_tree->SetParent(new_root);
         }
 
-        if (_change_box != nullptr)
-        {
-            _change_box->Destroy();
-            _change_box = nullptr; // break reference tu change_box
-        }
+        new_root->SetNewChilds(new_child_map);
+        return new_root;
     }
 
-    std::shared_ptr<FileTree> FileTree::UpdateNode(FileID new_file_id, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_new_version_parent)
-    {
-        // If changebox is empty, update it and and return nothing
-        if (_change_box == nullptr)
-        {
-            _change_box = std::make_shared<FileTree>(new_file_id, _parent, new_version, _celv);
-            _change_box->SetNewChilds(_contained_files);
-            return nullptr;
-        }
-
-        // If changebox if full, we need to create a new node
-        auto new_node = std::make_shared<FileTree>(new_file_id, nullptr, new_version, _celv);
-        // Update parent for this node
-        if (_parent == nullptr)
-        {   
-            // If this node is root, then new created node is this versions's root
-            out_new_version_parent = new_node;
-            return new_node;
-        }
-
-        auto parent_childs(_parent->GetChilds(current_version));
-        parent_childs.erase(_file_id);
-        parent_childs[new_file_id] = new_node;
-        auto possible_new_parent = _parent->UpdateNode(parent_childs, current_version,new_version, out_new_version_parent);
-
-        if (possible_new_parent == nullptr)
-            new_node->SetParent(_parent);
-        else 
-            new_node->SetParent(possible_new_parent);
-
-        // Update childs of this node as childs of change box, the newest version 
-        new_node->SetNewChilds(_change_box->GetChilds(current_version));
-
-        return new_node;
-    }
-        
-    std::shared_ptr<FileTree> FileTree::UpdateNode(const ChildMap& new_contained_files, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_new_version_parent)
-    {
-        // If changebox is empty, update it and and return nothing
-        if (_change_box == nullptr)
-        {
-            _change_box = std::make_shared<FileTree>(_file_id, _parent, new_version, _celv);
-            _change_box->SetNewChilds(new_contained_files);
-            return nullptr;
-        }
-
-        // If changebox if full, we need to create a new node
-        auto new_node = std::make_shared<FileTree>(_file_id, nullptr, new_version, _celv);
-        new_node->SetNewChilds(new_contained_files);
-
-        // Update parent for this node
-        if (IsRoot())
-        {   
-            // If this node is root, then new created node is this versions's root
-            out_new_version_parent = new_node;
-            return new_node;
-        }
-
-        auto parent_childs(_parent->GetChilds(current_version));
-        parent_childs[_file_id] = new_node;
-        auto possible_new_parent = _parent->UpdateNode(parent_childs, current_version, new_version, out_new_version_parent);
-
-        if (possible_new_parent == nullptr)
-            new_node->SetParent(_parent);
-        else 
-            new_node->SetParent(possible_new_parent);
-
-        return new_node;
-    }
-
-    bool FileTree::IsCelvInitInSubtree() const
-    {
-        if (CELVActive())
-            return true;
-
-        for (auto const& [file_id, file_ref] : _contained_files)
-            if (file_ref->IsCelvInitInSubtree())
-                return true;
-        
-        return false;
-    }
-
-    std::shared_ptr<FileTree> FileTree::CloneTree() const
-    {
-        auto const new_root = std::make_shared<FileTree>(_file_id, nullptr, _version, _celv);
-        ChildMap new_child_map;
-
-        for (auto const& [file_id, file_ref] : _contained_files)
-        {
-            auto const new_tree = file_ref->CloneTree();
-            new_child_map[file_id] = new_tree;
-            new_tree->SetParent(new_root);
-        }
-
-        new_root->SetNewChilds(new_child_map);
-        return new_root;
-    }
-
-    std::string Action::Str() const
+    std::string Action::Str() const
     {
         std::stringstream ss;
         ss  << MAGENTA << "[ " << origin_version << BLUE << " -> " << MAGENTA << new_version << " ]" << std::endl;
@@ -596,6 +776,12 @@ namespace CELV
         case ActionType::WRITE :
             ss << "escribir ";
             break;
+        case ActionType::APPEND :
+            ss << "anexar";
+            break;
+        case ActionType::WRITE_RANGE :
+            ss << "escribir_en";
+            break;
         case ActionType::CREATE_DIR: 
             ss << "crear_dir";
             break;
@@ -633,17 +819,32 @@ namespace CELV
 
     CELV::CELV()
         : _files()
+        , _working_path(PathTable::ROOT)
+        , _ancestors_loaded(true)
+        , _parent_file(nullptr)
+        , _arena(USE_HUGE_PAGES)
+        , _snapshot_node_count(0)
+        , _snapshot_versions(0)
+        , _snapshot_actions(0)
+        , _snapshot_change_box_count(0)
+        , _snapshot_history_loaded(true)
+        , _snapshot_change_boxes_loaded(true)
+        , _checkpoint_celv(SNAPSHOT_NONE)
+        , _checkpoint_sizes()
     { 
         _current_version = 0; // initial version
         _next_available_version = 1; // next possible version
-        _versions.push_back(std::make_shared<FileTree>(0, nullptr, _current_version)); // create an original version
-        _working_dir = _versions[_current_version]; // set working dir as root of only version available
+        _storage_mode = StorageMode::FULL;
+        _persistence_mode = PersistenceMode::CHANGE_BOX;
+        _versions.push_back(NewNode(0, nullptr, _current_version)); // create an original version
+        _working_dir = GetVersionRoot(_current_version); // set working dir as root of only version available
         _files.emplace_back("/", 0); // root dir is /
     }
 
-    std::shared_ptr<CELV> CELV::FromTree(std::shared_ptr<FileTree> file_tree)
+    CELV* CELV::FromTree(const FileTree& original_tree)
     { 
-        auto celv = std::make_shared<CELV>();
+        auto celv = new CELV();
+        auto file_tree = original_tree.CloneTree(celv);
 
         file_tree->SetParent(nullptr);
         celv->_current_version = 0; // initial version
@@ -652,7 +853,7 @@ namespace CELV
         celv->_working_dir = celv->_versions[celv->_current_version]; // set working dir as root of only version available
         
         // Traverse given tree updating their values
-        std::stack<std::shared_ptr<FileTree>> file_trees;
+        std::stack<FileTree*> file_trees;
         std::map<FileID, FileID> old_to_new;
         file_trees.emplace(celv->_working_dir);
 
@@ -687,11 +888,11 @@ namespace CELV
         {
             auto next_tree = file_trees.top();
             file_trees.pop();
-            FileTree::ChildMap new_contained;
+            ChildMap new_contained;
             for (auto const&[old_file_id, file_ref] : next_tree->_contained_files)
             {
                 auto new_id = old_to_new[old_file_id];
-                new_contained[new_id] = file_ref;
+                new_contained.Insert(new_id, FileTree::_files[old_file_id].GetName(), file_ref);
                 file_trees.push(file_ref);
             }
             next_tree->SetNewChilds(new_contained);
@@ -700,21 +901,13 @@ namespace CELV
         return celv;
     }
 
-    const std::vector<File> CELV::List() const
+    void CELV::List(const ListOptions& options, const ListCallback& callback) const
     {
         assert(_working_dir != nullptr && "File tree is not initialized");
-        auto const contained_files = _working_dir->ContainedFiles(_current_version);
-        std::vector<File> files;
-        for (auto const& file_tree : contained_files)
-        {
-            auto const file_id = file_tree->GetFileID();
-            files.emplace_back(_files[file_id]);
-        }
-
-        return files;
+        _working_dir->GetChilds(_current_version).List(_files, options, callback);
     }
 
-    std::string CELV::GetCurrentWorkingDirectory() const
+    const std::string& CELV::GetCurrentWorkingDirectory() const
     {
         assert(_working_dir != nullptr && "File tree is not initialized");
         auto dir_id =  _working_dir->GetFileID(_current_version);
@@ -723,57 +916,113 @@ namespace CELV
 
     STATUS CELV::ChangeDirectory(const std::string& directory_name, std::string& out_error_msg)
     {
-        auto const& files = _working_dir->ContainedFiles(_current_version);
+        auto const& childs = _working_dir->GetChilds(_current_version);
+        auto const possible_dir = childs.FindByName(directory_name);
 
-        // Iterate over files searching for a file matching this name
-        for(auto const& file : files)
+        // if couldn't find dir...
+        if (possible_dir == childs.end())
         {
-            auto const& file_id = file->GetFileID();
-            const bool name_match = _files[file_id].GetName() == directory_name;
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
 
-            // If match and is directory...
-            if ( name_match && _files[file_id].GetFileType() == FileType::DIRECTORY)
-            {
-                _working_dir = file;
-                return SUCCESS;
-            }
-            else if(name_match) // if match but not dir...
-            {
-                out_error_msg = "Specified file is not a directory";
-                return ERROR;
-            }
+        // if match but not dir...
+        if (_files[possible_dir->first].GetFileType() != FileType::DIRECTORY)
+        {
+            out_error_msg = "Specified file is not a directory";
+            return ERROR;
         }
 
-        // if couldn't find dir...
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        if (_ancestors_loaded)
+            _ancestors.push_back(_working_dir);
+        _working_dir = possible_dir->second;
+        _working_path = _paths.Child(_working_path, possible_dir->first);
+        return SUCCESS;
     }
 
     STATUS CELV::ChangeDirectory(std::string& out_error_msg)
     {
-        if (_working_dir->GetParent() == nullptr)
+        if (_working_path == PathTable::ROOT)
         {
             out_error_msg = "Can't go up from filesystem root";
             return ERROR;
         }
 
-        std::string s;
-        assert(SetVersion(_current_version, s, 1) == SUCCESS);
+        LoadAncestors();
+        _working_dir = _ancestors.back();
+        _ancestors.pop_back();
+        _working_path = _paths.Parent(_working_path);
         return SUCCESS;
     }
 
-    STATUS CELV::CreateFile(const std::string& filename, FileType type, std::string& out_error_msg)
+    void CELV::LoadAncestors()
     {
+        if (_ancestors_loaded)
+            return;
 
-        // Check if any files has this name already
-        for(auto const& file : _working_dir->ContainedFiles(_current_version))
+        std::vector<PathID> path;
+        for (auto directory = _working_path; directory != PathTable::ROOT; directory = _paths.Parent(directory))
+            path.push_back(directory);
+
+        // The working directory was reached from the root of the current version, so every step exists
+        _ancestors.clear();
+        auto node = GetVersionRoot(_current_version);
+        for (auto directory = path.rbegin(); directory != path.rend(); ++directory)
+        {
+            _ancestors.push_back(node);
+            node = node->GetChilds(_current_version).find(_paths.FileOf(*directory))->second;
+        }
+
+        assert(node == _working_dir && "Working directory is not reachable from the root of its version");
+        _ancestors_loaded = true;
+    }
+
+    void CELV::UpdateWorkingDirectory(const ChildMap& new_childs)
+    {
+        LoadAncestors();
+        auto const new_version = _next_available_version;
+
+        // Copies are propagated up the cursor of ancestors instead of parent pointers. A node shared by several
+        // versions only points to one of its parents, which might not be the one in the current version
+        auto level = _ancestors.size();
+        auto copy = _working_dir->UpdateNode(new_childs, _current_version, new_version, level > 0 ? _ancestors[level - 1] : nullptr);
+        if (copy != nullptr)
+            _working_dir = copy;
+
+        while (level > 0)
         {
-            auto const file_id = file->GetFileID();
-            if (_files[file_id].GetName() == filename)
+            // An ancestor not copied is shared by the new version, which must read it as the current one does. When
+            // a version branched from an older one modified it in between, it's updated as well to hide that change
+            auto const parent = _ancestors[--level];
+            if (copy == nullptr && parent->ModificationAt(new_version) == parent->ModificationAt(_current_version))
+                continue;
+
+            ChildMap parent_childs(parent->GetChilds(_current_version));
+            if (copy != nullptr)
+                parent_childs.SetNode(copy->GetFileID(), copy);
+            auto const parent_copy = parent->UpdateNode(parent_childs, _current_version, new_version, level > 0 ? _ancestors[level - 1] : nullptr);
+            if (parent_copy != nullptr)
             {
-                out_error_msg = "File already exists";
-                return ERROR;
+                if (copy != nullptr)
+                    copy->SetParent(parent_copy);
+                _ancestors[level] = parent_copy;
             }
+            copy = parent_copy;
+        }
+
+        // If the copies reached the root, the new root is the root of the new version
+        _versions.push_back(copy != nullptr ? copy : GetVersionRoot(_current_version));
+    }
+
+    STATUS CELV::CreateFile(const std::string& filename, FileType type, std::string& out_error_msg)
+    {
+
+        // Check if any files has this name already
+        auto const& childs = _working_dir->GetChilds(_current_version);
+        if (childs.FindByName(filename) != childs.end())
+        {
+            out_error_msg = "File already exists";
+            return ERROR;
         }
 
         // Add file according to type
@@ -794,19 +1043,9 @@ namespace CELV
         // Add file to current directory
         // Note that adding a new file means that the version root might be new 
         // and that a new version of current working dir could be created
-        std::shared_ptr<FileTree> possible_new_version_parent = nullptr;
-        auto possible_new_node = _working_dir->AddFile(std::make_shared<FileTree>(new_file_id, _working_dir, _next_available_version, _working_dir->_celv), _current_version, _next_available_version, possible_new_version_parent);
-
-        // Update version root
-        if (possible_new_version_parent != nullptr) // if a new root is created, added to version control
-            _versions.push_back(possible_new_version_parent);
-        else // if no new version of root is created, repeat root
-            _versions.push_back(_versions[_current_version]);
-
-        // If created a new node version for our working directory, update current working directory
-        if (possible_new_node != nullptr)
-            _working_dir = possible_new_node;
-
+        ChildMap new_childs(childs);
+        new_childs.Insert(new_file_id, filename, FileTree::MakeNode(new_file_id, _working_dir, _next_available_version, this));
+        UpdateWorkingDirectory(new_childs);
         
         //Register this action
         PushAction(Action
@@ -824,115 +1063,164 @@ namespace CELV
 
     STATUS CELV::RemoveFile(const std::string& filename, std::string& out_error_msg)
     {
-        for(auto const& file : _working_dir->ContainedFiles(_current_version))
+        auto const& childs = _working_dir->GetChilds(_current_version);
+        auto const possible_file = childs.FindByName(filename);
+        if (possible_file == childs.end())
         {
-            auto const file_id = file->GetFileID();
-            if (_files[file_id].GetName() == filename)
-            {
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
 
-                std::shared_ptr<FileTree> possible_new_version_parent = nullptr;
-                auto possible_new_node = _working_dir->RemoveFile(file_id, _current_version, _next_available_version, possible_new_version_parent);
+        ChildMap new_childs(childs);
+        new_childs.Erase(possible_file->first, filename);
+        UpdateWorkingDirectory(new_childs);
 
-                if (possible_new_version_parent != nullptr)
-                    _versions.push_back(possible_new_version_parent);
-                else 
-                    _versions.push_back(_versions[_current_version]);
+        //Register this action
+        PushAction(Action{ActionType::REMOVE, {filename}, _current_version, _next_available_version});
+
+        _current_version = _next_available_version++;
+        return SUCCESS;
+    }
 
-                if (possible_new_node != nullptr)
-                    _working_dir = possible_new_node;
+    STATUS CELV::ReadFile(const std::string& filename, BlobRef& out_content, std::string& out_error_msg) const
+    {
+        auto const& childs = _working_dir->GetChilds(_current_version);
+        auto const possible_file = childs.FindByName(filename);
+        if (possible_file == childs.end())
+        {
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
 
-                //Register this action
-                PushAction(Action{ActionType::REMOVE, {filename}, _current_version, _next_available_version});
+        auto const& file = _files[possible_file->first];
+        if (file.GetFileType() != FileType::DOCUMENT)
+        {
+            out_error_msg = "File is not a document, can't read directories";
+            return ERROR;
+        }
 
-                _current_version = _next_available_version++;
-                return SUCCESS;
-            }
+        if (!file.GetContentRef()->IsAvailable())
+        {
+            out_error_msg = "Local file of this document changed or was removed after being imported, its content is no longer available";
+            return ERROR;
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        out_content = file.GetBlob();
+        return SUCCESS;
+    }
+
+    STATUS CELV::WriteFile(const std::string& filename, const std::string& content, std::string& out_error_msg)
+    {
+        FileID file_id;
+        if (FindDocument(filename, file_id, out_error_msg) == ERROR)
+            return ERROR;
+
+        auto const new_content = StoreContent(_files[file_id].GetContentRef(), content);
+        UpdateDocument(file_id, new_content, ActionType::WRITE, {filename, content});
+        return SUCCESS;
     }
 
-    STATUS CELV::ReadFile(const std::string& filename, std::string& out_content, std::string& out_error_msg) const
+    STATUS CELV::AppendFile(const std::string& filename, std::string_view content, std::string& out_error_msg)
     {
-        for(auto const& file : _working_dir->ContainedFiles(_current_version))
+        FileID file_id;
+        if (FindDocument(filename, file_id, out_error_msg) == ERROR)
+            return ERROR;
+
+        // New version shares every chunk of the previous one
+        auto const new_content = RopeContent::FromContent(_files[file_id].GetContentRef())->Append(content);
+        UpdateDocument(file_id, new_content, ActionType::APPEND, {filename, std::string(content)});
+        return SUCCESS;
+    }
+
+    STATUS CELV::WriteFileRange(const std::string& filename, size_t offset, std::string_view content, std::string& out_error_msg)
+    {
+        FileID file_id;
+        if (FindDocument(filename, file_id, out_error_msg) == ERROR)
+            return ERROR;
+
+        auto const& file = _files[file_id];
+        if (offset > file.GetSize())
         {
-            auto const file_id = file->GetFileID();
-            bool name_match = _files[file_id].GetName() == filename;
-            if (name_match && _files[file_id].GetFileType() == FileType::DOCUMENT)
-            {
-                out_content = _files[file_id].GetContent();
-                return SUCCESS;
-            }
-            else if (name_match)
-            {
-                out_error_msg = "File is not a document, can't read directories";
-                return ERROR;
-            }
+            out_error_msg = "Offset out of range, document has only " + std::to_string(file.GetSize()) + " bytes";
+            return ERROR;
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        auto const new_content = RopeContent::FromContent(file.GetContentRef())->Write(offset, content);
+        UpdateDocument(file_id, new_content, ActionType::WRITE_RANGE, {filename, std::to_string(offset), std::string(content)});
+        return SUCCESS;
     }
 
-    STATUS CELV::WriteFile(const std::string& filename, const std::string& content, std::string& out_error_msg)
+    STATUS CELV::FindDocument(const std::string& filename, FileID& out_file_id, std::string& out_error_msg) const
     {
-        for(auto const& file : _working_dir->ContainedFiles(_current_version))
+        auto const& childs = _working_dir->GetChilds(_current_version);
+        auto const possible_file = childs.FindByName(filename);
+        if (possible_file == childs.end())
         {
-            auto const file_id = file->GetFileID();
-            bool name_match = _files[file_id].GetName() == filename;
-            if (name_match && _files[file_id].GetFileType() == FileType::DOCUMENT)
-            {
-                auto const& file = _files[file_id];
-                auto const new_file_id = _files.size();
-                _files.emplace_back(file.GetName(), new_file_id, content);
+            out_error_msg = "No such file or directory";
+            return ERROR;
+        }
+
+        out_file_id = possible_file->first;
+        if (_files[out_file_id].GetFileType() != FileType::DOCUMENT)
+        {
+            out_error_msg = "File is not a document, can't write on directories";
+            return ERROR;
+        }
 
-                std::shared_ptr<FileTree> possible_new_parent = nullptr;
-                auto const possible_new_cwd = _working_dir->ReplaceFileId(file_id, new_file_id, _current_version, _next_available_version, possible_new_parent);
+        return SUCCESS;
+    }
 
-                if (possible_new_parent != nullptr)
-                    _versions.push_back(possible_new_parent);
-                else
-                    _versions.push_back(_versions[_current_version]);
-                
-                if (possible_new_cwd != nullptr)
-                    _working_dir = possible_new_cwd;
+    void CELV::UpdateDocument(FileID file_id, ContentRef content, ActionType type, ActionArgs args)
+    {
+        auto const new_file_id = _files.size();
+        _files.emplace_back(_files[file_id].GetName(), new_file_id, std::move(content));
 
-                //Register this action
-                PushAction(Action{ActionType::WRITE, {filename, content}, _current_version, _next_available_version});
+        // The document is replaced by a node for its new file
+        ChildMap new_childs(_working_dir->GetChilds(_current_version));
+        new_childs.Erase(file_id, _files[file_id].GetName());
+        new_childs.Insert(new_file_id, _files[new_file_id].GetName(), FileTree::MakeNode(new_file_id, _working_dir, _next_available_version, this));
+        UpdateWorkingDirectory(new_childs);
 
-                _current_version = _next_available_version++;
+        //Register this action
+        PushAction(Action{type, std::move(args), _current_version, _next_available_version});
 
-                return SUCCESS;
-            }
-            else if (name_match)
+        _current_version = _next_available_version++;
+    }
+
+    ContentRef CELV::StoreContent(const ContentRef& previous, const std::string& content) const
+    {
+        auto& blob_store = File::GetBlobStore();
+        if (_storage_mode == StorageMode::DELTA)
+        {
+            // An identical content already stored is always cheaper than a delta
+            if (blob_store.Find(content) != nullptr)
+                return blob_store.Intern(content);
+
+            auto const delta = DeltaContent::Encode(previous, content);
+            if (delta != nullptr)
             {
-                out_error_msg = "File is not a document, can't write on directories";
-                return ERROR;
+                blob_store.AddDelta(delta, delta->GetEncodedSize());
+                return delta;
             }
         }
 
-        out_error_msg = "No such file or directory";
-        return ERROR;
+        return blob_store.Intern(content);
     }
 
-    STATUS CELV::ImportLocalPath(const std::string& path, std::string& out_error_msg, std::shared_ptr<CELV> celv)
+    STATUS CELV::ImportLocalPath(const std::string& path, std::string& out_error_msg, ImportStats& out_stats, const ImportOptions& options)
     {
         std::filesystem::path p(path);
         auto filename = p.filename().string();
 
-        for(auto const&[file_id, file_ref] : _working_dir->GetChilds(_current_version))
+        auto const& childs = _working_dir->GetChilds(_current_version);
+        if (childs.FindByName(filename) != childs.end())
         {
-            auto child_name = _files[file_id].GetName();
-            if (filename == child_name)
-            {
-                out_error_msg = "File already exists";
-                return ERROR;
-            }
+            out_error_msg = "File already exists";
+            return ERROR;
         }
 
-        std::shared_ptr<FileTree> new_node;
-        if (FileTree::FromLocalFileSystem(path, new_node, out_error_msg, _files, _next_available_version, celv) == ERROR)
+        FileTree* new_node;
+        if (FileTree::FromLocalFileSystem(path, new_node, out_error_msg, _files, out_stats, options, _next_available_version, this) == ERROR)
             return ERROR;
         
         new_node ->SetParent(_working_dir);
@@ -940,19 +1228,9 @@ namespace CELV
         // Add file to current directory
         // Note that adding a new file means that the version root might be new 
         // and that a new version of current working dir could be created
-        std::shared_ptr<FileTree> possible_new_version_parent = nullptr;
-        auto possible_new_node = _working_dir->AddFile(new_node, _current_version, _next_available_version, possible_new_version_parent);
-
-        // Update version root
-        if (possible_new_version_parent != nullptr) // if a new root is created, added to version control
-            _versions.push_back(possible_new_version_parent);
-        else // if no new version of root is created, repeat root
-            _versions.push_back(_versions[_current_version]);
-
-        // If created a new node version for our working directory, update current working directory
-        if (possible_new_node != nullptr)
-            _working_dir = possible_new_node;
-
+        ChildMap new_childs(childs);
+        new_childs.Insert(new_node->GetFileID(), new_node->GetFileName(), new_node);
+        UpdateWorkingDirectory(new_childs);
         
         //Register this action
         PushAction(Action
@@ -968,7 +1246,7 @@ namespace CELV
         return SUCCESS;
     }
 
-    STATUS CELV::SetVersion(Version version, std::string& out_error_msg, size_t skip_in_stack)
+    STATUS CELV::SetVersion(Version version, std::string& out_error_msg)
     {
         if (version >= _next_available_version) // raise error if requesting a version too high
         {
@@ -976,126 +1254,1481 @@ namespace CELV
             return ERROR;
         }
 
-        // When changing versions, we first need to check if the working directory is one that 
-        // exists in that version.
-        // We traverse the filesystem tree up to the root to get the path required to go down again.
-        std::stack<FileID> path_to_cwd;
-        auto next_dir = _working_dir;
-        while (!next_dir->IsRoot())
+        // The working directory might not exist in that version, then we stay in its deepest ancestor that does
+        auto const resolved = Resolve(version, _working_path);
+        _current_version = version;
+        _working_dir = resolved.node;
+        _working_path = resolved.path;
+        _ancestors_loaded = false; // Only loaded when needed, so switching versions stays O(1)
+        return SUCCESS;
+    }
+
+    Resolution CELV::Resolve(Version version, PathID path)
+    {
+        Resolution resolved;
+        if (_resolutions.Find(version, path, resolved))
+            return resolved;
+
+        // Skip to the deepest ancestor already resolved in this version, so only the rest of the path is traversed
+        std::vector<PathID> pending = {path};
+        auto ancestor = _paths.Parent(path);
+        while (pending.back() != PathTable::ROOT && !_resolutions.Find(version, ancestor, resolved))
+        {
+            pending.push_back(ancestor);
+            ancestor = _paths.Parent(ancestor);
+        }
+
+        if (pending.back() == PathTable::ROOT)
         {
-            path_to_cwd.push(next_dir->GetFileID());
-            next_dir = next_dir->GetParent();
+            pending.pop_back();
+            resolved = Resolution{GetVersionRoot(version), PathTable::ROOT};
         }
 
-        _current_version = version;
-        next_dir = _versions[version];
-        while(path_to_cwd.size() > skip_in_stack)
+        // An ancestor missing in this version is also where every path below it stops
+        auto const ancestor_found = pending.empty() || resolved.path == _paths.Parent(pending.back());
+        for (auto next = pending.rbegin(); ancestor_found && next != pending.rend(); ++next)
         {
-            // Get id of next folder to advance
-            auto next_dir_id = path_to_cwd.top();
-            path_to_cwd.pop();
-            
-            auto const &childs = next_dir->GetChilds(version);
-            // If this folder does not contains the directory we're looking for, 
-            // we end this
-            auto possible_dir = childs.find(next_dir_id);
-            if (possible_dir == childs.end())
+            auto const& childs = resolved.node->GetChilds(version);
+            auto const child = childs.find(_paths.FileOf(*next));
+            if (child == childs.end())
                 break;
-            
-            // If we found it, set the next dir as this dir
-            next_dir = (*possible_dir).second;
+
+            resolved = Resolution{child->second, *next};
+            _resolutions.Insert(version, *next, resolved);
         }
 
-        _working_dir = next_dir;
-        return SUCCESS;
+        if (resolved.path != path)
+            _resolutions.Insert(version, path, resolved);
+        return resolved;
     }
 
-    void CELV::Destroy()
+    PathID CELV::PathOf(const FileTree* node)
     {
-        for (auto &version : _versions)
-            version->Destroy();
-        _versions.clear();
-        _files.clear();
-        _history.clear();
-        _working_dir = nullptr;
+        std::vector<FileID> file_ids;
+        for (; !node->IsRoot(); node = node->GetParent())
+            file_ids.push_back(node->GetFileID());
+
+        auto path = PathTable::ROOT;
+        for (auto id = file_ids.rbegin(); id != file_ids.rend(); ++id)
+            path = _paths.Child(path, *id);
+        return path;
     }
 
-    FileSystem::FileSystem()
+    /// @brief Merge of a directory, computed before creating any node. Children of the merged directory are the ones
+    /// of the base node plus some edits
+    struct CELV::MergePlan
     {
-        _file_tree = FileTree::MakeRootFileTree();
-        _working_directory = _file_tree;
-    }
-
-    std::vector<File> FileSystem::List() const
+        enum class EditType
+        {
+            NONE, // Nothing to do, for example conflicting documents that turned out to have the same content
+            INSERT, // Insert an existing node as it is
+            DIRECTORY, // Insert a merged directory
+            CONFLICT // Insert a new document with the differences of two documents
+        };
+
+        /// @brief Change to the children of the base node
+        struct Edit
+        {
+            EditType type;
+            FileID replaced; // Child of base removed by this edit, NO_FILE if none
+            std::string name; // Name of inserted child
+            FileID id; // Inserted child for INSERT
+            FileTree* node; // Inserted node for INSERT
+            std::unique_ptr<MergePlan> directory; // Merged directory for DIRECTORY
+            ContentRef previous; // Content of base document for CONFLICT
+            std::string content; // Content with differences for CONFLICT
+        };
+
+        static constexpr FileID NO_FILE = std::numeric_limits<FileID>::max();
+
+        FileID id; // Id of this directory
+        const FileTree* base;
+        Version base_version;
+        std::deque<Edit> edits; // Deque, so edits filled by other tasks are not moved by new edits
+    };
+
+    /// @brief State shared by every task of a merge
+    struct CELV::MergeContext
     {
-        return _working_directory->List();
-    }
-
-    std::string  FileSystem::GetCurrentWorkingDirectory() const
+        ThreadPool& pool;
+        std::unordered_set<FileID> changed; // Directories where a change box was filled after the oldest merged version
+        std::atomic<size_t> merged_directories;
+        std::atomic<size_t> shared_subtrees;
+        std::atomic<size_t> conflicts;
+    };
+
+    STATUS CELV::Merge(Version version1, Version version2, MergeStats& out_stats, std::string& out_error_msg)
     {
-        return _working_directory->GetFileData().GetName();
-    }
+        if (version1 >= _next_available_version || version2 >= _next_available_version)
+        {
+            out_error_msg = "Invalid version";
+            return ERROR;
+        }
 
-    STATUS FileSystem::ChangeDirectory(const std::string& directory_name, std::string& out_error_msg)
-    {
-        std::shared_ptr<FileTree> new_cwd;
-        auto status = _working_directory->ChangeDirectory(directory_name, new_cwd, out_error_msg);
-        if (status == ERROR)
-            return status;
+        ThreadPool pool;
+        MergeContext context{pool, {}, {0}, {0}, {0}};
 
-        _working_directory = new_cwd;
-        return SUCCESS;
-    }
+        // A node reached in both versions might still differ if a change box was filled in its subtree after the 
+        // oldest version, even after the newest one, since it's also seen from both. Such directories are always visited
+        CollectChangedDirectories(std::min(version1, version2), _next_available_version, context.changed);
 
-    STATUS FileSystem::ChangeDirectory(std::string& out_error_msg)
-    {
-        std::shared_ptr<FileTree> new_cwd;
-        auto status = _working_directory->ChangeDirectory(new_cwd, out_error_msg);
-        if (status == ERROR)
-            return status;
+        // First compute the merge in parallel, then create nodes and files in this thread
+        auto const root1 = GetVersionRoot(version1);
+        auto const root2 = GetVersionRoot(version2);
+        MergePlan plan;
+        plan.id = root1->GetFileID(version1);
+        pool.Submit([&]() { PlanMerge(plan, root1, version1, root2, version2, context); });
+        pool.Wait();
 
-        _working_directory = new_cwd;
+        auto const new_version = _next_available_version++;
+        _versions.push_back(BuildMerge(plan, nullptr, new_version));
+        PushAction(Action{ActionType::MERGE, {std::to_string(version1), std::to_string(version2)}, _current_version, new_version});
+
+        // Keep working directory if it still exists in merged version
+        std::string error_msg;
+        SetVersion(new_version, error_msg);
+
+        out_stats = MergeStats{new_version, context.merged_directories, context.shared_subtrees, context.conflicts};
         return SUCCESS;
     }
 
-    STATUS FileSystem::CreateFile(const std::string& filename, FileType type, std::string& out_error_msg)
+    void CELV::CollectChangedDirectories(Version after, Version until, std::unordered_set<FileID>& out_changed)
     {
-        return _working_directory->CreateFile(filename, type, out_error_msg, _working_directory);
-    }
+        LoadSnapshotChangeBoxes();
 
-    STATUS FileSystem::RemoveFile(const std::string& filename, std::string& out_error_msg)
-    {
-        return _working_directory->RemoveFile(filename, out_error_msg);
-    }
+        auto const by_version = [](Version version, const std::pair<Version, FileTree*>& change_box) { return version < change_box.first; };
+        auto const first = std::upper_bound(_change_boxes.begin(), _change_boxes.end(), after, by_version);
+        auto const last = std::upper_bound(first, _change_boxes.end(), until, by_version);
 
-    STATUS FileSystem::ReadFile(const std::string& filename, std::string& out_content, std::string& out_error_msg) const
-    {
-        return _working_directory->ReadFile(filename, out_content, out_error_msg);
+        // Stop going up as soon as an ancestor was already added, its own ancestors are there too
+        for (auto it = first; it != last; ++it)
+            for (auto node = it->second; node != nullptr && out_changed.insert(node->GetFileID()).second; node = node->GetParent());
     }
 
-    STATUS FileSystem::WriteFile(const std::string& filename,const std::string& content, std::string& out_error_msg)
+    void CELV::PlanMerge(MergePlan& plan, const FileTree* primary, Version primary_version, const FileTree* secondary, Version secondary_version, MergeContext& context) const
     {
-        return _working_directory->WriteFile(filename, content, out_error_msg);
-    }
+        using EditType = MergePlan::EditType;
+        plan.base = primary;
+        plan.base_version = primary_version;
+
+        auto const& primary_childs = primary->GetChilds(primary_version);
+        auto const is_changed_directory = [this, &context](FileID id) {
+            return _files[id].GetFileType() == FileType::DIRECTORY && context.changed.count(id) > 0;
+        };
+
+        // Add an edit merging a directory in a task of its own
+        auto const merge_directory = [&](FileID replaced, FileID id, const FileTree* node, Version version, const FileTree* other, Version other_version) {
+            auto& edit = plan.edits.emplace_back(MergePlan::Edit{EditType::DIRECTORY, replaced, _files[id].GetName(), id, nullptr, std::make_unique<MergePlan>(), nullptr, {}});
+            auto const directory = edit.directory.get();
+            directory->id = id;
+            context.pool.Submit([this, directory, node, version, other, other_version, &context]() { 
+                PlanMerge(*directory, node, version, other, other_version, context); 
+            });
+        };
 
-    STATUS FileSystem::SetVersion(Version version, std::string& out_error_msg)
-    {
-        return _working_directory->SetVersion(version, out_error_msg);
-    }
+        // A changed directory reachable from only one version is rebuilt, so the merged version sees it as it was
+        auto const keep_primary = [&](FileID id, const FileTree* node) {
+            if (is_changed_directory(id))
+                merge_directory(id, id, node, primary_version, nullptr, 0);
+        };
 
-    STATUS FileSystem::GetVersion(Version& out_version, std::string& out_error_msg) const
-    {
-        return _working_directory->GetVersion(out_version, out_error_msg);
-    }
+        if (secondary == nullptr)
+        {
+            for (auto const& [id, node] : primary_childs)
+                keep_primary(id, node);
+            return;
+        }
+
+        auto const& secondary_childs = secondary->GetChilds(secondary_version);
+        auto const add_secondary = [&](FileID id, const std::string& name) {
+            auto const node = secondary_childs.find(id)->second;
+            if (is_changed_directory(id))
+                merge_directory(MergePlan::NO_FILE, id, node, secondary_version, nullptr, 0);
+            else
+                plan.edits.push_back(MergePlan::Edit{EditType::INSERT, MergePlan::NO_FILE, name, id, node, nullptr, nullptr, {}});
+        };
+
+        // Merge both directories visiting their children sorted by name, as in the merge step of mergesort
+        auto primary_it = primary_childs.ByName().begin();
+        auto secondary_it = secondary_childs.ByName().begin();
+        auto const primary_end = primary_childs.ByName().end();
+        auto const secondary_end = secondary_childs.ByName().end();
+        while (primary_it != primary_end || secondary_it != secondary_end)
+        {
+            if (secondary_it == secondary_end || (primary_it != primary_end && primary_it->first < secondary_it->first))
+            {
+                keep_primary(primary_it->second, primary_childs.find(primary_it->second)->second);
+                ++primary_it;
+                continue;
+            }
+
+            if (primary_it == primary_end || secondary_it->first < primary_it->first)
+            {
+                add_secondary(secondary_it->second, secondary_it->first);
+                ++secondary_it;
+                continue;
+            }
+
+            // Same name in both versions
+            auto const& name = primary_it->first;
+            auto const primary_id = primary_it->second, secondary_id = secondary_it->second;
+            auto const primary_node = primary_childs.find(primary_id)->second;
+            auto const secondary_node = secondary_childs.find(secondary_id)->second;
+            ++primary_it;
+            ++secondary_it;
+
+            auto const& primary_file = _files[primary_id];
+            auto const& secondary_file = _files[secondary_id];
+            if (primary_file.GetFileType() != secondary_file.GetFileType())
+            {
+                // Can't have both, first version wins
+                context.conflicts++;
+                keep_primary(primary_id, primary_node);
+            }
+            else if (primary_id == secondary_id && (primary_node == secondary_node || primary_file.GetFileType() == FileType::DOCUMENT) && !is_changed_directory(primary_id))
+            {
+                // Same subtree in both versions, it's reused as it is
+                context.shared_subtrees++;
+            }
+            else if (primary_file.GetFileType() == FileType::DIRECTORY)
+            {
+                context.merged_directories++;
+                merge_directory(primary_id, primary_id, primary_node, primary_version, secondary_node, secondary_version);
+            }
+            else
+            {
+                // Documents with different versions, compare contents and mark differences in a task of its own
+                auto& edit = plan.edits.emplace_back(MergePlan::Edit{EditType::NONE, primary_id, name, primary_id, nullptr, nullptr, primary_file.GetContentRef(), {}});
+                context.pool.Submit([&edit, &context, &primary_file, &secondary_file]() {
+                    auto const primary_blob = primary_file.GetBlob();
+                    auto const secondary_blob = secondary_file.GetBlob();
+                    if (primary_blob->GetData() == secondary_blob->GetData())
+                    {
+                        context.shared_subtrees++;
+                        return;
+                    }
+
+                    context.conflicts++;
+                    DIFF diff(std::string(primary_blob->GetData()), std::string(secondary_blob->GetData()), MYERS, LINES);
+                    edit.content = diff.compute_diff();
+                    edit.type = EditType::CONFLICT;
+                });
+            }
+        }
+    }
+
+    FileTree* CELV::BuildMerge(const MergePlan& plan, FileTree* parent, Version version)
+    {
+        using EditType = MergePlan::EditType;
+        auto const node = NewNode(plan.id, parent, version);
+        ChildMap childs(plan.base->GetChilds(plan.base_version));
+
+        for (auto const& edit : plan.edits)
+        {
+            if (edit.type == EditType::NONE)
+                continue;
+
+            if (edit.replaced != MergePlan::NO_FILE)
+                childs.Erase(edit.replaced, _files[edit.replaced].GetName());
+
+            switch (edit.type)
+            {
+            case EditType::INSERT:
+                childs.Insert(edit.id, edit.name, edit.node);
+                break;
+            case EditType::DIRECTORY:
+                childs.Insert(edit.directory->id, edit.name, BuildMerge(*edit.directory, node, version));
+                break;
+            case EditType::CONFLICT:
+            {
+                auto const new_file_id = _files.size();
+                _files.emplace_back(edit.name, new_file_id, StoreContent(edit.previous, edit.content));
+                childs.Insert(new_file_id, edit.name, NewNode(new_file_id, node, version));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        node->SetNewChilds(childs);
+        return node;
+    }
+
+    /// @brief State shared by every task of a diff
+    struct CELV::DiffContext
+    {
+        ThreadPool& pool;
+        std::unordered_set<FileID> changed; // Directories where a change box was filled between both versions
+        Version version1;
+        Version version2;
+        std::mutex mutex; // Protects changes
+        std::vector<VersionChange> changes;
+    };
+
+    STATUS CELV::Diff(Version version1, Version version2, std::vector<VersionChange>& out_changes, std::string& out_error_msg)
+    {
+        if (version1 >= _next_available_version || version2 >= _next_available_version)
+        {
+            out_error_msg = "Invalid version";
+            return ERROR;
+        }
+
+        ThreadPool pool;
+        DiffContext context{pool, {}, version1, version2, {}, {}};
+        CollectChangedDirectories(std::min(version1, version2), std::max(version1, version2), context.changed);
+
+        auto const root1 = GetVersionRoot(version1), root2 = GetVersionRoot(version2);
+        if (root1 != root2 || context.changed.count(root1->GetFileID()) > 0)
+        {
+            pool.Submit([&]() { DiffDirectory(root1, root2, "", context); });
+            pool.Wait();
+        }
+
+        // Every directory adds its changes at once, so changes with the same path keep their relative order
+        std::stable_sort(context.changes.begin(), context.changes.end(), 
+            [](const VersionChange& a, const VersionChange& b) { return a.path < b.path; });
+        out_changes = std::move(context.changes);
+        return SUCCESS;
+    }
+
+    void CELV::DiffDirectory(const FileTree* node1, const FileTree* node2, const std::string& path, DiffContext& context) const
+    {
+        auto const& childs1 = node1->GetChilds(context.version1);
+        auto const& childs2 = node2->GetChilds(context.version2);
+        std::vector<VersionChange> changes;
+
+        auto const report = [&](ChangeType type, FileID id) {
+            changes.push_back(VersionChange{type, _files[id].GetFileType(), path + "/" + _files[id].GetName()});
+        };
+
+        // Visit children of both directories sorted by name, as in the merge step of mergesort
+        auto it1 = childs1.ByName().begin();
+        auto it2 = childs2.ByName().begin();
+        auto const end1 = childs1.ByName().end();
+        auto const end2 = childs2.ByName().end();
+        while (it1 != end1 || it2 != end2)
+        {
+            if (it2 == end2 || (it1 != end1 && it1->first < it2->first))
+            {
+                report(ChangeType::REMOVED, it1->second);
+                ++it1;
+                continue;
+            }
+
+            if (it1 == end1 || it2->first < it1->first)
+            {
+                report(ChangeType::ADDED, it2->second);
+                ++it2;
+                continue;
+            }
+
+            // Same name in both versions
+            auto const id1 = it1->second, id2 = it2->second;
+            auto const child1 = childs1.find(id1)->second;
+            auto const child2 = childs2.find(id2)->second;
+            ++it1;
+            ++it2;
+
+            auto const& file1 = _files[id1];
+            auto const& file2 = _files[id2];
+            if (file1.GetFileType() != file2.GetFileType())
+            {
+                report(ChangeType::REMOVED, id1);
+                report(ChangeType::ADDED, id2);
+            }
+            else if (file1.GetFileType() == FileType::DOCUMENT)
+            {
+                // Every write creates a new document. Blobs are interned, so the same content ref means the same
+                // bytes, but ropes, deltas and lazy contents aren't, so different refs are compared byte by byte in a
+                // task of its own
+                if (id1 == id2 || file1.GetContentRef() == file2.GetContentRef())
+                    continue;
+
+                if (file1.GetSize() != file2.GetSize())
+                    report(ChangeType::MODIFIED, id2);
+                else
+                {
+                    auto change = VersionChange{ChangeType::MODIFIED, FileType::DOCUMENT, path + "/" + file2.GetName()};
+                    context.pool.Submit([&file1, &file2, change = std::move(change), &context]() mutable {
+                        if (file1.GetBlob()->GetData() == file2.GetBlob()->GetData())
+                            return;
+
+                        std::lock_guard<std::mutex> lock(context.mutex);
+                        context.changes.push_back(std::move(change));
+                    });
+                }
+            }
+            else if (child1 != child2 || context.changed.count(id1) > 0)
+            {
+                auto child_path = path + "/" + file1.GetName();
+                context.pool.Submit([this, child1, child2, child_path = std::move(child_path), &context]() {
+                    DiffDirectory(child1, child2, child_path, context);
+                });
+            }
+        }
+
+        if (changes.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(context.mutex);
+        context.changes.insert(context.changes.end(), std::make_move_iterator(changes.begin()), std::make_move_iterator(changes.end()));
+    }
+
+    FileTree* CELV::NewNode(FileID id, FileTree* parent, Version version)
+    {
+        auto const node = _arena.New<FileTree>(id, parent, version, this);
+        node->_snapshot_index = _snapshot_node_count + _nodes.size();
+        _nodes.push_back(node);
+        return node;
+    }
+
+    PersistenceStats CELV::GetPersistenceStats() const
+    {
+        PersistenceStats stats{_persistence_mode, _nodes.size() + _snapshot_nodes.size(), 0, _arena.GetBytesInUse()};
+        stats.modifications = (_snapshot_change_boxes_loaded ? 0 : _snapshot_change_box_count) + _change_boxes.size();
+        return stats;
+    }
+
+    void CELV::Destroy()
+    {
+        // Nodes reference each other and are shared between versions, so they're all released at once 
+        auto const delete_node = [this](FileTree* node) {
+            if (node->_log != nullptr)
+                _arena.Delete(node->_log);
+            _arena.Delete(node);
+        };
+        for (auto node : _nodes)
+            delete_node(node);
+        for (auto const& [index, node] : _snapshot_nodes)
+            delete_node(node);
+        _nodes.clear();
+        _change_boxes.clear();
+        _versions.clear();
+        _files.clear();
+        _history.clear();
+        _working_dir = nullptr;
+        _parent_file = nullptr;
+        _snapshot_layers.clear();
+        _snapshot_node_count = 0;
+        _snapshot_versions = 0;
+        _snapshot_actions = 0;
+        _snapshot_change_box_count = 0;
+        _snapshot_nodes.clear();
+        _snapshot_patches.clear();
+        _snapshot_history_loaded = true;
+        _snapshot_change_boxes_loaded = true;
+        _checkpoint_celv = SNAPSHOT_NONE;
+        _checkpoint_sizes = CelvOrigin{};
+    }
+
+    FileTree* CELV::GetVersionRoot(Version version)
+    {
+        if (version >= _snapshot_versions)
+            return _versions[version - _snapshot_versions];
+
+        auto layer = _snapshot_layers.rbegin();
+        while (layer->record.origin.version > version)
+            ++layer;
+
+        auto const& record = layer->record;
+        return NodeFromSnapshot(layer->snapshot->Array<uint64_t>(record.versions)[version - record.origin.version]);
+    }
+
+    CELV* CELV::FromSnapshot(std::vector<SnapshotLayer> layers, FileTree* parent_file)
+    {
+        assert(!layers.empty() && "Missing layers of celv");
+        auto celv = new CELV();
+        celv->Destroy(); // Discard initial version, every version comes from the snapshot
+
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            auto const& [snapshot, record] = layers[i];
+            celv->_files.AddSnapshotFiles(snapshot, record.files);
+
+            auto const patches = snapshot->Array<NodePatchRecord>(record.node_patches);
+            for (size_t j = 0; j < record.node_patches.count; j++)
+                celv->_snapshot_patches[patches[j].node] = patches[j].change_box;
+        }
+
+        auto const& record = layers.back().record;
+        celv->_snapshot_node_count = record.origin.node + record.nodes.count;
+        celv->_snapshot_versions = record.origin.version + record.versions.count;
+        celv->_snapshot_actions = record.origin.action + record.history.count;
+        celv->_snapshot_change_box_count = record.origin.change_box + record.change_boxes.count;
+        celv->_snapshot_history_loaded = celv->_snapshot_actions == 0;
+        celv->_snapshot_change_boxes_loaded = celv->_snapshot_change_box_count == 0;
+        celv->_current_version = record.current_version;
+        celv->_next_available_version = record.next_available_version;
+        celv->_storage_mode = static_cast<StorageMode>(record.storage_mode);
+        celv->_persistence_mode = static_cast<PersistenceMode>(record.persistence_mode);
+        celv->_parent_file = parent_file;
+        celv->_snapshot_layers = std::move(layers);
+        celv->_working_dir = celv->NodeFromSnapshot(record.working_dir);
+        celv->_working_path = celv->PathOf(celv->_working_dir);
+        celv->_ancestors_loaded = false;
+        return celv;
+    }
+
+    const SnapshotLayer& CELV::LayerOfNode(uint64_t index) const
+    {
+        assert(index < _snapshot_node_count && "Node out of snapshot");
+
+        // Segments are few, newest nodes are usually the most requested
+        auto layer = _snapshot_layers.rbegin();
+        while (layer->record.origin.node > index)
+            ++layer;
+        return *layer;
+    }
+
+    const NodeRecord& CELV::NodeRecordOf(uint64_t index) const
+    {
+        auto const& layer = LayerOfNode(index);
+        return layer.snapshot->Array<NodeRecord>(layer.record.nodes)[index - layer.record.origin.node];
+    }
+
+    FileTree* CELV::NodeFromSnapshot(uint64_t index)
+    {
+        if (index == SNAPSHOT_NONE)
+            return nullptr;
+
+        std::lock_guard<std::recursive_mutex> lock(_snapshot_mutex);
+        auto const loaded = _snapshot_nodes.find(index);
+        if (loaded != _snapshot_nodes.end())
+            return loaded->second;
+
+        auto const& record = NodeRecordOf(index);
+        auto const node = _arena.New<FileTree>(record.file_id, nullptr, record.version, this);
+        node->_snapshot_index = index;
+        node->_childs_pending = true;
+        _snapshot_nodes.emplace(index, node);
+
+        // Parents and change boxes are needed to navigate and update the tree, so they're created right away.
+        // There's at most one of each per node, and both are shared by many nodes. A change box might be filled 
+        // in a later segment than the one storing its node
+        auto const patch = _snapshot_patches.find(index);
+        node->_parent = NodeFromSnapshot(record.parent);
+        node->_change_box = NodeFromSnapshot(patch == _snapshot_patches.end() ? record.change_box : patch->second);
+        return node;
+    }
+
+    void CELV::LoadChilds(const FileTree* node)
+    {
+        std::lock_guard<std::recursive_mutex> lock(_snapshot_mutex);
+        if (!node->_childs_pending.load(std::memory_order_relaxed))
+            return; // Loaded by another thread while waiting
+
+        // Childs are stored as edits to the childs of a base node, so both share most of their map
+        auto const& layer = LayerOfNode(node->_snapshot_index);
+        auto const& record = layer.snapshot->Array<NodeRecord>(layer.record.nodes)[node->_snapshot_index - layer.record.origin.node];
+        ChildMap childs;
+        if (record.base != SNAPSHOT_NONE)
+            childs = NodeFromSnapshot(record.base)->LoadedChilds();
+
+        auto const child_records = layer.snapshot->Array<ChildRecord>(record.childs);
+        for (size_t i = 0; i < record.childs.count; i++)
+        {
+            auto const& child = child_records[i];
+            auto const& name = _files[child.file_id].GetName();
+            if (child.node == SNAPSHOT_NONE)
+                childs.Erase(child.file_id, name);
+            else
+                childs.Insert(child.file_id, name, NodeFromSnapshot(child.node));
+        }
+
+        // Loading childs doesn't change what the node represents, it only happens once
+        auto const loaded_node = const_cast<FileTree*>(node);
+        loaded_node->_contained_files = childs;
+        loaded_node->_childs_pending.store(false, std::memory_order_release);
+    }
+
+    void CELV::LoadSnapshotHistory()
+    {
+        if (_snapshot_history_loaded)
+            return;
+
+        std::vector<Action> history;
+        history.reserve(_snapshot_actions + _history.size());
+        for (auto const& [snapshot, celv_record] : _snapshot_layers)
+        {
+            auto const records = snapshot->Array<ActionRecord>(celv_record.history);
+            for (size_t i = 0; i < celv_record.history.count; i++)
+            {
+                auto const& record = records[i];
+                auto const args = snapshot->Array<SnapshotRange>(record.args);
+                ActionArgs action_args;
+                for (size_t j = 0; j < record.args.count; j++)
+                    action_args.emplace_back(snapshot->Bytes(args[j]));
+
+                history.push_back(Action{static_cast<ActionType>(record.type), std::move(action_args), record.origin_version, record.new_version});
+            }
+        }
+
+        // Actions taken after loading the snapshot go after the ones in it
+        history.insert(history.end(), std::make_move_iterator(_history.begin()), std::make_move_iterator(_history.end()));
+        _history = std::move(history);
+        _snapshot_history_loaded = true;
+    }
+
+    void CELV::LoadSnapshotChangeBoxes()
+    {
+        if (_snapshot_change_boxes_loaded)
+            return;
+
+        std::vector<std::pair<Version, FileTree*>> change_boxes;
+        change_boxes.reserve(_snapshot_change_box_count + _change_boxes.size());
+        for (auto const& [snapshot, record] : _snapshot_layers)
+        {
+            auto const records = snapshot->Array<ChangeBoxRecord>(record.change_boxes);
+            for (size_t i = 0; i < record.change_boxes.count; i++)
+                change_boxes.emplace_back(records[i].version, NodeFromSnapshot(records[i].node));
+        }
+
+        change_boxes.insert(change_boxes.end(), _change_boxes.begin(), _change_boxes.end());
+        _change_boxes = std::move(change_boxes);
+        _snapshot_change_boxes_loaded = true;
+    }
+
+    CelvOrigin CELV::GetTableSizes() const
+    {
+        CelvOrigin sizes{};
+        sizes.node = _snapshot_node_count + _nodes.size();
+        sizes.file = _files.size();
+        sizes.version = _next_available_version;
+        sizes.action = (_snapshot_history_loaded ? 0 : _snapshot_actions) + _history.size();
+        sizes.change_box = (_snapshot_change_boxes_loaded ? 0 : _snapshot_change_box_count) + _change_boxes.size();
+        return sizes;
+    }
+
+    CelvRecord CELV::WriteSnapshot(SnapshotWriter& writer, uint64_t parent_file, bool incremental)
+    {
+        // Nodes, files, versions, actions and change boxes are only added, never changed, except for change boxes 
+        // filled in existing nodes. So an incremental write stores the end of every table, and those change boxes
+        incremental = incremental && _checkpoint_celv != SNAPSHOT_NONE;
+        if (!incremental)
+        {
+            LoadSnapshotHistory();
+            LoadSnapshotChangeBoxes();
+        }
+
+        CelvRecord record{};
+        record.origin = incremental ? _checkpoint_sizes : CelvOrigin{};
+        record.previous = incremental ? _checkpoint_celv : SNAPSHOT_NONE;
+        auto const& origin = record.origin;
+        auto const sizes = GetTableSizes();
+        assert(origin.node >= (incremental ? _snapshot_node_count : 0) && "Checkpoint is older than loaded snapshot");
+
+        auto const index_of = [](const FileTree* node) { return node == nullptr ? SNAPSHOT_NONE : node->_snapshot_index; };
+
+        record.files = WriteFiles(writer, _files, origin.file);
+
+        // Most nodes are a copy of a previous node of the same file with a few changes, so their childs are stored
+        // as edits to the childs of that node. Chains of edits are bounded, so loading a node loads few others.
+        // Only nodes in this write are used as base, so writing never loads nodes of a previous segment
+        static constexpr size_t MAX_CHAIN_LENGTH = 16;
+        std::vector<NodeRecord> node_records;
+        node_records.reserve(sizes.node - origin.node);
+        std::vector<FileTree*> nodes;
+        nodes.reserve(sizes.node - origin.node);
+        std::vector<size_t> chain_lengths;
+        chain_lengths.reserve(sizes.node - origin.node);
+        std::unordered_map<FileID, uint64_t> last_node_of_file; // Position in this write
+        std::vector<ChildRecord> child_records;
+        for (uint64_t index = origin.node; index < sizes.node; index++)
+        {
+            auto const node = NodeByIndex(index);
+            nodes.push_back(node);
+            auto const& childs = node->LoadedChilds();
+            NodeRecord node_record{node->_file_id, node->_version, index_of(node->_parent), index_of(node->_change_box), SNAPSHOT_NONE, {}, SNAPSHOT_NONE};
+            size_t chain_length = 0;
+
+            child_records.clear();
+            auto const base = last_node_of_file.find(node->_file_id);
+            if (base != last_node_of_file.end() && chain_lengths[base->second] < MAX_CHAIN_LENGTH)
+            {
+                // Both maps are sorted by id, so they're compared in a single pass
+                auto const& base_childs = nodes[base->second]->LoadedChilds();
+                auto base_it = base_childs.begin();
+                auto it = childs.begin();
+                while ((base_it != base_childs.end() || it != childs.end()) && child_records.size() < childs.size())
+                {
+                    if (it == childs.end() || (base_it != base_childs.end() && base_it->first < it->first))
+                    {
+                        child_records.push_back(ChildRecord{base_it->first, SNAPSHOT_NONE});
+                        ++base_it;
+                    }
+                    else if (base_it == base_childs.end() || it->first < base_it->first)
+                    {
+                        child_records.push_back(ChildRecord{it->first, index_of(it->second)});
+                        ++it;
+                    }
+                    else
+                    {
+                        if (base_it->second != it->second)
+                            child_records.push_back(ChildRecord{it->first, index_of(it->second)});
+                        ++base_it;
+                        ++it;
+                    }
+                }
+
+                // Edits are only worth it if there are less than childs
+                auto const finished = base_it == base_childs.end() && it == childs.end();
+                if (finished && child_records.size() < childs.size())
+                {
+                    node_record.base = origin.node + base->second;
+                    chain_length = chain_lengths[base->second] + 1;
+                }
+                else
+                    child_records.clear();
+            }
+
+            if (node_record.base == SNAPSHOT_NONE)
+                for (auto const& [id, child] : childs)
+                    child_records.push_back(ChildRecord{id, index_of(child)});
+
+            node_record.childs = writer.WriteArray(child_records);
+            node_records.push_back(node_record);
+            chain_lengths.push_back(chain_length);
+            last_node_of_file[node->_file_id] = nodes.size() - 1;
+        }
+        record.nodes = writer.WriteArray(node_records);
+
+        std::vector<uint64_t> versions;
+        versions.reserve(sizes.version - origin.version);
+        for (Version version = origin.version; version < sizes.version; version++)
+            versions.push_back(index_of(GetVersionRoot(version)));
+        record.versions = writer.WriteArray(versions);
+
+        // Actions and change boxes of the snapshot are only in memory once decoded
+        auto const first_action = _snapshot_history_loaded ? 0 : _snapshot_actions;
+        std::vector<ActionRecord> action_records;
+        action_records.reserve(sizes.action - origin.action);
+        std::vector<SnapshotRange> args;
+        for (uint64_t i = origin.action; i < sizes.action; i++)
+        {
+            auto const& action = _history[i - first_action];
+            args.clear();
+            for (auto const& arg : action.args)
+                args.push_back(writer.WriteBytes(arg));
+
+            action_records.push_back(ActionRecord{static_cast<uint64_t>(action.type), action.origin_version, action.new_version, writer.WriteArray(args)});
+        }
+        record.history = writer.WriteArray(action_records);
+
+        auto const first_change_box = _snapshot_change_boxes_loaded ? 0 : _snapshot_change_box_count;
+        std::vector<ChangeBoxRecord> change_box_records;
+        change_box_records.reserve(sizes.change_box - origin.change_box);
+        std::vector<NodePatchRecord> patches;
+        for (uint64_t i = origin.change_box; i < sizes.change_box; i++)
+        {
+            auto const& [version, node] = _change_boxes[i - first_change_box];
+            change_box_records.push_back(ChangeBoxRecord{version, index_of(node)});
+
+            // Nodes of previous segments are not written again, only their new change box
+            if (node->_snapshot_index < origin.node)
+                patches.push_back(NodePatchRecord{node->_snapshot_index, index_of(node->_change_box)});
+        }
+        record.change_boxes = writer.WriteArray(change_box_records);
+        record.node_patches = writer.WriteArray(patches);
+
+        record.current_version = _current_version;
+        record.next_available_version = _next_available_version;
+        record.storage_mode = static_cast<uint64_t>(_storage_mode);
+        record.persistence_mode = static_cast<uint64_t>(_persistence_mode);
+        record.working_dir = index_of(_working_dir);
+        record.parent_file = parent_file;
+        return record;
+    }
+
+    FileSystem::FileSystem()
+        : _unsaved_changes(false)
+        , _background_save(-1)
+        , _background_save_errors(-1)
+        , _finished_background_save()
+    {
+        _file_tree = FileTree::MakeRootFileTree();
+        _working_directory = _file_tree;
+    }
+
+    void FileSystem::List(const ListOptions& options, const ListCallback& callback) const
+    {
+        _working_directory->List(options, callback);
+    }
+
+    const std::string& FileSystem::GetCurrentWorkingDirectory() const
+    {
+        return _working_directory->GetFileData().GetName();
+    }
+
+    STATUS FileSystem::ChangeDirectory(const std::string& directory_name, std::string& out_error_msg)
+    {
+        FileTree* new_cwd;
+        auto status = _working_directory->ChangeDirectory(directory_name, new_cwd, out_error_msg);
+        if (status == ERROR)
+            return status;
+
+        _working_directory = new_cwd;
+        Log({JournalOp::CHANGE_DIRECTORY, {}, {directory_name}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::ChangeDirectory(std::string& out_error_msg)
+    {
+        FileTree* new_cwd;
+        auto status = _working_directory->ChangeDirectory(new_cwd, out_error_msg);
+        if (status == ERROR)
+            return status;
+
+        _working_directory = new_cwd;
+        Log({JournalOp::CHANGE_TO_PARENT, {}, {}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::CreateFile(const std::string& filename, FileType type, std::string& out_error_msg)
+    {
+        if (_working_directory->CreateFile(filename, type, out_error_msg, _working_directory) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::CREATE_FILE, {static_cast<uint64_t>(type)}, {filename}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::RemoveFile(const std::string& filename, std::string& out_error_msg)
+    {
+        if (_working_directory->RemoveFile(filename, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::REMOVE_FILE, {}, {filename}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::ReadFile(const std::string& filename, BlobRef& out_content, std::string& out_error_msg) const
+    {
+        return _working_directory->ReadFile(filename, out_content, out_error_msg);
+    }
+
+    STATUS FileSystem::WriteFile(const std::string& filename,const std::string& content, std::string& out_error_msg)
+    {
+        if (_working_directory->WriteFile(filename, content, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::WRITE_FILE, {}, {filename, content}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::AppendFile(const std::string& filename, std::string_view content, std::string& out_error_msg)
+    {
+        if (_working_directory->AppendFile(filename, content, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::APPEND_FILE, {}, {filename, content}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::WriteFileRange(const std::string& filename, size_t offset, std::string_view content, std::string& out_error_msg)
+    {
+        if (_working_directory->WriteFileRange(filename, offset, content, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::WRITE_FILE_RANGE, {offset}, {filename, content}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::SetVersion(Version version, std::string& out_error_msg)
+    {
+        if (_working_directory->SetVersion(version, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::SET_VERSION, {version}, {}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::GetVersion(Version& out_version, std::string& out_error_msg) const
+    {
+        return _working_directory->GetVersion(out_version, out_error_msg);
+    }
+
+    STATUS FileSystem::SetStorageMode(StorageMode mode, std::string& out_error_msg)
+    {
+        if (_working_directory->SetStorageMode(mode, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::SET_STORAGE_MODE, {static_cast<uint64_t>(mode)}, {}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::SetPersistenceMode(PersistenceMode mode, std::string& out_error_msg)
+    {
+        if (_working_directory->SetPersistenceMode(mode, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::SET_PERSISTENCE_MODE, {static_cast<uint64_t>(mode)}, {}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::GetPersistenceStats(PersistenceStats& out_stats, std::string& out_error_msg) const
+    {
+        return _working_directory->GetPersistenceStats(out_stats, out_error_msg);
+    }
+
+    STATUS FileSystem::GetHistory(std::vector<Action>& out_history, std::string& error_msg)
+    {
+        return _working_directory->GetHistory(out_history, error_msg);
+    }
+    STATUS FileSystem::Merge(Version version1, Version version2, MergeStats& out_stats, std::string& out_error_msg)
+    {
+        if (_working_directory->Merge(version1, version2, out_stats, out_error_msg) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::MERGE, {version1, version2}, {}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::Diff(Version version1, Version version2, std::vector<VersionChange>& out_changes, std::string& out_error_msg)
+    {
+        return _working_directory->Diff(version1, version2, out_changes, out_error_msg);
+    }
+
+    STATUS FileSystem::InitCELV(std::string& out_error_msg)
+    {
+        if (_working_directory->InitCELV(out_error_msg, _working_directory) == ERROR)
+            return ERROR;
+
+        Log({JournalOp::INIT_CELV, {}, {}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::Import(const std::string& filepath, std::string& out_error_msg, ImportStats& out_stats, const ImportOptions& options)
+    {
+        if (_working_directory->ImportLocalPath(filepath, out_error_msg, _working_directory, out_stats, options) == ERROR)
+            return ERROR;
+
+        // Documents are not stored in the journal, they're imported again from local storage when recovering
+        Log({JournalOp::IMPORT, {options.lazy}, {filepath}});
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::Save(const std::string& path, std::string& out_error_msg)
+    {
+        std::vector<CELV*> celvs;
+        std::vector<CelvRecord> celv_records;
+        if (WriteSegment(path, false, celvs, celv_records, out_error_msg) == ERROR)
+            return ERROR;
+
+        return SetSnapshotPath(path, out_error_msg);
+    }
+
+    STATUS FileSystem::SaveInBackground(const std::string& path, double& out_pause_seconds, std::string& out_error_msg)
+    {
+        if (_background_save != -1)
+        {
+            out_error_msg = "A snapshot is already being saved to '" + _background_save_path + "'";
+            return ERROR;
+        }
+
+        int errors[2];
+        if (::pipe(errors) != 0)
+        {
+            out_error_msg = "Could not start saving in the background";
+            return ERROR;
+        }
+
+        // Only the calling thread exists in the child. Background threads never hold a lock that writing needs: the
+        // journal and checkpoint threads only touch their own state, and thread pools only live during a command
+        auto const start = std::chrono::steady_clock::now();
+        auto const pid = ::fork();
+        if (pid == 0)
+        {
+            ::close(errors[0]);
+            auto const write_start = std::chrono::steady_clock::now();
+            std::string error_msg;
+            std::vector<CELV*> celvs;
+            std::vector<CelvRecord> celv_records;
+            auto const status = WriteSegment(path, false, celvs, celv_records, error_msg);
+
+            // Time its own write, the parent might only find out it finished much later
+            std::chrono::duration<double> const seconds = std::chrono::steady_clock::now() - write_start;
+            auto const write_seconds = seconds.count();
+            std::string message(reinterpret_cast<const char*>(&write_seconds), sizeof(write_seconds));
+            if (status == ERROR)
+                message += error_msg;
+            ::write(errors[1], message.data(), message.size());
+
+            // Skip destructors and exit handlers, they would flush and close the parent's journal
+            ::_exit(status == SUCCESS ? 0 : 1);
+        }
+
+        std::chrono::duration<double> const pause = std::chrono::steady_clock::now() - start;
+        out_pause_seconds = pause.count();
+        ::close(errors[1]);
+        if (pid < 0)
+        {
+            ::close(errors[0]);
+            out_error_msg = "Could not start saving in the background";
+            return ERROR;
+        }
+
+        _background_save = pid;
+        _background_save_errors = errors[0];
+        _background_save_path = path;
+        return SUCCESS;
+    }
+
+    bool FileSystem::TakeBackgroundSaveStats(BackgroundSaveStats& out_stats)
+    {
+        if (!_finished_background_save.has_value())
+        {
+            int status;
+            if (_background_save == -1 || ::waitpid(_background_save, &status, WNOHANG) != _background_save)
+                return false;
+
+            FinishBackgroundSave(status);
+        }
+
+        out_stats = std::move(*_finished_background_save);
+        _finished_background_save.reset();
+        return true;
+    }
+
+    void FileSystem::WaitBackgroundSave()
+    {
+        if (_background_save == -1)
+            return;
+
+        int status;
+        if (::waitpid(_background_save, &status, 0) == _background_save)
+            FinishBackgroundSave(status);
+        else
+        {
+            ::close(_background_save_errors);
+            _finished_background_save = BackgroundSaveStats{_background_save_path, "Could not wait for process saving '" + _background_save_path + "'"};
+        }
+
+        _background_save = -1;
+        _background_save_errors = -1;
+    }
+
+    void FileSystem::FinishBackgroundSave(int status)
+    {
+        BackgroundSaveStats stats;
+        stats.path = _background_save_path;
+
+        std::string message;
+        char buffer[256];
+        ssize_t bytes_read;
+        while ((bytes_read = ::read(_background_save_errors, buffer, sizeof(buffer))) > 0)
+            message.append(buffer, static_cast<size_t>(bytes_read));
+        ::close(_background_save_errors);
+
+        // The child sends the time it spent writing, followed by its error message if any
+        if (message.size() >= sizeof(stats.seconds))
+        {
+            std::memcpy(&stats.seconds, message.data(), sizeof(stats.seconds));
+            stats.error = message.substr(sizeof(stats.seconds));
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            if (stats.error.empty())
+                stats.error = "Process saving '" + _background_save_path + "' ended unexpectedly";
+        }
+        else
+        {
+            std::error_code error;
+            stats.bytes = std::filesystem::file_size(_background_save_path, error);
+        }
+
+        _finished_background_save = std::move(stats);
+        _background_save = -1;
+        _background_save_errors = -1;
+    }
+
+    STATUS FileSystem::Checkpoint(const std::string& directory, CheckpointStats& out_stats, std::string& out_error_msg)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        std::error_code error;
+        auto const same_store = _checkpoints.IsOpen() && _checkpoints.GetDirectory() == std::filesystem::absolute(directory, error).string();
+        if (!same_store && _checkpoints.Create(directory, out_error_msg) == ERROR)
+            return ERROR;
+
+        // The first checkpoint in a store stores everything, later ones only what was added since the previous one
+        out_stats = CheckpointStats();
+        out_stats.incremental = same_store;
+        out_stats.path = _checkpoints.GetNextSegmentPath();
+        std::vector<CELV*> celvs;
+        std::vector<CelvRecord> celv_records;
+        if (WriteSegment(out_stats.path, out_stats.incremental, celvs, celv_records, out_error_msg) == ERROR)
+            return ERROR;
+
+        for (uint64_t i = 0; i < celvs.size(); i++)
+        {
+            celvs[i]->SetCheckpoint(i, GetTableEnd(celv_records[i]));
+            out_stats.nodes += celv_records[i].nodes.count;
+            out_stats.versions += celv_records[i].versions.count;
+        }
+
+        out_stats.compacting_segments = _checkpoints.Commit(out_stats.incremental);
+        out_stats.bytes = std::filesystem::file_size(out_stats.path, error);
+        std::chrono::duration<double> const seconds = std::chrono::steady_clock::now() - start;
+        out_stats.seconds = seconds.count();
+        return SetSnapshotPath(_checkpoints.GetDirectory(), out_error_msg);
+    }
+
+    STATUS FileSystem::WriteSegment(const std::string& path, bool incremental, std::vector<CELV*>& out_celvs, std::vector<CelvRecord>& out_celv_records, std::string& out_error_msg)
+    {
+        SnapshotWriter writer(path);
+        SnapshotHeader header{};
+        header.incremental = incremental ? 1 : 0;
+        header.files = WriteFiles(writer, FileTree::_files);
+
+        // Nodes not managed by any celv are indexed in preorder, root first
+        std::vector<const FileTree*> nodes;
+        std::unordered_map<const FileTree*, uint64_t> indices;
+        std::vector<const FileTree*> pending = {_file_tree};
+        while (!pending.empty())
+        {
+            auto const node = pending.back();
+            pending.pop_back();
+            indices[node] = nodes.size();
+            nodes.push_back(node);
+            for (auto const& [id, child] : node->_contained_files)
+                pending.push_back(child);
+        }
+
+        std::vector<NodeRecord> node_records;
+        auto& celvs = out_celvs;
+        std::vector<ChildRecord> child_records;
+        for (auto const node : nodes)
+        {
+            child_records.clear();
+            for (auto const& [id, child] : node->_contained_files)
+                child_records.push_back(ChildRecord{id, indices.at(child)});
+
+            auto const parent = indices.find(node->_parent);
+            NodeRecord record{node->_file_id, node->_version, parent == indices.end() ? SNAPSHOT_NONE : parent->second, SNAPSHOT_NONE, SNAPSHOT_NONE, writer.WriteArray(child_records), SNAPSHOT_NONE};
+            if (node->_is_celv_root)
+            {
+                record.celv = celvs.size();
+                celvs.push_back(node->_celv);
+            }
+            node_records.push_back(record);
+        }
+        header.nodes = writer.WriteArray(node_records);
+        header.root = 0;
+        header.working_directory = SnapshotNodeRef{SNAPSHOT_NONE, 0};
+
+        auto& celv_records = out_celv_records;
+        for (uint64_t i = 0; i < celvs.size(); i++)
+        {
+            celv_records.push_back(celvs[i]->WriteSnapshot(writer, indices.at(celvs[i]->GetParentDir()), incremental));
+
+            // Working directory might be a node managed by a celv
+            if (_working_directory->_celv == celvs[i] && _working_directory->_snapshot_index != SNAPSHOT_NONE)
+                header.working_directory = SnapshotNodeRef{i, _working_directory->_snapshot_index};
+        }
+        header.celvs = writer.WriteArray(celv_records);
+
+        auto const working_directory = indices.find(_working_directory);
+        if (working_directory != indices.end())
+            header.working_directory = SnapshotNodeRef{SNAPSHOT_NONE, working_directory->second};
+
+        return writer.Finish(header, out_error_msg);
+    }
+
+    STATUS FileSystem::Load(const std::string& path, std::string& out_error_msg)
+    {
+        // A directory is a checkpoint store, its state is a chain of segments
+        std::error_code error;
+        std::vector<std::shared_ptr<const MappedSnapshot>> chain;
+        auto const is_store = std::filesystem::is_directory(path, error);
+        if (is_store)
+        {
+            if (_checkpoints.Open(path, chain, out_error_msg) == ERROR)
+                return ERROR;
+        }
+        else
+        {
+            auto snapshot = MappedSnapshot::Open(path, out_error_msg);
+            if (snapshot == nullptr)
+                return ERROR;
+
+            if (snapshot->GetHeader().incremental != 0)
+            {
+                out_error_msg = "'" + path + "' is an incremental checkpoint, load the directory storing it instead";
+                return ERROR;
+            }
+            chain.push_back(std::move(snapshot));
+        }
+
+        // Checkpoints after loading a store keep adding to it, any other store starts with a full checkpoint
+        auto const status = LoadSegments(chain, path, out_error_msg);
+        if (status == ERROR || !is_store)
+            _checkpoints.Close();
+
+        if (status == ERROR)
+            return ERROR;
+
+        return SetSnapshotPath(path, out_error_msg);
+    }
+
+    STATUS FileSystem::LoadSegments(const std::vector<std::shared_ptr<const MappedSnapshot>>& chain, const std::string& path, std::string& out_error_msg)
+    {
+        // Nodes not managed by a celv come from the last segment. Check every reference between them before 
+        // replacing anything
+        auto const& snapshot = chain.back();
+        auto const& header = snapshot->GetHeader();
+        auto const node_records = snapshot->Array<NodeRecord>(header.nodes);
+        auto const node_count = header.nodes.count;
+        auto const celv_count = header.celvs.count;
+        auto const celv_records = snapshot->Array<CelvRecord>(header.celvs);
+        auto const& working_directory = header.working_directory;
+        auto is_valid = working_directory.celv == SNAPSHOT_NONE ? working_directory.node < node_count 
+            : working_directory.celv < celv_count && working_directory.node < GetTableEnd(celv_records[working_directory.celv]).node;
+        for (size_t i = 0; i < node_count && is_valid; i++)
+        {
+            auto const& record = node_records[i];
+            is_valid = (record.parent == SNAPSHOT_NONE || record.parent < node_count) && (record.celv == SNAPSHOT_NONE || record.celv < celv_count)
+                && snapshot->Contains(record.childs, sizeof(ChildRecord));
+            auto const childs = snapshot->Array<ChildRecord>(is_valid ? record.childs : SnapshotRange{0, 0});
+            for (size_t j = 0; j < record.childs.count && is_valid; j++)
+                is_valid = childs[j].node < node_count && childs[j].file_id < header.files.count;
+        }
+
+        if (!is_valid)
+        {
+            out_error_msg = "'" + path + "' is not a valid snapshot";
+            return ERROR;
+        }
+
+        Destroy();
+        FileTree::_files.clear();
+        FileTree::_files.AddSnapshotFiles(snapshot, header.files);
+
+        std::vector<FileTree*> nodes;
+        nodes.reserve(node_count);
+        for (size_t i = 0; i < node_count; i++)
+            nodes.push_back(FileTree::MakeNode(node_records[i].file_id, nullptr, node_records[i].version, nullptr));
+
+        for (size_t i = 0; i < node_count; i++)
+        {
+            auto const& record = node_records[i];
+            auto const node = nodes[i];
+            node->SetParent(record.parent == SNAPSHOT_NONE ? nullptr : nodes[record.parent]);
+            auto const childs = snapshot->Array<ChildRecord>(record.childs);
+            for (size_t j = 0; j < record.childs.count; j++)
+            {
+                // Node of a celv root refers to a file of the celv, so the name comes from the id it's stored with
+                auto const id = childs[j].file_id;
+                node->_contained_files.Insert(id, FileTree::_files[id].GetName(), nodes[childs[j].node]);
+            }
+        }
+
+        // Celvs are created once the node where they were initialized exists. A celv is stored across every 
+        // segment since the one where it first appears
+        std::vector<CELV*> celvs;
+        for (size_t i = 0; i < celv_count; i++)
+        {
+            std::vector<SnapshotLayer> layers;
+            auto segment = chain.size() - 1;
+            auto record = &celv_records[i];
+            while (true)
+            {
+                layers.push_back(SnapshotLayer{chain[segment], *record});
+                if (record->previous == SNAPSHOT_NONE)
+                    break;
+
+                segment--;
+                record = &chain[segment]->Array<CelvRecord>(chain[segment]->GetHeader().celvs)[record->previous];
+            }
+            std::reverse(layers.begin(), layers.end());
+
+            auto const celv = CELV::FromSnapshot(std::move(layers), nodes[celv_records[i].parent_file]);
+            celv->SetCheckpoint(i, GetTableEnd(celv_records[i]));
+            celvs.push_back(celv);
+        }
+
+        for (size_t i = 0; i < node_count; i++)
+        {
+            if (node_records[i].celv == SNAPSHOT_NONE)
+                continue;
+
+            nodes[i]->_celv = celvs[node_records[i].celv];
+            nodes[i]->_is_celv_root = true;
+        }
+
+        _file_tree = nodes[header.root];
+        if (working_directory.celv == SNAPSHOT_NONE)
+            _working_directory = nodes[working_directory.node];
+        else
+            _working_directory = celvs[working_directory.celv]->NodeFromSnapshot(working_directory.node);
+
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::SetSnapshotPath(const std::string& path, std::string& out_error_msg)
+    {
+        std::error_code error;
+        _snapshot_path = std::filesystem::absolute(path, error).string();
+        _unsaved_changes = false;
+        if (!_journal.IsOpen())
+            return SUCCESS;
+
+        // Operations so far are stored in the snapshot, the journal starts again from it
+        auto const journal_path = _journal.GetPath();
+        auto const options = _journal.GetOptions();
+        if (_journal.Create(journal_path, _snapshot_path, options, out_error_msg) == ERROR)
+        {
+            out_error_msg += ", operations from now on won't be recovered";
+            return ERROR;
+        }
+
+        return SUCCESS;
+    }
+
+    STATUS FileSystem::OpenJournal(const std::string& path, const JournalOptions& options, JournalReplayStats& out_stats, std::string& out_error_msg)
+    {
+        _journal.Close();
+        out_stats = JournalReplayStats();
+        if (!std::filesystem::exists(path))
+        {
+            if (_unsaved_changes)
+            {
+                out_error_msg = "Session has changes not stored in any snapshot, save it with `guardar` before starting a journal";
+                return ERROR;
+            }
+
+            return _journal.Create(path, _snapshot_path, options, out_error_msg);
+        }
+
+        JournalReader reader;
+        if (reader.Open(path, out_error_msg) == ERROR)
+            return ERROR;
+
+        // Recover session: restore the snapshot the journal starts from, and apply its operations again
+        auto const start = std::chrono::steady_clock::now();
+        if (reader.GetBase().empty())
+            Reset();
+        else if (Load(reader.GetBase(), out_error_msg) == ERROR)
+            return ERROR;
+
+        JournalRecord record;
+        std::string error_msg;
+        while (reader.Next(record))
+        {
+            if (Apply(record, error_msg) == SUCCESS)
+            {
+                out_stats.applied++;
+                continue;
+            }
+
+            out_stats.failed++;
+            std::cerr << YELLOW << "Could not recover operation " << out_stats.applied + out_stats.failed << ": " << error_msg << RESET << std::endl;
+        }
+
+        std::chrono::duration<double> const seconds = std::chrono::steady_clock::now() - start;
+        out_stats.seconds = seconds.count();
+        out_stats.discarded_bytes = reader.GetDiscardedBytes();
+        _unsaved_changes = out_stats.applied > 0;
+        return _journal.Resume(path, reader.GetValidSize(), options, out_error_msg);
+    }
+
+    void FileSystem::Log(const JournalRecord& record)
+    {
+        _unsaved_changes = true;
+        _journal.Append(record);
+    }
+
+    STATUS FileSystem::Apply(const JournalRecord& record, std::string& out_error_msg)
+    {
+        auto const& numbers = record.numbers;
+        auto const& strings = record.strings;
+        auto const has_arguments = [&](size_t number_count, size_t string_count) {
+            if (numbers.size() == number_count && strings.size() == string_count)
+                return true;
+
+            out_error_msg = "Invalid arguments for journal operation " + std::to_string(static_cast<uint32_t>(record.op));
+            return false;
+        };
+
+        MergeStats merge_stats;
+        ImportStats import_stats;
+        ImportOptions import_options;
+        switch (record.op)
+        {
+        case JournalOp::CREATE_FILE:
+            if (!has_arguments(1, 1))
+                return ERROR;
+            return CreateFile(std::string(strings[0]), static_cast<FileType>(numbers[0]), out_error_msg);
+        case JournalOp::REMOVE_FILE:
+            if (!has_arguments(0, 1))
+                return ERROR;
+            return RemoveFile(std::string(strings[0]), out_error_msg);
+        case JournalOp::WRITE_FILE:
+            if (!has_arguments(0, 2))
+                return ERROR;
+            return WriteFile(std::string(strings[0]), std::string(strings[1]), out_error_msg);
+        case JournalOp::APPEND_FILE:
+            if (!has_arguments(0, 2))
+                return ERROR;
+            return AppendFile(std::string(strings[0]), strings[1], out_error_msg);
+        case JournalOp::WRITE_FILE_RANGE:
+            if (!has_arguments(1, 2))
+                return ERROR;
+            return WriteFileRange(std::string(strings[0]), numbers[0], strings[1], out_error_msg);
+        case JournalOp::CHANGE_DIRECTORY:
+            if (!has_arguments(0, 1))
+                return ERROR;
+            return ChangeDirectory(std::string(strings[0]), out_error_msg);
+        case JournalOp::CHANGE_TO_PARENT:
+            if (!has_arguments(0, 0))
+                return ERROR;
+            return ChangeDirectory(out_error_msg);
+        case JournalOp::SET_VERSION:
+            if (!has_arguments(1, 0))
+                return ERROR;
+            return SetVersion(numbers[0], out_error_msg);
+        case JournalOp::SET_STORAGE_MODE:
+            if (!has_arguments(1, 0))
+                return ERROR;
+            return SetStorageMode(static_cast<StorageMode>(numbers[0]), out_error_msg);
+        case JournalOp::SET_PERSISTENCE_MODE:
+            if (!has_arguments(1, 0))
+                return ERROR;
+            return SetPersistenceMode(static_cast<PersistenceMode>(numbers[0]), out_error_msg);
+        case JournalOp::MERGE:
+            if (!has_arguments(2, 0))
+                return ERROR;
+            return Merge(numbers[0], numbers[1], merge_stats, out_error_msg);
+        case JournalOp::INIT_CELV:
+            if (!has_arguments(0, 0))
+                return ERROR;
+            return InitCELV(out_error_msg);
+        case JournalOp::IMPORT:
+            if (!has_arguments(1, 1))
+                return ERROR;
+            import_options.lazy = numbers[0] != 0;
+            return Import(std::string(strings[0]), out_error_msg, import_stats, import_options);
+        }
+
+        out_error_msg = "Unknown journal operation " + std::to_string(static_cast<uint32_t>(record.op));
+        return ERROR;
+    }
+
+    void FileSystem::Reset()
+    {
+        Destroy();
+        FileTree::_files.clear();
+        _file_tree = FileTree::MakeRootFileTree();
+        _working_directory = _file_tree;
+        _snapshot_path.clear();
+        _unsaved_changes = false;
+    }
 
-    STATUS FileSystem::GetHistory(std::vector<Action>& out_history, std::string& error_msg)
-    {
-        return _working_directory->GetHistory(out_history, error_msg);
-    }
     void FileSystem::Destroy()
     {
+        WaitBackgroundSave();
         _working_directory = nullptr;
-        _file_tree->Destroy();
+        FileTree::DestroyTree(_file_tree);
         _file_tree = nullptr;
     }
 }
\ No newline at end of file
@@ -2,8 +2,28 @@
 #define FILESYSTEM_HPP
 #include <vector>
 #include <string>
+#include <optional>
 #include <memory>
+#include <string_view>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <sys/types.h>
 #include "Core.hpp"
+#include "NodeArena.hpp"
+#include "PersistentMap.hpp"
+#include "BlobStore.hpp"
+#include "Import.hpp"
+#include "Rope.hpp"
+#include "Snapshot.hpp"
+#include "Journal.hpp"
+#include "Checkpoint.hpp"
+#include "PathCache.hpp"
 #include <map>
 #include <assert.h>
 
@@ -20,6 +40,20 @@ namespace CELV
 
     using FileID = size_t;
     using Version = size_t;
+
+    /// @brief How new versions of documents are stored by a version control system
+    enum class StorageMode
+    {
+        FULL, // Every version is a full copy of the document
+        DELTA // Versions are stored as deltas against the previous version when possible
+    };
+
+    /// @brief How a version control system stores new versions of a node
+    enum class PersistenceMode
+    {
+        CHANGE_BOX, // A node has a single change box, its next modification copies it
+        MODIFICATION_LOG // A node has a bounded log of modifications, it's copied only when the log is full
+    };
     class File
     {
         public:
@@ -28,36 +62,117 @@ namespace CELV
         /// @param name name of file
         /// @param FileId if for this file
         /// @param content content to write into the document
-        File(const std::string& name, FileID id, const std::string& content);
+        File(const std::string& name, FileID id, std::string content);
+
+        /// @brief Create a document sharing an already stored content
+        /// @param name name of file
+        /// @param FileId if for this file
+        /// @param content content of this document
+        File(const std::string& name, FileID id, ContentRef content);
 
         /// @brief Create a folder with the specified name
         /// @param name name of new folder
         /// @param id id for this folder
         File(const std::string& name, FileID id);
 
-        std::string GetName() const { return _name; }
+        /// @brief Create a document whose content is stored in a snapshot. The content is only built when first needed,
+        /// so loading a snapshot doesn't depend on how many contents it has
+        /// @param name name of file
+        /// @param id id for this file
+        /// @param snapshot snapshot storing the content
+        /// @param content_index index of content record in snapshot
+        File(const std::string& name, FileID id, std::shared_ptr<const MappedSnapshot> snapshot, uint64_t content_index);
+
+        const std::string& GetName() const { return _name; }
         FileType GetFileType() const { return _type; }
         FileID GetId() const { return _id; }
 
-        /// @brief Try to get content of this file. Raise an error if type is dir
-        /// @return Content of file as string
-        std::string GetContent() const;
+        /// @brief Get size in bytes of the content of this file, 0 for directories
+        /// @return size of this file
+        size_t GetSize() const { return _type == FileType::DOCUMENT ? GetContentRef()->Size() : 0; }
+
+        /// @brief Get full content of this file as a blob, rebuilding it if necessary. Raise an error if type is dir
+        /// @return blob with content of this file
+        BlobRef GetBlob() const;
+
+        /// @brief Get content of this file as stored. Raise an error if type is dir
+        /// @return stored content of this file
+        const ContentRef& GetContentRef() const;
 
         /// @brief Set content to the specified new content
         /// @param new_content content to add
         void SetContent(const std::string& new_content);
 
+        /// @brief Set content to an already stored content
+        /// @param new_content content to add
+        void SetContent(ContentRef new_content);
+
+        /// @brief Get store where every document content is stored
+        /// @return global store of contents
+        static BlobStore& GetBlobStore() { return _blob_store; }
+
         private:
         std::string _name;
-        std::string _content; // Empty when file type is directory
+        mutable ContentRef _content; // Null when file type is directory, or until first needed if stored in a snapshot
+        std::shared_ptr<const MappedSnapshot> _snapshot; // Snapshot storing content not built yet, if any
+        uint64_t _content_index;
         FileType _type;
         FileID _id;
+        static BlobStore _blob_store;
+        static std::mutex _snapshot_mutex; // Serializes building contents from snapshots
+    };
+
+    /// @brief Files of a tree indexed by id. Files stored in a snapshot are only created the first time they're 
+    /// requested, so loading a snapshot doesn't depend on how many files it stores
+    class FileTable
+    {
+        public:
+        FileTable() : _snapshot_file_count(0) { }
+
+        /// @brief Get a file. Files of a snapshot might be requested from several threads
+        /// @param id id of file, less than `size()`
+        /// @return file with such id
+        const File& operator[](FileID id) const;
+        File& operator[](FileID id) { return const_cast<File&>(static_cast<const FileTable&>(*this)[id]); }
+
+        /// @brief Get amount of files, including files of a snapshot not created yet
+        size_t size() const { return _snapshot_file_count + _files.size(); }
+        bool empty() const { return size() == 0; }
+
+        /// @brief Add a file, its id is the current size
+        template<typename ...Args>
+        File& emplace_back(Args&&... args) { return _files.emplace_back(std::forward<Args>(args)...); }
+        void push_back(File file) { _files.push_back(std::move(file)); }
+
+        /// @brief Add every file stored in a range of a snapshot after files already added, without creating them
+        /// @param snapshot snapshot storing files, already checked when mapped
+        /// @param range range of file records
+        void AddSnapshotFiles(std::shared_ptr<const MappedSnapshot> snapshot, const SnapshotRange& range);
+
+        /// @brief Remove every file
+        void clear();
+
+        private:
+        struct SnapshotFiles
+        {
+            std::shared_ptr<const MappedSnapshot> snapshot;
+            SnapshotRange range;
+            FileID first; // Id of first file in range
+        };
+
+        std::vector<SnapshotFiles> _snapshot_files; // Ranges storing files of a snapshot, in id order
+        FileID _snapshot_file_count; // Files stored in a snapshot, files added later have greater ids
+        std::vector<File> _files; // Files added after loading the snapshot
+        mutable std::unordered_map<FileID, File> _loaded_files; // Files created from the snapshot so far, by id
+        mutable std::mutex _snapshot_mutex; // Protects files created from the snapshot
     };
 
     /// @brief Possible action types performed by the client
     enum class ActionType
     {
         WRITE,
+        APPEND,
+        WRITE_RANGE,
         REMOVE,
         CREATE_DIR,
         CREATE_DOC,
@@ -83,24 +198,193 @@ namespace CELV
 
     class FileTree;
 
+    /// @brief Modifications of a node sorted by version, so the one active in a version is found by binary search.
+    /// Each modification is a node with the file id and childs of the node from its version on
+    struct ModificationLog
+    {
+        static constexpr size_t CAPACITY = 8;
+        FileTree* entries[CAPACITY];
+        size_t size = 0;
+    };
+
+    /// @brief Lightweight description of a file returned by listings. Name refers to memory owned by the file system,
+    /// so it's only valid until the next operation modifying it
+    struct FileEntry
+    {
+        std::string_view name;
+        FileType type;
+        FileID id;
+        size_t size;
+    };
+
+    /// @brief Options for listing a directory
+    struct ListOptions
+    {
+        size_t offset = 0; // Amount of entries to skip
+        size_t limit = std::numeric_limits<size_t>::max(); // Max amount of entries to list
+        bool sorted = false; // Sort by name instead of creation order
+    };
+
+    /// @brief Function called for every entry listed in a directory
+    using ListCallback = std::function<void(const FileEntry&)>;
+
+    /// @brief Stats about a merge of two versions
+    struct MergeStats
+    {
+        Version version; // Version created by the merge
+        size_t merged_directories; // Directories present in both versions with different content
+        size_t shared_subtrees; // Files present in both versions with the same content, reused without visiting them
+        size_t conflicts; // Documents with different content in both versions, or files with same name and different type
+    };
+
+    /// @brief Stats about the nodes of a version control system
+    struct PersistenceStats
+    {
+        PersistenceMode mode;
+        size_t nodes; // Nodes created, including change boxes and modifications
+        size_t modifications; // Change boxes and log entries filled
+        size_t bytes; // Memory used by nodes and modification logs, not counting their childs
+    };
+
+    /// @brief Possible ways a path might change from one version to another
+    enum class ChangeType
+    {
+        ADDED,
+        REMOVED,
+        MODIFIED
+    };
+
+    /// @brief A path that differs between two versions
+    struct VersionChange
+    {
+        ChangeType type;
+        FileType file_type; // Type of the added, removed or modified file
+        std::string path; // Path from the root of the celv, starting with '/'
+    };
+
+    /// @brief Set of children of a directory node. Children are stored by file id, and a secondary 
+    /// index maps every child name to its file id, so name lookups don't need to scan the whole directory.
+    /// Both maps are persistent: copying a ChildMap is O(1), and modifying a copy only allocates O(log n) new nodes,
+    /// so every version of a directory shares most of its children set with the previous one
+    class ChildMap
+    {
+        public:
+        using Node = FileTree*;
+        using IdMap = PersistentMap<FileID, Node>;
+        using NameIndex = PersistentMap<std::string, FileID>;
+        using const_iterator = IdMap::const_iterator;
+
+        const_iterator begin() const { return _by_id.begin(); }
+        const_iterator end() const { return _by_id.end(); }
+        const_iterator find(FileID id) const { return _by_id.find(id); }
+        size_t size() const { return _by_id.size(); }
+        bool empty() const { return _by_id.empty(); }
+
+        /// @brief Search a child by its name
+        /// @param name name of the file to search
+        /// @return iterator to the child with such name, end() if there's no such child
+        const_iterator FindByName(const std::string& name) const;
+
+        /// @brief Add a new child. Replaces the node if id already exists
+        /// @param id id of file refered by this child
+        /// @param name name of file refered by this child
+        /// @param node node of new child
+        void Insert(FileID id, const std::string& name, Node node);
+
+        /// @brief Remove a child from this map
+        /// @param id id of child to remove
+        /// @param name name of child to remove
+        void Erase(FileID id, const std::string& name);
+
+        /// @brief Change the node stored for an already existing child, name and id are kept unchanged
+        /// @param id id of child to update
+        /// @param node new node for this child
+        void SetNode(FileID id, Node node);
+
+        /// @brief Remove every child in this map
+        void Clear() { _by_id.Clear(); _by_name.Clear(); }
+
+        /// @brief Get index of children by name, to iterate them sorted by name
+        /// @return name index of this map
+        const NameIndex& ByName() const { return _by_name; }
+
+        /// @brief List a page of children, skipping the first ones in O(log n)
+        /// @param files data of files refered by this map
+        /// @param options which page to list and in which order
+        /// @param callback function called for every listed child
+        void List(const FileTable& files, const ListOptions& options, const ListCallback& callback) const;
+
+        private:
+        IdMap _by_id;
+        NameIndex _by_name;
+    };
+
     /// @brief This class represents a version control system. 
     class CELV
     {
         public:
         CELV();
-        CELV(std::shared_ptr<FileTree> file_tree);
 
-        static std::shared_ptr<CELV> FromTree(std::shared_ptr<FileTree> file_tree);
+        CELV(const CELV&) = delete;
+        CELV& operator=(const CELV&) = delete;
+
+        /// @brief Create a new version control system managing a copy of the specified tree
+        /// @param original_tree tree to copy as first version
+        /// @return new version control system
+        static CELV* FromTree(const FileTree& original_tree);
+
+        /// @brief Create a version control system from a snapshot. Nothing is decoded right away: nodes are created
+        /// the first time they're reached, files and history and change boxes the first time they're requested,
+        /// so the time to load doesn't depend on the amount of versions
+        /// @param layers tables of this celv in every segment storing it, oldest first. A single layer for snapshots
+        /// not in a checkpoint store
+        /// @param parent_file node not managed by any celv where this celv was initialized
+        /// @return new version control system
+        static CELV* FromSnapshot(std::vector<SnapshotLayer> layers, FileTree* parent_file);
+
+        /// @brief Write files, nodes, versions and actions of this celv to a snapshot. Nodes are stored by index,
+        /// which is given to them on creation and never changes
+        /// @param writer snapshot to write
+        /// @param parent_file index in the snapshot of the node where this celv was initialized
+        /// @param incremental if only what was added after the last checkpoint should be written. Ignored if this
+        /// celv is not in a checkpoint yet
+        /// @return record of this celv
+        CelvRecord WriteSnapshot(SnapshotWriter& writer, uint64_t parent_file, bool incremental);
+
+        /// @brief Get the size of every table of this celv, which is where the next incremental segment starts
+        /// @return size of tables of this celv
+        CelvOrigin GetTableSizes() const;
+
+        /// @brief Remember the last checkpoint storing this celv, so the next one only stores what's added later
+        /// @param celv index of this celv in the last segment of the checkpoint store, SNAPSHOT_NONE if none
+        /// @param sizes size of every table of this celv when the checkpoint was written
+        void SetCheckpoint(uint64_t celv, const CelvOrigin& sizes) { _checkpoint_celv = celv; _checkpoint_sizes = sizes; }
+
+        /// @brief Get the node stored in the snapshot this celv was loaded from, creating it if not created yet.
+        /// Its parent and change box are created too, its children are loaded when first requested
+        /// @param index index of node in snapshot, SNAPSHOT_NONE for no node
+        /// @return node with such index, nullptr for SNAPSHOT_NONE
+        FileTree* NodeFromSnapshot(uint64_t index);
+
+        /// @brief Get a node by its index, either stored in a snapshot or created in memory
+        /// @param index index of node
+        /// @return node with such index
+        FileTree* NodeByIndex(uint64_t index) { return index < _snapshot_node_count ? NodeFromSnapshot(index) : _nodes[index - _snapshot_node_count]; }
+
+        /// @brief Load children of a node created from the snapshot. Safe to call from many threads
+        /// @param node node whose children are not loaded yet
+        void LoadChilds(const FileTree* node);
 
         /// @brief List files in current directory
-        /// @return List of files in current directory
-        const std::vector<File> List() const;
+        /// @param options which page to list and in which order
+        /// @param callback function called for every listed file
+        void List(const ListOptions& options, const ListCallback& callback) const;
 
         /// @brief Get currently active current working directory
         /// @return name of currently active working directory
-        std::string GetCurrentWorkingDirectory() const;
+        const std::string& GetCurrentWorkingDirectory() const;
 
-        std::shared_ptr<FileTree> GetCurrentWorkingDirectoryRef() const { return _working_dir; }
+        FileTree* GetCurrentWorkingDirectoryRef() const { return _working_dir; }
 
         /// @brief Try to change directory to a directory named `directory_name`. If not such directory, return error  
         /// @param directory_name Name of directory to change to
@@ -126,12 +410,13 @@ namespace CELV
         /// @return Success status
         STATUS RemoveFile(const std::string& filename, std::string& out_error_msg);
 
-        /// @brief Try to read content of file `filename` to string `out_content`. Return error if not possible 
+        /// @brief Try to read content of file `filename` to `out_content`. Return error if not possible.
+        /// The content is shared with the file system, no bytes are copied
         /// @param filename name of file to read in current directory
         /// @param out_content where to return content of file
         /// @param out_error_msg error msg if not possible to read
         /// @return Status success
-        STATUS ReadFile(const std::string& filename, std::string& out_content, std::string& out_error_msg) const;
+        STATUS ReadFile(const std::string& filename, BlobRef& out_content, std::string& out_error_msg) const;
 
         /// @brief Try to write `content` into a file named `filename`. Return error if not possible
         /// @param filename name of file to write
@@ -140,78 +425,303 @@ namespace CELV
         /// @return Success status
         STATUS WriteFile(const std::string& filename,const std::string& content, std::string& out_error_msg);
 
-        /// @brief Try to change version to the specified version
+        /// @brief Try to add `content` at the end of a file named `filename`. Return error if not possible
+        /// @param filename name of file to write
+        /// @param content content to add at the end of the file
+        /// @param out_error_msg error msg if not possible
+        /// @return Success status
+        STATUS AppendFile(const std::string& filename, std::string_view content, std::string& out_error_msg);
+
+        /// @brief Try to overwrite a file named `filename` with `content` starting at byte `offset`, growing the file
+        /// if writing past its end. Return error if not possible
+        /// @param filename name of file to write
+        /// @param offset position of first byte to overwrite, can't be greater than size of the file
+        /// @param content content to write into the file
+        /// @param out_error_msg error msg if not possible
+        /// @return Success status
+        STATUS WriteFileRange(const std::string& filename, size_t offset, std::string_view content, std::string& out_error_msg);
+
+        /// @brief Try to change version to the specified version. The working directory becomes the same directory
+        /// in that version, or its deepest ancestor present there. Recently resolved directories are cached, so 
+        /// switching back and forth between versions takes constant time
         /// @param version Version to change to
         /// @param out_error_msg error message in case of error
         /// @return Success status
-        STATUS SetVersion(Version version, std::string& out_error_msg, size_t skip_in_stack = 0);
+        STATUS SetVersion(Version version, std::string& out_error_msg);
 
-        STATUS ImportLocalPath(const std::string& path, std::string& out_error_msg, std::shared_ptr<CELV> celv);
+        /// @brief Import a path in the actual local storage as a subtree of current working directory, creating a new version
+        /// @param path path to a directory in local storage
+        /// @param out_error_msg error message in case of error
+        /// @param out_stats stats about the import
+        /// @param options how to import local files
+        /// @return Success status
+        STATUS ImportLocalPath(const std::string& path, std::string& out_error_msg, ImportStats& out_stats, const ImportOptions& options);
+
+        /// @brief Merge two versions into a new version, which becomes the current one. Files present in only one 
+        /// version are included as they are, directories present in both are merged recursively, and documents with
+        /// different content in both versions get a content marking their differences, as reported by DIFF.
+        /// Subtrees shared by both versions are reused without visiting them, and independent directories are 
+        /// merged in parallel
+        /// @param version1 first version to merge, its files win when both versions have files with the same name and different type
+        /// @param version2 second version to merge
+        /// @param out_stats stats about the merge
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Merge(Version version1, Version version2, MergeStats& out_stats, std::string& out_error_msg);
+
+        /// @brief Compare two versions, listing which paths were added, removed or modified from the first one to 
+        /// the second one. Both versions are traversed together and subtrees shared by them are skipped, so this 
+        /// takes time proportional to the amount of changes rather than to the size of the tree. Added or removed 
+        /// directories are reported as a single path, and independent directories are compared in parallel
+        /// @param version1 version to compare from
+        /// @param version2 version to compare to
+        /// @param out_changes changed paths, sorted by path
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Diff(Version version1, Version version2, std::vector<VersionChange>& out_changes, std::string& out_error_msg);
 
         /// @brief Get currently active version
         /// @return currently active version
         Version GetVersion() const { return _current_version; }
 
-        /// @brief Get the history of actions taken so far
+        /// @brief Set how new versions of documents are stored from now on
+        /// @param mode new storage mode
+        void SetStorageMode(StorageMode mode) { _storage_mode = mode; }
+
+        /// @brief Get how new versions of documents are stored
+        /// @return current storage mode
+        StorageMode GetStorageMode() const { return _storage_mode; }
+
+        /// @brief Set how new versions of nodes are stored from now on. Nodes already modified keep their
+        /// modifications, both modes read them the same way
+        /// @param mode new persistence mode
+        void SetPersistenceMode(PersistenceMode mode) { _persistence_mode = mode; }
+
+        /// @brief Get how new versions of nodes are stored
+        /// @return current persistence mode
+        PersistenceMode GetPersistenceMode() const { return _persistence_mode; }
+
+        /// @brief Get stats about the nodes of this celv. Nodes of the snapshot it was loaded from count only if 
+        /// they were already created
+        /// @return stats about nodes
+        PersistenceStats GetPersistenceStats() const;
+
+        /// @brief Get the history of actions taken so far. Actions in the snapshot this celv was loaded from are 
+        /// decoded the first time
         /// @return List of actions in execution order
-        const std::vector<Action>& GetHistory() const { return _history; }
+        const std::vector<Action>& GetHistory() { LoadSnapshotHistory(); return _history; }
 
         /// @brief Destroy all data stored in this object
         void Destroy();
 
         /// @brief Get a read only reference to files
         /// @return 
-        const std::vector<File>& GetFiles() const { return _files; }
+        const FileTable& GetFiles() const { return _files; }
+
+        FileTree* GetParentDir() const { return _parent_file; }
+        void SetParentDir(FileTree* parent_dir) { _parent_file = parent_dir; }
+
+        /// @brief Create a new node stored in the arena of this celv. It lives until this celv is destroyed
+        /// @param id id of file refered by this node
+        /// @param parent parent of new node
+        /// @param version version of new node
+        /// @return newly created node
+        FileTree* NewNode(FileID id, FileTree* parent, Version version);
 
-        std::shared_ptr<FileTree> GetParentDir() const { return _parent_file; }
-        void SetParentDir(std::shared_ptr<FileTree> parent_dir) { _parent_file = parent_dir; }
+        /// @brief Create an empty modification log in the arena of this celv
+        /// @return newly created log
+        ModificationLog* NewModificationLog() { return _arena.New<ModificationLog>(); }
 
+        /// @brief Register that the change box of a node was filled in some version. Since nodes are shared, a 
+        /// subtree reached through the same node in two versions is only the same if no change box was filled inside
+        /// of it in between
+        /// @param node node whose change box was filled
+        /// @param version version of change box
+        void RegisterChangeBox(FileTree* node, Version version) { _change_boxes.emplace_back(version, node); }
 
         private:
+        /// @brief Find the node of a path in a version. Starts from the deepest ancestor of the path already 
+        /// resolved in that version, or from the root of the version if none, caching every directory reached
+        /// @param version version to look the path in
+        /// @param path path to look for
+        /// @return node of path, or of its longest prefix present in version
+        Resolution Resolve(Version version, PathID path);
+
+        /// @brief Find the ancestors of the working directory in the current version, if not known already
+        void LoadAncestors();
+
+        /// @brief Create a new version where the working directory has a new list of files. The working directory
+        /// and its ancestors are copied as needed, up to the root, and the new version root is stored
+        /// @param new_childs files of working directory in the new version
+        void UpdateWorkingDirectory(const ChildMap& new_childs);
+
+        /// @brief Get path of a node by walking its parents
+        /// @param node node to get path of
+        /// @return id of path from root to node
+        PathID PathOf(const FileTree* node);
+
         /// @brief Push an action when performing some operation
         /// @param action action to push
         void PushAction(const Action& action) { _history.push_back(action); }
 
+        /// @brief Search a document by name in current working directory
+        /// @param filename name of document
+        /// @param out_file_id id of document
+        /// @param out_error_msg error message if there's no such document
+        /// @return Success status
+        STATUS FindDocument(const std::string& filename, FileID& out_file_id, std::string& out_error_msg) const;
+
+        /// @brief Create a new version where a document of current working directory has a new content
+        /// @param file_id id of document to update
+        /// @param content new content of document
+        /// @param type type of action creating this version
+        /// @param args arguments of action creating this version
+        void UpdateDocument(FileID file_id, ContentRef content, ActionType type, ActionArgs args);
+
         /// @brief  Traverse filetree adding their files into this
         /// @param filetree 
-        void AddFilesFromFileTree(std::shared_ptr<FileTree> filetree);
-
+        void AddFilesFromFileTree(FileTree* filetree);
+
+        /// @brief Store content for a new version of a document according to the current storage mode
+        /// @param previous content of previous version of the document
+        /// @param content content of new version
+        /// @return stored content
+        ContentRef StoreContent(const ContentRef& previous, const std::string& content) const;
+
+        /// @brief Collect directories where a change box was filled in some version in the range (after, until], 
+        /// along with their ancestors. A node reached in two versions in such range is the same subtree in both
+        /// unless it's one of these directories
+        /// @param after versions up to this one are ignored
+        /// @param until versions after this one are ignored
+        /// @param out_changed where to add ids of changed directories
+        void CollectChangedDirectories(Version after, Version until, std::unordered_set<FileID>& out_changed);
+
+        /// @brief Get root of a version
+        /// @param version version to query
+        /// @return root node of such version
+        FileTree* GetVersionRoot(Version version);
+
+        /// @brief Get the layer of the snapshot storing a node
+        /// @param index index of node, less than `_snapshot_node_count`
+        /// @return layer storing such node
+        const SnapshotLayer& LayerOfNode(uint64_t index) const;
+
+        /// @brief Get the record of a node stored in a snapshot
+        /// @param index index of node, less than `_snapshot_node_count`
+        /// @return record of such node
+        const NodeRecord& NodeRecordOf(uint64_t index) const;
+
+        /// @brief Decode actions in the snapshot this celv was loaded from, if not decoded yet
+        void LoadSnapshotHistory();
+
+        /// @brief Decode change boxes in the snapshot this celv was loaded from, if not decoded yet
+        void LoadSnapshotChangeBoxes();
+
+        struct MergePlan;
+        struct MergeContext;
+        struct DiffContext;
+
+        /// @brief Compute how to merge the children of two directories, scheduling merges of subdirectories and 
+        /// diffs of conflicting documents in the pool of the merge. No node nor file is created yet
+        /// @param plan where to store merge of this directory
+        /// @param primary node of directory whose children are the base of the merge
+        /// @param primary_version version of primary node
+        /// @param secondary node of directory whose children are merged into the base ones, null to just rebuild primary
+        /// @param secondary_version version of secondary node
+        /// @param context state shared by the whole merge
+        void PlanMerge(MergePlan& plan, const FileTree* primary, Version primary_version, const FileTree* secondary, Version secondary_version, MergeContext& context) const;
+
+        /// @brief Create nodes and files of a merged directory
+        /// @param plan merge of this directory
+        /// @param parent parent of new node
+        /// @param version version of new nodes
+        /// @return new node for the merged directory
+        FileTree* BuildMerge(const MergePlan& plan, FileTree* parent, Version version);
+
+        /// @brief Compare the children of two versions of a directory, scheduling comparisons of subdirectories in 
+        /// the pool of the diff
+        /// @param node1 node of directory in first version
+        /// @param node2 node of directory in second version
+        /// @param path path of this directory
+        /// @param context state shared by the whole diff
+        void DiffDirectory(const FileTree* node1, const FileTree* node2, const std::string& path, DiffContext& context) const;
 
         private:
-        std::vector<File> _files;
-        std::shared_ptr<FileTree> _working_dir;
-        // Array of version roots
-        std::vector<std::shared_ptr<FileTree>> _versions;
+        FileTable _files;
+        FileTree* _working_dir;
+        PathID _working_path; // Path from root to working directory
+        // Nodes of the ancestors of the working directory in the current version, root first. Parent pointers can't be
+        // used instead, since a node shared by several versions only points to one of its parents
+        std::vector<FileTree*> _ancestors;
+        bool _ancestors_loaded; // If `_ancestors` is up to date, they're found again after switching versions
+        PathTable _paths; // Every path visited as working directory
+        ResolutionCache _resolutions; // Nodes of recently visited paths in recently visited versions
+        // Array of version roots. Roots of versions in the snapshot this celv was loaded from are not stored here
+        std::vector<FileTree*> _versions;
         Version _current_version;
         Version _next_available_version;
+        StorageMode _storage_mode;
+        PersistenceMode _persistence_mode;
         std::vector<Action> _history;
-        std::shared_ptr<FileTree> _parent_file;
+        FileTree* _parent_file;
+        // Nodes created in memory by this celv, in creation order. Nodes are shared between versions, so they're 
+        // only released when the whole celv is destroyed. Index of each node is its position plus `_snapshot_node_count`
+        std::vector<FileTree*> _nodes;
+        NodeArena _arena;
+        // Nodes whose change box was filled, sorted by version of the change box. In a modification log, each
+        // modification is the change box of the previous one
+        std::vector<std::pair<Version, FileTree*>> _change_boxes;
+        // Snapshot this celv was loaded from, if any, a layer per segment storing it
+        std::vector<SnapshotLayer> _snapshot_layers;
+        uint64_t _snapshot_node_count; // Nodes stored in the snapshot, nodes created later have greater indices
+        Version _snapshot_versions; // Versions whose root is in the snapshot, later ones are in _versions
+        uint64_t _snapshot_actions; // Actions stored in the snapshot
+        uint64_t _snapshot_change_box_count; // Change boxes stored in the snapshot
+        std::unordered_map<uint64_t, FileTree*> _snapshot_nodes; // Nodes created from the snapshot so far, by index
+        std::unordered_map<uint64_t, uint64_t> _snapshot_patches; // Change boxes filled in a segment after the one storing their node
+        bool _snapshot_history_loaded;
+        bool _snapshot_change_boxes_loaded;
+        std::recursive_mutex _snapshot_mutex; // Protects nodes loaded from the snapshot, they might be loaded by any thread
+        // Last checkpoint storing this celv
+        uint64_t _checkpoint_celv; // Index of this celv in last segment, SNAPSHOT_NONE if not in any checkpoint
+        CelvOrigin _checkpoint_sizes; // Size of every table when last checkpoint was written
     };
 
     class FileTree
     {
         friend CELV;
-
-        public:
-        // typedef ChildMap = ...
-        using ChildMap = std::map<FileID, std::shared_ptr<FileTree>>;
+        friend class FileSystem;
 
         public:
         /// @brief Create a new FileTree
         /// @param id id of this file
         /// @param parent parent file
-        FileTree(FileID id, std::shared_ptr<FileTree> parent, Version version = 0, std::shared_ptr<CELV> _version_control = nullptr);
+        FileTree(FileID id, FileTree* parent, Version version = 0, CELV* _version_control = nullptr);
 
         /// @brief Create a root FileTree object assuming no file tree has been created so far
         /// @return ptr to file tree root
-        static std::shared_ptr<FileTree> MakeRootFileTree();
-
-        File GetFileData() const;
-
-        /// @brief Generate a FileTree based on a copy of a local filepath  
+        static FileTree* MakeRootFileTree();
+
+        /// @brief Create a new node. It's allocated in the arena of `celv` if provided, in the global arena otherwise
+        /// @param id id of file refered by this node
+        /// @param parent parent of new node
+        /// @param version version of new node
+        /// @param celv version control system managing this node, if any
+        /// @return newly created node
+        static FileTree* MakeNode(FileID id, FileTree* parent, Version version, CELV* celv);
+
+        /// @brief Get data of the file represented by this node
+        /// @return data of this file
+        const File& GetFileData() const;
+
+        /// @brief Generate a FileTree based on a copy of a local filepath. Directories are scanned and documents are read
+        /// in parallel, while the tree is built in this thread. File ids are assigned in preorder, visiting children
+        /// sorted by name, so they don't depend on the order of the local directory nor on scheduling
         /// @param src_path Path in the local machine to an actual directory
+        /// @param out_stats stats about the import
+        /// @param options how to import local files
         /// @return Success
-        static STATUS FromLocalFileSystem(const std::string& src_path, std::shared_ptr<FileTree>& out_tree, std::string& out_error_msg, std::vector<File>& files,  Version version = 0, std::shared_ptr<CELV> celv = nullptr);
+        static STATUS FromLocalFileSystem(const std::string& src_path, FileTree*& out_tree, std::string& out_error_msg, FileTable& files, ImportStats& out_stats, const ImportOptions& options, Version version = 0, CELV* celv = nullptr);
 
         // The following functions are CRUD function that may or may not use the version control system depending on 
         // the confuguration of the current filetree node
@@ -219,26 +729,27 @@ namespace CELV
         // -- < CRUD Functions > ------------------------------------------------------------------------------------
 
         /// @brief List files contained by this node
-        /// @return List of files contained by this folder
-        const std::vector<File> List() const;
+        /// @param options which page to list and in which order
+        /// @param callback function called for every listed file
+        void List(const ListOptions& options, const ListCallback& callback) const;
 
         /// @brief Try to change directory to a directory named `directory_name`. If not such directory, return error  
         /// @param directory_name Name of directory to change to
         /// @param out_error_msg Error message
         /// @return Success Status
-        STATUS ChangeDirectory(const std::string& directory_name, std::shared_ptr<FileTree>& out_new_dir, std::string& out_error_msg);
+        STATUS ChangeDirectory(const std::string& directory_name, FileTree*& out_new_dir, std::string& out_error_msg);
 
         /// @brief Try to change directory to parent directory. Raise error if already in root directory. 
         /// @param out_error_msg error message if some error happened
         /// @return Success Status
-        STATUS ChangeDirectory(std::shared_ptr<FileTree>& out_new_dir, std::string& out_error_msg);
+        STATUS ChangeDirectory(FileTree*& out_new_dir, std::string& out_error_msg);
 
         /// @brief Try to create a directory named `directory_name`. Report error if not possible and store message in `out_error_msg`
         /// @param filename Name of new directory to create
         /// @param type If directory or document
         /// @param out_error_msg Resulting error message when not possible
         /// @return Success Status
-        STATUS CreateFile(const std::string& filename, FileType type, std::string& out_error_msg, std::shared_ptr<FileTree> new_parent = nullptr);
+        STATUS CreateFile(const std::string& filename, FileType type, std::string& out_error_msg, FileTree* new_parent = nullptr);
 
         /// @brief Try to remove specified file. If directory, perform recursive delete
         /// @param filename name of file to delete
@@ -246,12 +757,13 @@ namespace CELV
         /// @return Success status
         STATUS RemoveFile(const std::string& filename, std::string& out_error_msg);
 
-        /// @brief Try to read content of file `filename` to string `out_content`. Return error if not possible 
+        /// @brief Try to read content of file `filename` to `out_content`. Return error if not possible.
+        /// The content is shared with the file system, no bytes are copied
         /// @param filename name of file to read in current directory
         /// @param out_content where to return content of file
         /// @param out_error_msg error msg if not possible to read
         /// @return Status success
-        STATUS ReadFile(const std::string& filename, std::string& out_content, std::string& out_error_msg) const;
+        STATUS ReadFile(const std::string& filename, BlobRef& out_content, std::string& out_error_msg) const;
 
         /// @brief Try to write `content` into a file named `filename`. Return error if not possible
         /// @param filename name of file to write
@@ -260,6 +772,22 @@ namespace CELV
         /// @return Success status
         STATUS WriteFile(const std::string& filename,const std::string& content, std::string& out_error_msg);
 
+        /// @brief Try to add `content` at the end of a file named `filename`. Return error if not possible
+        /// @param filename name of file to write
+        /// @param content content to add at the end of the file
+        /// @param out_error_msg error msg if not possible
+        /// @return Success status
+        STATUS AppendFile(const std::string& filename, std::string_view content, std::string& out_error_msg);
+
+        /// @brief Try to overwrite a file named `filename` with `content` starting at byte `offset`, growing the file
+        /// if writing past its end. Return error if not possible
+        /// @param filename name of file to write
+        /// @param offset position of first byte to overwrite, can't be greater than size of the file
+        /// @param content content to write into the file
+        /// @param out_error_msg error msg if not possible
+        /// @return Success status
+        STATUS WriteFileRange(const std::string& filename, size_t offset, std::string_view content, std::string& out_error_msg);
+
         /// @brief Try to change version to the specified version
         /// @param version Version to change to
         /// @param out_error_msg error message in case of error
@@ -271,71 +799,80 @@ namespace CELV
         /// @return Success status
         STATUS GetVersion(Version& out_version, std::string& out_error_msg);
 
+        /// @brief Set how new versions of documents are stored by the version control system
+        /// @param mode new storage mode
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS SetStorageMode(StorageMode mode, std::string& out_error_msg);
+
+        /// @brief Set how new versions of nodes are stored by the version control system
+        /// @param mode new persistence mode
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS SetPersistenceMode(PersistenceMode mode, std::string& out_error_msg);
+
+        /// @brief Get stats about the nodes of the version control system
+        /// @param out_stats stats about nodes
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS GetPersistenceStats(PersistenceStats& out_stats, std::string& out_error_msg) const;
+
         /// @brief Get the history of actions taken so far
         /// @return List of actions in execution order
         STATUS  GetHistory(std::vector<Action>& out_history, std::string& out_error_msg);
 
+        /// @brief Merge two versions of the version control system into a new version
+        /// @param version1 first version to merge
+        /// @param version2 second version to merge
+        /// @param out_stats stats about the merge
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Merge(Version version1, Version version2, MergeStats& out_stats, std::string& out_error_msg);
+
+        /// @brief List paths changed from a version of the version control system to another
+        /// @param version1 version to compare from
+        /// @param version2 version to compare to
+        /// @param out_changes changed paths, sorted by path
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Diff(Version version1, Version version2, std::vector<VersionChange>& out_changes, std::string& out_error_msg);
+
         /// @brief Try to init version control system in this node
         /// @param out_error_msg 
         /// @return 
-        STATUS InitCELV(std::string& out_error_msg, std::shared_ptr<FileTree> celv_parent = nullptr);
+        STATUS InitCELV(std::string& out_error_msg, FileTree* celv_parent = nullptr);
 
         /// @brief Import a path in the actual local storage as a subtree, ignores links and files with missing permissions
         /// @param path path to a directory in local storage
         /// @param out_error_msg 
+        /// @param out_stats stats about the import
+        /// @param options how to import local files
         /// @return 
-        STATUS ImportLocalPath(const std::string& path, std::string& out_error_msg, std::shared_ptr<FileTree> parent);
+        STATUS ImportLocalPath(const std::string& path, std::string& out_error_msg, FileTree* parent, ImportStats& out_stats, const ImportOptions& options);
 
         // The following functions are Control version related, used with CELV object
         // -- < Version control functions > --------------------------------------------------------------
 
         /// @brief Get parent of this tree
         /// @return pointer to parent
-        std::shared_ptr<FileTree> GetParent() const { return _parent; }
+        FileTree* GetParent() const { return _parent; }
 
         /// @brief Set new parent of this node
         /// @param new_parent new parent to set
-        void SetParent(std::shared_ptr<FileTree> new_parent) { _parent = new_parent; }
-
-        /// @brief Try to add this file as child of this file tree. Note that this function doesn't checks if file is dir or doc, 
-        /// you have to ensure it yourself
-        /// @param file file to add as child
-        /// @param current_version Current version to use, used to query which data to use next
-        /// @param new_version New version to mark in any newly modified node
-        /// @param out_new_possible_parent New version parent if new root was created. Null if no new root is created.
-        /// @return new node if one was created during the update
-        std::shared_ptr<FileTree> AddFile(std::shared_ptr<FileTree> file, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_possible_new_parent);
-        void AddFile(std::shared_ptr<FileTree> file)
+        void SetParent(FileTree* new_parent) { _parent = new_parent; }
+
+        /// @brief Add a file as child of this node, without versioning
+        /// @param file node of file to add
+        void AddFile(FileTree* file)
         {
             assert(file != nullptr);
-            _contained_files[file->GetFileID()] = file;
+            _contained_files.Insert(file->GetFileID(), file->GetFileName(), file);
         }
 
         /// @brief Delete specified file from this node
         /// @param file_id id of file to delete
         void RemoveFile(FileID file_id);
         
-        /// @brief Delete specified file from this node
-        /// @param file_id id of file to delete
-        /// @param current_version currently active version
-        /// @param new_version new version to mark for new nodes
-        /// @param out_new_possible_parent New version parent if new root was created. Null if no new root is created.
-        /// @return new node if one was created during the update
-        std::shared_ptr<FileTree> RemoveFile(FileID file_id, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_possible_new_parent);
-
-        /// @brief replace a file with id `old_file_id` with a new file with id `new_file_id`
-        /// @param old_file_id id of old file to be replaced
-        /// @param new_file_id new id replacing old id
-        /// @param current_version currently active version
-        /// @param new_version new version to mark in each newly created node
-        /// @param out_possible_new_parent possible new root parent if one was created
-        /// @return possible new version of this node if one was created
-        std::shared_ptr<FileTree> ReplaceFileId(FileID old_file_id, FileID new_file_id, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_possible_new_parent);
-
-        /// @brief Return list of contained files
-        /// @return files contained by this node
-        std::vector<std::shared_ptr<FileTree>> ContainedFiles(Version version) const;
-
         /// @brief Checks if this file node contains the file specified by `id`
         /// @param id id of file to check if exists
         /// @return if this file tree contains the required file
@@ -345,14 +882,18 @@ namespace CELV
         /// @return id of file refered by this node
         FileID GetFileID() const { return _file_id; }
 
+        /// @brief Get name of file refered by this node
+        /// @return name of file refered by this node
+        const std::string& GetFileName() const { return FileData(_file_id).GetName(); }
+
         /// @brief Get if of file refered by this node
         /// @param version Query version
         /// @return id of file refered by this node
-        FileID GetFileID(Version version) const { return UseChangeBox(version) ? _change_box->GetFileID() : _file_id; }
+        FileID GetFileID(Version version) const { return ModificationAt(version)->_file_id; }
 
         /// @brief Get how many children has this folder of the file tree
         /// @return amount of childs in first level of this file
-        size_t GetNChilds() const { return _contained_files.size(); }
+        size_t GetNChilds() const { return LoadedChilds().size(); }
 
         /// @brief Get version of this node
         /// @return version of this node
@@ -360,12 +901,11 @@ namespace CELV
 
         /// @brief Set new childs of this file
         /// @param childs new childs to updatre
-        void SetNewChilds(const ChildMap& childs) { _contained_files = childs; }
+        void SetNewChilds(const ChildMap& childs) { _contained_files = childs; _childs_pending = false; }
 
         /// @brief Get reference to childs of this node
         /// @return childs contained by this node
-        const ChildMap& GetChilds(Version version ) const 
-        { return UseChangeBox(version) ? _change_box->GetChilds(version) : _contained_files ; }
+        const ChildMap& GetChilds(Version version ) const { return ModificationAt(version)->LoadedChilds(); }
 
         /// @brief If this node is a root node
         /// @return true if this node is root, false otherwise
@@ -376,45 +916,113 @@ namespace CELV
         /// @return true if should use change box, false otherwise
         bool UseChangeBox(Version version) const { return _change_box != nullptr && _change_box->GetVersion() <= version; }
 
-        /// @brief Destroy this tree and all its children
-        void Destroy();
+        /// @brief Get the node storing data of this node in a version: itself, or its latest modification up to 
+        /// that version. Modifications after the change box are chained through their own change box, and found by
+        /// binary search when indexed by a log
+        /// @param version active version
+        /// @return node with data of this node in version
+        const FileTree* ModificationAt(Version version) const
+        {
+            if (!UseChangeBox(version))
+                return this;
+            if (_log == nullptr)
+                return _change_box->ModificationAt(version); // Not indexed, walk the chain
+
+            auto const next = std::upper_bound(_log->entries, _log->entries + _log->size, version, 
+                [](Version query, const FileTree* modification) { return query < modification->_version; });
+            return *(next - 1);
+        }
+
+        /// @brief Destroy a tree not managed by any celv, its children, and any celv initialized in this subtree
+        /// @param tree root of tree to destroy
+        static void DestroyTree(FileTree* tree);
 
         bool CELVActive() const { return _celv != nullptr; }
 
         private:
-        /// @brief Update file_id of this node. Return new node if new was created
-        /// @param new_file_id updated file id
-        /// @param current_version Current version to use, used to query which data to use next
-        /// @param new_version New version to mark in any newly modified node
-        /// @return nullptr if no new node was created, ptr to newly created node otherwise
-        std::shared_ptr<FileTree> UpdateNode(FileID new_file_id, Version current_version, Version new_version, std::shared_ptr<FileTree>& out_new_version_parent); // escribir
+        /// @brief Get childs stored in this node, ignoring its change box. Nodes created from a snapshot load them 
+        /// the first time
+        /// @return childs stored in this node
+        const ChildMap& LoadedChilds() const 
+        {
+            if (_childs_pending.load(std::memory_order_acquire))
+                _celv->LoadChilds(this);
+            return _contained_files;
+        }
 
-        /// @brief Update list of files of this node. Return new node if new was created
+        /// @brief Set list of files of this node in a new version. The change box is filled if it's empty, or a 
+        /// modification is added to the log if the celv uses one, it's not full and `version` reads its last entry.
+        /// Otherwise a copy of this node is created and the parent has to be updated to refer to it
         /// @param new_contained_files new list of files for this node
-        /// @param current_version Current version to use, used to query which data to use next
-        /// @param new_version New version to mark in any newly modified node
+        /// @param version version being modified
+        /// @param new_version version of new list of files
+        /// @param parent node of parent directory in the version being modified, null if this node is a version root
         /// @return nullptr if no new node was created, ptr to newly created node otherwise
-        std::shared_ptr<FileTree> UpdateNode(const ChildMap& new_contained_files,Version current_version, Version new_version, std::shared_ptr<FileTree>& out_new_version_parent); // operacion de directorio
+        FileTree* UpdateNode(const ChildMap& new_contained_files, Version version, Version new_version, FileTree* parent);
+
+        /// @brief Get the modification log of this node, indexing the chain of modifications if not done yet
+        /// @return log of this node
+        ModificationLog& LoadLog();
 
         /// @brief Set CELV reference to the entire tree
         /// @param celv_ref Ref to celv to update in the entire subtree
-        void SetCELVRef(std::shared_ptr<CELV> celv_ref) { _celv = celv_ref; };
+        void SetCELVRef(CELV* celv_ref) { _celv = celv_ref; };
 
         bool IsCelvInitInSubtree() const;
 
+        /// @brief Get data of a file using the file storage this node refers to, the celv's one if active 
+        /// or the global one otherwise
+        /// @param id id of file to retrieve
+        /// @return Data of requested file
+        const File& FileData(FileID id) const;
+
         /// @brief Clone this file tree into a new ptr
+        /// @param celv version control system that will manage the cloned nodes
         /// @return cloned tree
-        std::shared_ptr<FileTree> CloneTree() const;
+        FileTree* CloneTree(CELV* celv) const;
+
+        /// @brief Last stage of the import pipeline, build nodes from files scanned from local storage, in preorder
+        /// @param scanner scanner providing loaded files
+        /// @param scanned file to build a node for
+        /// @param parent parent of new node
+        /// @param files storage where to add data of new files
+        /// @return newly created node
+        static FileTree* BuildImportedTree(LocalScanner& scanner, ScannedFile& scanned, FileTree* parent, FileTable& files, Version version, CELV* celv);
 
         private:
         ChildMap _contained_files;
-        std::shared_ptr<FileTree> _parent;
-        std::shared_ptr<FileTree> _change_box;
+        FileTree* _parent;
+        FileTree* _change_box;
+        ModificationLog* _log; // Index of the chain of modifications starting at the change box, null if not built
         FileID _file_id; // id of file containing actual data
         Version _version;
         bool _is_celv_root;
-        std::shared_ptr<CELV> _celv;
-        static std::vector<File> _files;
+        CELV* _celv;
+        uint64_t _snapshot_index; // Index of this node among the nodes of its celv, SNAPSHOT_NONE if not managed by one
+        std::atomic<bool> _childs_pending; // If childs are still only in the snapshot
+        static FileTable _files;
+        static NodeArena _nodes; // Arena for nodes not managed by any celv
+    };
+
+    /// @brief Stats about a snapshot written by a child process
+    struct BackgroundSaveStats
+    {
+        std::string path;
+        std::string error; // Empty if the snapshot was written
+        uint64_t bytes = 0;
+        double seconds = 0; // Time the child process spent writing the snapshot
+    };
+
+    /// @brief Stats about a checkpoint
+    struct CheckpointStats
+    {
+        std::string path; // Path of written segment
+        bool incremental = false; // If only what was added since the previous checkpoint was written
+        size_t nodes = 0; // Versioned nodes written
+        size_t versions = 0; // Versions written
+        uint64_t bytes = 0;
+        double seconds = 0;
+        size_t compacting_segments = 0; // Segments being merged in the background, 0 if no compaction was started
     };
 
     class FileSystem
@@ -423,12 +1031,13 @@ namespace CELV
         FileSystem();
 
         /// @brief List files in current directory
-        /// @return List of files in current directory
-        std::vector<File> List() const;
+        /// @param options which page to list and in which order
+        /// @param callback function called for every listed file
+        void List(const ListOptions& options, const ListCallback& callback) const;
 
         /// @brief Get currently active current working directory
         /// @return name of currently active working directory
-        std::string GetCurrentWorkingDirectory() const;
+        const std::string& GetCurrentWorkingDirectory() const;
 
         /// @brief Try to change directory to a directory named `directory_name`. If not such directory, return error  
         /// @param directory_name Name of directory to change to
@@ -454,12 +1063,13 @@ namespace CELV
         /// @return Success status
         STATUS RemoveFile(const std::string& filename, std::string& out_error_msg);
 
-        /// @brief Try to read content of file `filename` to string `out_content`. Return error if not possible 
+        /// @brief Try to read content of file `filename` to `out_content`. Return error if not possible.
+        /// The content is shared with the file system, no bytes are copied
         /// @param filename name of file to read in current directory
         /// @param out_content where to return content of file
         /// @param out_error_msg error msg if not possible to read
         /// @return Status success
-        STATUS ReadFile(const std::string& filename, std::string& out_content, std::string& out_error_msg) const;
+        STATUS ReadFile(const std::string& filename, BlobRef& out_content, std::string& out_error_msg) const;
 
         /// @brief Try to write `content` into a file named `filename`. Return error if not possible
         /// @param filename name of file to write
@@ -468,6 +1078,22 @@ namespace CELV
         /// @return Success status
         STATUS WriteFile(const std::string& filename,const std::string& content, std::string& out_error_msg);
 
+        /// @brief Try to add `content` at the end of a file named `filename`. Return error if not possible
+        /// @param filename name of file to write
+        /// @param content content to add at the end of the file
+        /// @param out_error_msg error msg if not possible
+        /// @return Success status
+        STATUS AppendFile(const std::string& filename, std::string_view content, std::string& out_error_msg);
+
+        /// @brief Try to overwrite a file named `filename` with `content` starting at byte `offset`, growing the file
+        /// if writing past its end. Return error if not possible
+        /// @param filename name of file to write
+        /// @param offset position of first byte to overwrite, can't be greater than size of the file
+        /// @param content content to write into the file
+        /// @param out_error_msg error msg if not possible
+        /// @return Success status
+        STATUS WriteFileRange(const std::string& filename, size_t offset, std::string_view content, std::string& out_error_msg);
+
         /// @brief Try to change version to the specified version
         /// @param version Version to change to
         /// @param out_error_msg error message in case of error
@@ -478,23 +1104,178 @@ namespace CELV
         /// @return currently active version
         STATUS GetVersion(Version& out_version, std::string& out_error_msg) const;
 
+        /// @brief Set how new versions of documents are stored by the active version control system
+        /// @param mode new storage mode
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS SetStorageMode(StorageMode mode, std::string& out_error_msg);
+
+        /// @brief Set how new versions of nodes are stored by the version control system
+        /// @param mode new persistence mode
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS SetPersistenceMode(PersistenceMode mode, std::string& out_error_msg);
+
+        /// @brief Get stats about the nodes of the version control system
+        /// @param out_stats stats about nodes
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS GetPersistenceStats(PersistenceStats& out_stats, std::string& out_error_msg) const;
+
         /// @brief Get the history of actions taken so far
         /// @return List of actions in execution order
         STATUS GetHistory(std::vector<Action>& out_history, std::string& error_msg);
 
+        /// @brief Merge two versions of the active version control system into a new version
+        /// @param version1 first version to merge
+        /// @param version2 second version to merge
+        /// @param out_stats stats about the merge
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Merge(Version version1, Version version2, MergeStats& out_stats, std::string& out_error_msg);
+
+        /// @brief List paths changed from a version of the active version control system to another
+        /// @param version1 version to compare from
+        /// @param version2 version to compare to
+        /// @param out_changes changed paths, sorted by path
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Diff(Version version1, Version version2, std::vector<VersionChange>& out_changes, std::string& out_error_msg);
+
+        /// @brief Get stats about storage of document contents, shared by the whole filesystem
+        /// @return stats of content storage
+        BlobStore::Stats GetStorageStats() const { return File::GetBlobStore().GetStats(); }
+
         /// @brief Init the current working directoy with a version control system
         /// @param out_error_msg possible error message in case of error
         /// @return Success status
-        STATUS InitCELV(std::string& out_error_msg) { return _working_directory->InitCELV(out_error_msg, _working_directory); }
+        STATUS InitCELV(std::string& out_error_msg);
+
+        /// @brief Import a directory in local storage into current working directory
+        /// @param filepath path to a directory in local storage
+        /// @param out_error_msg error message in case of error
+        /// @param out_stats stats about the import
+        /// @param options how to import local files
+        /// @return Success status
+        STATUS Import(const std::string& filepath, std::string& out_error_msg, ImportStats& out_stats, const ImportOptions& options = ImportOptions());
+
+        /// @brief Save the whole file system to a binary snapshot: files, nodes and every version and action of
+        /// every celv. Nodes shared between versions are stored once
+        /// @param path where to store the snapshot
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Save(const std::string& path, std::string& out_error_msg);
+
+        /// @brief Replace the whole file system with the one stored in a snapshot. The snapshot is mapped to memory,
+        /// and versioned nodes are only loaded when first reached, so loading takes the same time no matter how long 
+        /// the history is. Nothing changes if the snapshot can't be loaded
+        /// @param path path to snapshot, or to a directory storing checkpoints
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Load(const std::string& path, std::string& out_error_msg);
+
+        /// @brief Store a checkpoint of the file system in a directory. The first checkpoint in a directory stores 
+        /// everything, like `Save`. Later ones only store nodes, files, versions and actions added since the previous
+        /// one, as a new segment. Long chains of segments are merged in the background. `Load` with the directory
+        /// restores the last checkpoint
+        /// @param directory directory storing checkpoints
+        /// @param out_stats stats about the checkpoint
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Checkpoint(const std::string& directory, CheckpointStats& out_stats, std::string& out_error_msg);
+
+        /// @brief Save the whole file system to a binary snapshot from a child process, so this process can keep 
+        /// modifying it meanwhile. The child sees the file system as it was when it was started, since its memory is
+        /// a copy-on-write copy of this process'. The journal, if any, keeps starting from the previous snapshot, as
+        /// it may already record operations after the child was started. Only one such child runs at a time
+        /// @param path where to store the snapshot
+        /// @param out_pause_seconds time this process was paused to start the child
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS SaveInBackground(const std::string& path, double& out_pause_seconds, std::string& out_error_msg);
+
+        /// @brief Get stats of the last snapshot written in the background, if its child process finished since the
+        /// last call to this function
+        /// @param out_stats stats of snapshot
+        /// @return if a child process finished
+        bool TakeBackgroundSaveStats(BackgroundSaveStats& out_stats);
+
+        /// @brief Block until the snapshot being written in the background, if any, is finished. Its stats are
+        /// still returned by the next call to TakeBackgroundSaveStats
+        void WaitBackgroundSave();
+
+        /// @brief Get stats of the last merge of checkpoints finished since the last call to this function
+        /// @param out_stats stats of merge
+        /// @return if a merge finished since the last call
+        bool TakeCompactionStats(CompactionStats& out_stats) { return _checkpoints.TakeCompactionStats(out_stats); }
+
+        /// @brief Record every operation that modifies the file system in a journal, so the session can be recovered
+        /// after a crash. If the journal exists, the session it records is recovered first: the snapshot it starts 
+        /// from is loaded, and its operations applied again. Saving or loading a snapshot starts a new journal from it
+        /// @param path path to journal
+        /// @param options when to sync operations to disk
+        /// @param out_stats stats about the recovered operations, if any
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS OpenJournal(const std::string& path, const JournalOptions& options, JournalReplayStats& out_stats, std::string& out_error_msg);
 
-        STATUS Import(const std::string& filepath, std::string& out_error_msg) { return _working_directory->ImportLocalPath(filepath, out_error_msg, _working_directory); }
+        /// @brief Stop recording operations, syncing the ones recorded so far
+        void CloseJournal() { _journal.Close(); }
 
         /// @brief Destroy all data stored in this object
         void Destroy();
 
         private:
-        std::shared_ptr<FileTree> _file_tree;
-        std::shared_ptr<FileTree> _working_directory;
+        /// @brief Record an operation in the journal, if any
+        /// @param record operation that modified the file system
+        void Log(const JournalRecord& record);
+
+        /// @brief Apply an operation read from a journal
+        /// @param record operation to apply
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Apply(const JournalRecord& record, std::string& out_error_msg);
+
+        /// @brief Replace file system with an empty one
+        void Reset();
+
+        /// @brief Collect stats of the child process writing a snapshot in the background, once it was reaped
+        /// @param status exit status of the child process
+        void FinishBackgroundSave(int status);
+
+        /// @brief Write the whole file system to a snapshot
+        /// @param path where to write the snapshot
+        /// @param incremental if only what celvs added since the last checkpoint should be written
+        /// @param out_celvs every celv, in the order they're stored
+        /// @param out_celv_records record of every celv
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS WriteSegment(const std::string& path, bool incremental, std::vector<CELV*>& out_celvs, std::vector<CelvRecord>& out_celv_records, std::string& out_error_msg);
+
+        /// @brief Replace the whole file system with the one stored in a chain of segments
+        /// @param chain segments to load, starting with a full one
+        /// @param path path they were loaded from, to report errors
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS LoadSegments(const std::vector<std::shared_ptr<const MappedSnapshot>>& chain, const std::string& path, std::string& out_error_msg);
+
+        /// @brief Remember the snapshot this session was saved to or loaded from, and start the journal from it
+        /// @param path path to snapshot
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS SetSnapshotPath(const std::string& path, std::string& out_error_msg);
+
+        private:
+        FileTree* _file_tree;
+        FileTree* _working_directory;
+        Journal _journal;
+        CheckpointStore _checkpoints; // Store of last checkpoint written or loaded, if any
+        std::string _snapshot_path; // Absolute path of last snapshot saved or loaded, empty if none
+        bool _unsaved_changes; // If some operation was applied since the last snapshot
+        pid_t _background_save; // Child process writing a snapshot, -1 if none
+        int _background_save_errors; // Read end of a pipe where the child writes its write time and error message, if any
+        std::string _background_save_path;
+        std::optional<BackgroundSaveStats> _finished_background_save; // Stats of a child already reaped but not taken yet
 
     };
 }
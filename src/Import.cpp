@@ -0,0 +1,199 @@
+#include "Import.hpp"
+#include "MappedContent.hpp"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace CELV
+{
+    namespace
+    {
+        // Minimum time between two progress reports
+        constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(250);
+
+        /// @brief Check if we have permissions to import a local file
+        bool CanImport(std::filesystem::perms permissions)
+        {
+            using std::filesystem::perms;
+            auto const has = [permissions](perms flag) { return (permissions & flag) != perms::none; };
+            return (has(perms::owner_read) && has(perms::owner_write)) || (has(perms::others_read) && has(perms::others_write));
+        }
+    }
+
+    LocalScanner::LocalScanner(const std::filesystem::path& path, const ImportOptions& options)
+        : _root(std::make_unique<ScannedFile>())
+        , _options(options)
+        , _start(std::chrono::steady_clock::now())
+        , _last_report(_start)
+        , _directories(0)
+        , _documents(0)
+        , _bytes(0)
+        , _skipped(0)
+        , _mutex()
+        , _file_loaded()
+        , _pool()
+    {
+        _root->name = path.filename().string();
+        _root->is_directory = true;
+        _root->skipped = false;
+        _root->loaded = false;
+        _pool.Submit([this, path] { ScanDirectory(*_root, path); });
+    }
+
+    void LocalScanner::WaitUntilLoaded(const ScannedFile& file)
+    {
+        ReportProgress();
+        if (file.loaded)
+            return;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!file.loaded)
+        {
+            _file_loaded.wait_for(lock, PROGRESS_INTERVAL);
+
+            lock.unlock();
+            ReportProgress();
+            lock.lock();
+        }
+    }
+
+    ImportStats LocalScanner::Finish()
+    {
+        _pool.Wait();
+        return GetStats();
+    }
+
+    void LocalScanner::ScanDirectory(ScannedFile& directory, std::filesystem::path path)
+    {
+        std::error_code error;
+        auto it = std::filesystem::directory_iterator(path, error);
+        for (; !error && it != std::filesystem::end(it); it.increment(error))
+        {
+            auto const& entry = *it;
+
+            // A single status call provides both type and permissions
+            std::error_code status_error;
+            auto const status = entry.status(status_error);
+            if (status_error || !CanImport(status.permissions()))
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                std::cerr<<" Ignoring '"<<entry.path().string()<<"'. Not enough permissions\n";
+                continue;
+            }
+
+            if (!std::filesystem::is_directory(status) && !std::filesystem::is_regular_file(status))
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                std::cerr<<" Ignoring '"<<entry.path().string()<<"'. Not regular file nor directory\n";
+                continue;
+            }
+
+            auto child = std::make_unique<ScannedFile>();
+            child->name = entry.path().filename().string();
+            child->is_directory = std::filesystem::is_directory(status);
+            child->skipped = false;
+            child->loaded = false;
+            directory.children.push_back(std::move(child));
+        }
+
+        if (error)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::cerr<<" Ignoring content of '"<<path.string()<<"'. "<<error.message()<<"\n";
+        }
+
+        // Sort so results don't depend on the order of the local directory
+        std::sort(directory.children.begin(), directory.children.end(), [](auto const& a, auto const& b) { return a->name < b->name; });
+
+        // Children are not modified from now on, so they can be loaded in parallel
+        for (auto& child : directory.children)
+        {
+            auto child_path = path / child->name;
+            auto& child_ref = *child;
+            if (child->is_directory)
+                _pool.Submit([this, &child_ref, child_path] { ScanDirectory(child_ref, child_path); });
+            else
+                _pool.Submit([this, &child_ref, child_path] { ReadDocument(child_ref, child_path); });
+        }
+
+        _directories++;
+        MarkLoaded(directory);
+    }
+
+    void LocalScanner::ReadDocument(ScannedFile& document, std::filesystem::path path)
+    {
+        if (_options.lazy)
+        {
+            document.lazy_content = MappedContent::FromPath(path.string());
+            if (document.lazy_content == nullptr)
+                return SkipDocument(document, path);
+
+            _documents++;
+            MarkLoaded(document);
+            return;
+        }
+
+        // Read straight into the final buffer, with a single allocation of the right size
+        std::ifstream input(path, std::ios::binary | std::ios::ate);
+        auto const size = input ? static_cast<std::streamoff>(input.tellg()) : -1;
+        if (size < 0)
+            return SkipDocument(document, path);
+
+        if (size > 0)
+        {
+            document.content.resize(static_cast<size_t>(size));
+            input.seekg(0);
+            input.read(document.content.data(), size);
+            if (input.bad())
+            {
+                document.content.clear();
+                return SkipDocument(document, path);
+            }
+            document.content.resize(static_cast<size_t>(input.gcount()));
+        }
+
+        _documents++;
+        _bytes += document.content.size();
+        MarkLoaded(document);
+    }
+
+    void LocalScanner::SkipDocument(ScannedFile& document, const std::filesystem::path& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::cerr<<" Ignoring '"<<path.string()<<"'. Could not read it\n";
+        }
+
+        document.skipped = true;
+        _skipped++;
+        MarkLoaded(document);
+    }
+
+    void LocalScanner::MarkLoaded(ScannedFile& file)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            file.loaded = true;
+        }
+        _file_loaded.notify_one();
+    }
+
+    ImportStats LocalScanner::GetStats() const
+    {
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - _start;
+        return ImportStats{_directories, _documents, _bytes, _skipped, elapsed.count()};
+    }
+
+    void LocalScanner::ReportProgress()
+    {
+        if (!_options.on_progress)
+            return;
+
+        auto const now = std::chrono::steady_clock::now();
+        if (now - _last_report < PROGRESS_INTERVAL)
+            return;
+
+        _last_report = now;
+        _options.on_progress(GetStats());
+    }
+}
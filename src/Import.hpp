@@ -0,0 +1,114 @@
+#ifndef IMPORT_HPP
+#define IMPORT_HPP
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <filesystem>
+#include <chrono>
+#include "ThreadPool.hpp"
+#include "Content.hpp"
+
+namespace CELV
+{
+    /// @brief Stats about an import of local files
+    struct ImportStats
+    {
+        size_t directories; // Directories imported so far
+        size_t documents; // Documents imported so far
+        size_t bytes; // Bytes read so far
+        size_t skipped; // Documents that couldn't be read, so they were not imported
+        double seconds; // Time elapsed since the import started
+
+        /// @brief Get read throughput
+        /// @return bytes read per second
+        double GetThroughput() const { return seconds > 0 ? bytes / seconds : 0; }
+    };
+
+    /// @brief Function called periodically while an import is in progress
+    using ImportCallback = std::function<void(const ImportStats&)>;
+
+    /// @brief Options for an import of local files
+    struct ImportOptions
+    {
+        bool lazy = false; // Don't read documents, refer to local files and map them to memory when first needed
+        ImportCallback on_progress; // Function called periodically to report progress, might be empty
+    };
+
+    /// @brief A file found while scanning local storage
+    struct ScannedFile
+    {
+        std::string name;
+        bool is_directory;
+        std::vector<std::unique_ptr<ScannedFile>> children; // Sorted by name, only for directories
+        std::string content; // Only for documents read eagerly
+        ContentRef lazy_content; // Only for documents imported lazily
+        bool skipped; // If this document couldn't be read and must not be imported
+        std::atomic<bool> loaded; // If children or content are already available
+    };
+
+    /// @brief First stages of the import pipeline. Directories are enumerated and documents are read in parallel,
+    /// in a work stealing thread pool, while the caller consumes the results in a fixed order as soon as they're loaded.
+    /// Children of every directory are sorted by name, so the order of results doesn't depend on the order of the
+    /// local directory entries nor on scheduling.
+    class LocalScanner
+    {
+        public:
+        /// @brief Start scanning a local directory
+        /// @param path path to an existing local directory
+        /// @param options import options. Progress is reported from the consumer thread
+        LocalScanner(const std::filesystem::path& path, const ImportOptions& options);
+
+        LocalScanner(const LocalScanner&) = delete;
+        LocalScanner& operator=(const LocalScanner&) = delete;
+
+        /// @brief Get root of the scanned directory
+        /// @return scanned root directory
+        ScannedFile& GetRoot() { return *_root; }
+
+        /// @brief Block until the children of a directory or the content of a document are loaded
+        /// @param file file to wait for
+        void WaitUntilLoaded(const ScannedFile& file);
+
+        /// @brief Wait for every pending task
+        /// @return final stats of this import
+        ImportStats Finish();
+
+        private:
+        /// @brief Read entries of a local directory into `directory`, and schedule loading of its children
+        void ScanDirectory(ScannedFile& directory, std::filesystem::path path);
+
+        /// @brief Read content of a local file into `document`, or just refer to it if importing lazily
+        void ReadDocument(ScannedFile& document, std::filesystem::path path);
+
+        /// @brief Mark a document that couldn't be read as loaded, so it's left out of the import
+        void SkipDocument(ScannedFile& document, const std::filesystem::path& path);
+
+        /// @brief Mark a file as loaded and wake up the consumer
+        void MarkLoaded(ScannedFile& file);
+
+        /// @brief Get stats so far
+        ImportStats GetStats() const;
+
+        /// @brief Call progress callback if enough time passed since the last time
+        void ReportProgress();
+
+        private:
+        std::unique_ptr<ScannedFile> _root;
+        ImportOptions _options;
+        std::chrono::steady_clock::time_point _start;
+        std::chrono::steady_clock::time_point _last_report;
+        std::atomic<size_t> _directories;
+        std::atomic<size_t> _documents;
+        std::atomic<size_t> _bytes;
+        std::atomic<size_t> _skipped;
+        std::mutex _mutex;
+        std::condition_variable _file_loaded;
+        ThreadPool _pool; // Last member, so workers stop before the rest of the scanner is destroyed
+    };
+}
+
+#endif
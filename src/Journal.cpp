@@ -0,0 +1,319 @@
+#include "Journal.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace CELV
+{
+    namespace
+    {
+        constexpr char MAGIC[8] = {'C', 'E', 'L', 'V', 'J', 'R', 'N', 'L'};
+        constexpr uint32_t FORMAT_VERSION = 1;
+
+        // Size of the fixed part of every record: payload size and checksum
+        constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+        /// @brief Table for CRC-32 (polynomial 0xEDB88320), one entry per byte value
+        struct CrcTable
+        {
+            uint32_t entries[256];
+
+            CrcTable()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    auto crc = i;
+                    for (int bit = 0; bit < 8; bit++)
+                        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+                    entries[i] = crc;
+                }
+            }
+        };
+
+        uint32_t Checksum(std::string_view bytes)
+        {
+            static const CrcTable table;
+            uint32_t crc = 0xFFFFFFFFu;
+            for (auto const byte : bytes)
+                crc = table.entries[(crc ^ static_cast<uint8_t>(byte)) & 0xFF] ^ (crc >> 8);
+            return crc ^ 0xFFFFFFFFu;
+        }
+
+        template<typename T>
+        void Put(std::string& out, T value)
+        {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        /// @brief Read a value of type T at `offset`, advancing it. Return false if there are not enough bytes
+        template<typename T>
+        bool Get(std::string_view bytes, size_t& offset, T& out_value)
+        {
+            if (bytes.size() - offset < sizeof(T))
+                return false;
+
+            std::memcpy(&out_value, bytes.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return true;
+        }
+
+        /// @brief Write all bytes to a file descriptor, retrying on partial writes
+        bool WriteAll(int fd, std::string_view bytes)
+        {
+            while (!bytes.empty())
+            {
+                auto const written = ::write(fd, bytes.data(), bytes.size());
+                if (written < 0)
+                    return false;
+                bytes.remove_prefix(static_cast<size_t>(written));
+            }
+            return true;
+        }
+
+        /// @brief Sync a directory, so that files renamed in it are on disk
+        void SyncDirectory(const std::string& path)
+        {
+            auto directory = std::filesystem::path(path).parent_path();
+            auto const fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+            if (fd < 0)
+                return;
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    Journal::Journal()
+        : _fd(-1)
+        , _appended(0)
+        , _written(0)
+        , _synced(0)
+        , _failed(false)
+        , _closing(false)
+    {
+
+    }
+
+    STATUS Journal::Create(const std::string& path, const std::string& base, const JournalOptions& options, std::string& out_error_msg)
+    {
+        Close();
+
+        std::string header(MAGIC, sizeof(MAGIC));
+        Put<uint32_t>(header, FORMAT_VERSION);
+        Put<uint32_t>(header, static_cast<uint32_t>(base.size()));
+        header += base;
+
+        auto const temporary_path = path + ".tmp";
+        auto const fd = ::open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        auto const stored = fd >= 0 && WriteAll(fd, header) && ::fdatasync(fd) == 0;
+        if (fd >= 0)
+            ::close(fd);
+
+        if (!stored || std::rename(temporary_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary_path.c_str());
+            out_error_msg = "Could not create journal '" + path + "'";
+            return ERROR;
+        }
+
+        SyncDirectory(path);
+        return OpenFile(path, options, out_error_msg);
+    }
+
+    STATUS Journal::Resume(const std::string& path, uint64_t valid_size, const JournalOptions& options, std::string& out_error_msg)
+    {
+        Close();
+
+        // Drop a torn record left by a crash, so new records follow the last valid one
+        if (::truncate(path.c_str(), static_cast<off_t>(valid_size)) != 0)
+        {
+            out_error_msg = "Could not open journal '" + path + "' for writing";
+            return ERROR;
+        }
+
+        return OpenFile(path, options, out_error_msg);
+    }
+
+    STATUS Journal::OpenFile(const std::string& path, const JournalOptions& options, std::string& out_error_msg)
+    {
+        _fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        if (_fd < 0)
+        {
+            out_error_msg = "Could not open journal '" + path + "' for writing";
+            return ERROR;
+        }
+
+        _path = path;
+        _options = options;
+        _buffer.clear();
+        _appended = _written = _synced = 0;
+        _failed = _closing = false;
+
+        if (_options.sync == SyncPolicy::PERIODIC)
+            _syncer = std::thread(&Journal::SyncPeriodically, this);
+
+        return SUCCESS;
+    }
+
+    void Journal::Append(const JournalRecord& record)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_fd < 0 || _failed)
+            return;
+
+        // Payload is encoded in place, after room for its size and checksum
+        auto const record_start = _buffer.size();
+        _buffer.resize(record_start + RECORD_HEADER_SIZE);
+        Put<uint32_t>(_buffer, static_cast<uint32_t>(record.op));
+        Put<uint32_t>(_buffer, static_cast<uint32_t>(record.numbers.size()));
+        Put<uint32_t>(_buffer, static_cast<uint32_t>(record.strings.size()));
+        for (auto const number : record.numbers)
+            Put<uint64_t>(_buffer, number);
+        for (auto const string : record.strings)
+        {
+            Put<uint32_t>(_buffer, static_cast<uint32_t>(string.size()));
+            _buffer.append(string);
+        }
+
+        auto const payload_start = record_start + RECORD_HEADER_SIZE;
+        uint32_t const payload_size = static_cast<uint32_t>(_buffer.size() - payload_start);
+        uint32_t const checksum = Checksum(std::string_view(_buffer).substr(payload_start));
+        std::memcpy(&_buffer[record_start], &payload_size, sizeof(payload_size));
+        std::memcpy(&_buffer[record_start + sizeof(payload_size)], &checksum, sizeof(checksum));
+
+        _appended++;
+        Commit(_options.sync == SyncPolicy::ALWAYS);
+    }
+
+    void Journal::Commit(bool sync)
+    {
+        if (_failed || (_written == _appended && (!sync || _synced == _appended)))
+            return;
+
+        auto const written = WriteAll(_fd, _buffer) && (!sync || ::fdatasync(_fd) == 0);
+        _buffer.clear();
+        if (!written)
+        {
+            _failed = true;
+            std::cerr << RED << "Could not write to journal '" << _path << "', operations from now on won't be recovered" << RESET << std::endl;
+            return;
+        }
+
+        _written = _appended;
+        if (sync)
+            _synced = _appended;
+    }
+
+    void Journal::SyncPeriodically()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_closing)
+        {
+            _closed.wait_for(lock, _options.interval, [this]() { return _closing; });
+            if (_written <= _synced)
+                continue;
+
+            // Records written while syncing are left for the next round
+            auto const last = _written;
+            lock.unlock();
+            auto const synced = ::fdatasync(_fd) == 0;
+            lock.lock();
+            if (synced && last > _synced)
+                _synced = last;
+        }
+    }
+
+    void Journal::Close()
+    {
+        if (_fd < 0)
+            return;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            Commit(_options.sync != SyncPolicy::NEVER);
+            _closing = true;
+            _closed.notify_all();
+        }
+
+        if (_syncer.joinable())
+            _syncer.join();
+
+        ::close(_fd);
+        _fd = -1;
+    }
+
+    STATUS JournalReader::Open(const std::string& path, std::string& out_error_msg)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            out_error_msg = "Could not open journal '" + path + "'";
+            return ERROR;
+        }
+
+        // The whole journal is read at once, records are decoded in place
+        std::stringstream contents;
+        contents << file.rdbuf();
+        _data = contents.str();
+
+        _offset = 0;
+        uint32_t format_version = 0, base_size = 0;
+        auto const is_valid = _data.size() >= sizeof(MAGIC) && std::memcmp(_data.data(), MAGIC, sizeof(MAGIC)) == 0
+            && (_offset = sizeof(MAGIC), Get(_data, _offset, format_version)) && format_version == FORMAT_VERSION
+            && Get(_data, _offset, base_size) && _data.size() - _offset >= base_size;
+
+        if (!is_valid)
+        {
+            out_error_msg = "'" + path + "' is not a journal or was written by an incompatible version";
+            return ERROR;
+        }
+
+        _base = _data.substr(_offset, base_size);
+        _offset += base_size;
+        return SUCCESS;
+    }
+
+    bool JournalReader::Next(JournalRecord& out_record)
+    {
+        std::string_view const data(_data);
+        auto offset = _offset;
+        uint32_t payload_size, checksum;
+        if (!Get(data, offset, payload_size) || !Get(data, offset, checksum) || data.size() - offset < payload_size)
+            return false;
+
+        auto const payload = data.substr(offset, payload_size);
+        if (Checksum(payload) != checksum)
+            return false;
+
+        size_t position = 0;
+        uint32_t op, number_count, string_count;
+        if (!Get(payload, position, op) || !Get(payload, position, number_count) || !Get(payload, position, string_count))
+            return false;
+
+        out_record.op = static_cast<JournalOp>(op);
+        out_record.numbers.resize(number_count);
+        out_record.strings.resize(string_count);
+        for (auto& number : out_record.numbers)
+        {
+            if (!Get(payload, position, number))
+                return false;
+        }
+
+        for (auto& string : out_record.strings)
+        {
+            uint32_t size;
+            if (!Get(payload, position, size) || payload.size() - position < size)
+                return false;
+
+            string = payload.substr(position, size);
+            position += size;
+        }
+
+        _offset = offset + payload_size;
+        return true;
+    }
+}
@@ -0,0 +1,166 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include "Core.hpp"
+
+namespace CELV
+{
+    // Write-ahead journal of the operations that modify a file system. A journal is a header, naming the snapshot
+    // the operations apply to, followed by records appended as operations succeed. Every record carries its size and
+    // a checksum, so a record torn by a crash is detected and discarded, together with anything after it.
+
+    /// @brief When appended records are forced to disk
+    enum class SyncPolicy
+    {
+        ALWAYS, // An operation returns once its record is on disk, every record is synced on its own
+        PERIODIC, // Records are written as they're appended, and synced every `JournalOptions::interval`
+        NEVER // Records are written as they're appended, the operating system decides when to store them
+    };
+
+    struct JournalOptions
+    {
+        SyncPolicy sync = SyncPolicy::ALWAYS;
+        std::chrono::milliseconds interval = std::chrono::milliseconds(100); // Only for PERIODIC
+    };
+
+    /// @brief Operations stored in a journal
+    enum class JournalOp : uint32_t
+    {
+        CREATE_FILE, // numbers: type; strings: name
+        REMOVE_FILE, // strings: name
+        WRITE_FILE, // strings: name, content
+        APPEND_FILE, // strings: name, content
+        WRITE_FILE_RANGE, // numbers: offset; strings: name, content
+        CHANGE_DIRECTORY, // strings: name
+        CHANGE_TO_PARENT,
+        SET_VERSION, // numbers: version
+        SET_STORAGE_MODE, // numbers: mode
+        MERGE, // numbers: version1, version2
+        INIT_CELV,
+        IMPORT, // numbers: lazy; strings: local path
+        SET_PERSISTENCE_MODE // numbers: mode
+    };
+
+    /// @brief An operation and its arguments. Strings refer to memory owned by whoever built the record: the caller
+    /// when appending it, the reader when reading it
+    struct JournalRecord
+    {
+        JournalOp op;
+        std::vector<uint64_t> numbers;
+        std::vector<std::string_view> strings;
+    };
+
+    /// @brief Stats about the recovery of a session from its journal
+    struct JournalReplayStats
+    {
+        size_t applied = 0; // Records applied successfully
+        size_t failed = 0; // Records that could not be applied again
+        size_t discarded_bytes = 0; // Bytes at the end of the journal that were not a valid record
+        double seconds = 0;
+    };
+
+    /// @brief Append records to a journal file
+    class Journal
+    {
+        public:
+        Journal();
+
+        ~Journal() { Close(); }
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        /// @brief Create an empty journal, replacing any previous journal in the same path only once the new one is
+        /// stored on disk
+        /// @param path path to journal
+        /// @param base path to the snapshot records apply to, empty if they apply to an empty file system
+        /// @param options when to sync records
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Create(const std::string& path, const std::string& base, const JournalOptions& options, std::string& out_error_msg);
+
+        /// @brief Keep appending to an existing journal
+        /// @param path path to journal
+        /// @param valid_size size of the valid prefix of the journal, anything after it is removed
+        /// @param options when to sync records
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Resume(const std::string& path, uint64_t valid_size, const JournalOptions& options, std::string& out_error_msg);
+
+        /// @brief Append a record, syncing it as required by the sync policy
+        /// @param record record to append
+        void Append(const JournalRecord& record);
+
+        /// @brief Write and sync every pending record, and close the journal file
+        void Close();
+
+        bool IsOpen() const { return _fd >= 0; }
+
+        const std::string& GetPath() const { return _path; }
+
+        const JournalOptions& GetOptions() const { return _options; }
+
+        private:
+        /// @brief Open journal file for appending, and start syncing periodically if required
+        STATUS OpenFile(const std::string& path, const JournalOptions& options, std::string& out_error_msg);
+
+        /// @brief Write pending records, and sync them if `sync`. Must be called with `_mutex` locked
+        void Commit(bool sync);
+
+        /// @brief Sync written records every `_options.interval` until closed
+        void SyncPeriodically();
+
+        private:
+        std::string _path;
+        JournalOptions _options;
+        int _fd;
+        std::string _buffer; // Encoded records not written yet
+        uint64_t _appended; // Sequence number of last appended record
+        uint64_t _written; // Sequence number of last record written to the journal file
+        uint64_t _synced; // Sequence number of last record known to be on disk
+        bool _failed; // If some write failed, further records are dropped
+        bool _closing;
+        std::mutex _mutex; // Shared with the periodic syncer
+        std::condition_variable _closed;
+        std::thread _syncer; // Only for PERIODIC
+    };
+
+    /// @brief Read the records of a journal file, in the same order they were appended
+    class JournalReader
+    {
+        public:
+        /// @brief Read a journal file and check its header
+        /// @param path path to journal
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Open(const std::string& path, std::string& out_error_msg);
+
+        /// @brief Path to the snapshot records apply to, empty if they apply to an empty file system
+        const std::string& GetBase() const { return _base; }
+
+        /// @brief Read next record. Reading stops at the first record that is incomplete or fails its checksum
+        /// @param out_record next record, valid until this reader is destroyed
+        /// @return false if there are no more valid records
+        bool Next(JournalRecord& out_record);
+
+        /// @brief Size of the part of the journal read so far
+        uint64_t GetValidSize() const { return _offset; }
+
+        /// @brief Bytes after the last valid record, only meaningful once `Next` returns false
+        uint64_t GetDiscardedBytes() const { return _data.size() - _offset; }
+
+        private:
+        std::string _data;
+        std::string _base;
+        size_t _offset = 0;
+    };
+}
+
+#endif
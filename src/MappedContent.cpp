@@ -0,0 +1,83 @@
+#include "MappedContent.hpp"
+#include "BlobStore.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace CELV
+{
+    namespace
+    {
+        int64_t ModificationTime(const struct stat& status)
+        {
+            return static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+        }
+    }
+
+    MappedContent::MappedContent(std::string path, size_t size, int64_t modification_time)
+        : _path(std::move(path))
+        , _size(size)
+        , _modification_time(modification_time)
+        , _blob(nullptr)
+        , _available(false)
+        , _mutex()
+    { }
+
+    std::shared_ptr<const MappedContent> MappedContent::FromPath(const std::string& path)
+    {
+        struct stat status;
+        if (::stat(path.c_str(), &status) != 0 || ::access(path.c_str(), R_OK) != 0)
+            return nullptr;
+
+        return std::make_shared<const MappedContent>(path, static_cast<size_t>(status.st_size), ModificationTime(status));
+    }
+
+    BlobRef MappedContent::Materialize() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_blob == nullptr)
+            _blob = Map();
+
+        return _blob;
+    }
+
+    bool MappedContent::IsAvailable() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_blob == nullptr)
+            _blob = Map();
+
+        return _available;
+    }
+
+    BlobRef MappedContent::Map() const
+    {
+        auto const fd = ::open(_path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd < 0 || ::fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) != _size || ModificationTime(status) != _modification_time)
+        {
+            if (fd >= 0)
+                ::close(fd);
+
+            return std::make_shared<const Blob>(std::string());
+        }
+
+        if (_size == 0)
+        {
+            ::close(fd);
+            _available = true;
+            return std::make_shared<const Blob>(std::string());
+        }
+
+        auto const address = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps its own reference to the file
+        if (address == MAP_FAILED)
+            return std::make_shared<const Blob>(std::string());
+
+        _available = true;
+        auto const size = _size;
+        std::shared_ptr<const void> mapping(address, [size](const void* mapped) { ::munmap(const_cast<void*>(mapped), size); });
+        return std::make_shared<const Blob>(std::string_view(static_cast<const char*>(address), _size), std::move(mapping));
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef MAPPED_CONTENT_HPP
+#define MAPPED_CONTENT_HPP
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include "Content.hpp"
+
+namespace CELV
+{
+    /// @brief Content of a file in local storage that is not loaded until needed. Only path, size and modification
+    /// time are kept in memory; the first time the content is requested the file is mapped with `mmap`, so the
+    /// operating system loads pages on demand and can evict them under memory pressure. The mapping is never written,
+    /// new versions of the document are stored as regular contents.
+    class MappedContent : public Content
+    {
+        public:
+        /// @brief Create a lazy reference to a local file
+        /// @param path path to file in local storage
+        /// @param size size of file at the moment of creating this reference
+        /// @param modification_time modification time of file, in nanoseconds, at the moment of creating this reference
+        MappedContent(std::string path, size_t size, int64_t modification_time);
+
+        /// @brief Create a lazy reference to a local file, using its current size and modification time
+        /// @param path path to file in local storage
+        /// @return new lazy reference, or nullptr if the file can't be accessed or read
+        static std::shared_ptr<const MappedContent> FromPath(const std::string& path);
+
+        size_t Size() const override { return _size; }
+
+        /// @brief Map file to memory if not mapped yet. If the local file changed since this reference was created,
+        /// its original content is no longer available, so an empty content is returned
+        /// @return blob backed by mapped memory
+        BlobRef Materialize() const override;
+
+        /// @brief Map file to memory if not mapped yet, and check if its original content is available
+        /// @return false if the local file changed or couldn't be mapped
+        bool IsAvailable() const override;
+
+        /// @brief Get path to file in local storage
+        /// @return path to local file
+        const std::string& GetPath() const { return _path; }
+
+        /// @brief Get modification time of local file when this reference was created
+        /// @return modification time in nanoseconds
+        int64_t GetModificationTime() const { return _modification_time; }
+
+        private:
+        /// @brief Map local file to memory, checking it didn't change
+        BlobRef Map() const;
+
+        private:
+        std::string _path;
+        size_t _size;
+        int64_t _modification_time;
+        mutable BlobRef _blob; // Null until first materialization
+        mutable bool _available; // If _blob has the original content of the local file
+        mutable std::mutex _mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include "NodeArena.hpp"
+#include <cstdlib>
+#include <new>
+#include <assert.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace CELV
+{
+    NodeArena::NodeArena(bool use_huge_pages)
+        : _free_lists(MAX_BLOCK_SIZE / ALIGNMENT + 1, nullptr)
+        , _slabs()
+        , _cursor(nullptr)
+        , _limit(nullptr)
+        , _bytes_in_use(0)
+        , _use_huge_pages(use_huge_pages)
+    { }
+
+    NodeArena::~NodeArena()
+    {
+        // Every block lives in some slab, so releasing slabs releases everything at once
+        for (auto slab : _slabs)
+            std::free(slab);
+    }
+
+    void* NodeArena::Allocate(size_t size)
+    {
+        auto const block_size = BlockSize(size);
+        if (block_size > MAX_BLOCK_SIZE)
+            return ::operator new(size);
+
+        _bytes_in_use += block_size;
+
+        // Reuse a released block if possible
+        auto& free_list = _free_lists[block_size / ALIGNMENT];
+        if (free_list != nullptr)
+        {
+            auto block = free_list;
+            free_list = block->next;
+            return block;
+        }
+
+        // Otherwise carve a new block from current slab
+        if (_cursor == nullptr || _cursor + block_size > _limit)
+            NewSlab();
+
+        auto block = _cursor;
+        _cursor += block_size;
+        return block;
+    }
+
+    void NodeArena::Deallocate(void* ptr, size_t size)
+    {
+        auto const block_size = BlockSize(size);
+        if (block_size > MAX_BLOCK_SIZE)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        assert(_bytes_in_use >= block_size && "Deallocating more memory than allocated");
+        _bytes_in_use -= block_size;
+
+        auto& free_list = _free_lists[block_size / ALIGNMENT];
+        auto block = static_cast<FreeBlock*>(ptr);
+        block->next = free_list;
+        free_list = block;
+    }
+
+    void NodeArena::NewSlab()
+    {
+        // Slabs are aligned to their size, so the system can back them with a single huge page
+        auto slab = std::aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        if (slab == nullptr)
+            throw std::bad_alloc();
+
+        #ifdef __linux__
+        if (_use_huge_pages)
+            madvise(slab, SLAB_SIZE, MADV_HUGEPAGE); // Just an advice, ignore if not possible
+        #endif
+
+        _slabs.push_back(slab);
+        _cursor = static_cast<char*>(slab);
+        _limit = _cursor + SLAB_SIZE;
+    }
+}
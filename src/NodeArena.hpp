@@ -0,0 +1,110 @@
+#ifndef NODE_ARENA_HPP
+#define NODE_ARENA_HPP
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <utility>
+
+// Build with `-D CELV_HUGE_PAGES` to advise the system to back node arenas with huge pages
+#ifdef CELV_HUGE_PAGES
+#define USE_HUGE_PAGES true
+#else
+#define USE_HUGE_PAGES false
+#endif
+
+namespace CELV
+{
+    /// @brief Slab allocator used for nodes of the file tree. Memory is requested to the system in big slabs, and blocks
+    /// are carved sequentially from the newest slab, so nodes created together (a new node, its change box, its duplicated
+    /// ancestors) stay close in memory. Released blocks go to a free list per block size to be reused later.
+    /// Slabs are only returned to the system in bulk when the arena is destroyed. The arena doesn't run destructors of
+    /// objects still alive at that point, their owner is responsible for it.
+    /// This class is not thread safe.
+    class NodeArena
+    {
+        public:
+        /// @brief Create a new empty arena
+        /// @param use_huge_pages if slabs should be advised to be backed by huge pages, when supported by the system
+        NodeArena(bool use_huge_pages = false);
+        ~NodeArena();
+
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        /// @brief Get a block of memory of at least `size` bytes
+        /// @param size amount of bytes to allocate
+        /// @return pointer to newly allocated memory
+        void* Allocate(size_t size);
+
+        /// @brief Return a block of memory to this arena. It will be reused by later allocations of the same size
+        /// @param ptr pointer to memory returned by `Allocate`
+        /// @param size size used to allocate this block
+        void Deallocate(void* ptr, size_t size);
+
+        /// @brief Construct a new object in memory owned by this arena
+        /// @param args arguments to forward to the constructor of T
+        /// @return pointer to newly created object
+        template<typename T, typename ...Args>
+        T* New(Args&&... args)
+        {
+            void* memory = Allocate(sizeof(T));
+            try
+            {
+                return new (memory) T(std::forward<Args>(args)...);
+            }
+            catch(...)
+            {
+                Deallocate(memory, sizeof(T));
+                throw;
+            }
+        }
+
+        /// @brief Destroy an object created with `New` and give its memory back to this arena
+        /// @param object object to destroy
+        template<typename T>
+        void Delete(T* object)
+        {
+            object->~T();
+            Deallocate(object, sizeof(T));
+        }
+
+        /// @brief Get how many slabs were requested to the system so far
+        /// @return amount of slabs owned by this arena
+        size_t GetSlabCount() const { return _slabs.size(); }
+
+        /// @brief Get how many bytes are currently given to users of this arena
+        /// @return bytes in use
+        size_t GetBytesInUse() const { return _bytes_in_use; }
+
+        /// @brief Size of each slab requested to the system, matches the size of a huge page
+        static constexpr size_t SLAB_SIZE = 2 * 1024 * 1024;
+
+        /// @brief Blocks bigger than this are not managed by the arena
+        static constexpr size_t MAX_BLOCK_SIZE = 1024;
+
+        private:
+        /// @brief Round a size to the size of the class that will store it
+        static size_t BlockSize(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+        /// @brief Request a new slab to the system and make it the current one
+        void NewSlab();
+
+        private:
+        static constexpr size_t ALIGNMENT = 16;
+
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        // Free list of each block size, indexed by block size / ALIGNMENT
+        std::vector<FreeBlock*> _free_lists;
+        std::vector<void*> _slabs;
+        char* _cursor;
+        char* _limit;
+        size_t _bytes_in_use;
+        bool _use_huge_pages;
+    };
+}
+
+#endif
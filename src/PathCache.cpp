@@ -0,0 +1,69 @@
+#include "PathCache.hpp"
+
+namespace CELV
+{
+    PathTable::PathTable()
+        : _paths{Entry{ROOT, 0}}
+    {
+
+    }
+
+    PathID PathTable::Child(PathID parent, size_t file_id)
+    {
+        auto const [id, inserted] = _ids.emplace(std::make_pair(parent, file_id), static_cast<PathID>(_paths.size()));
+        if (inserted)
+            _paths.push_back(Entry{parent, file_id});
+
+        return id->second;
+    }
+
+    ResolutionCache::ResolutionCache(size_t capacity)
+        : _capacity(capacity)
+        , _hits(0)
+        , _misses(0)
+    {
+
+    }
+
+    bool ResolutionCache::Find(size_t version, PathID path, Resolution& out_resolution)
+    {
+        auto const entry = _index.find(Key{version, path});
+        if (entry == _index.end())
+        {
+            _misses++;
+            return false;
+        }
+
+        _hits++;
+        _entries.splice(_entries.begin(), _entries, entry->second);
+        out_resolution = entry->second->resolution;
+        return true;
+    }
+
+    void ResolutionCache::Insert(size_t version, PathID path, const Resolution& resolution)
+    {
+        Key const key{version, path};
+        auto const entry = _index.find(key);
+        if (entry != _index.end())
+        {
+            entry->second->resolution = resolution;
+            _entries.splice(_entries.begin(), _entries, entry->second);
+            return;
+        }
+
+        if (_entries.size() >= _capacity)
+        {
+            _index.erase(_entries.back().key);
+            _entries.pop_back();
+        }
+
+        _entries.push_front(Entry{key, resolution});
+        _index.emplace(key, _entries.begin());
+    }
+
+    void ResolutionCache::Clear()
+    {
+        _entries.clear();
+        _index.clear();
+    }
+}
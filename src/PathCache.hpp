@@ -0,0 +1,126 @@
+#ifndef PATH_CACHE_HPP
+#define PATH_CACHE_HPP
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace CELV
+{
+    class FileTree;
+
+    /// @brief Id of a path from the root of a celv, as a sequence of file ids. Equal paths have equal ids
+    using PathID = uint32_t;
+
+    /// @brief Interns paths of a celv, so a path can be named by a single id and extended or shortened in O(1)
+    /// without walking the tree. A path is stored as its parent path and its last file id, so paths sharing a
+    /// prefix share its storage. Paths are never removed, they're as many as distinct directories visited
+    class PathTable
+    {
+        public:
+        /// @brief Path of the root itself
+        static constexpr PathID ROOT = 0;
+
+        PathTable();
+
+        /// @brief Get id of path `parent` followed by file `file_id`, creating it if needed
+        /// @param parent path to parent directory
+        /// @param file_id id of file inside parent
+        /// @return id of extended path
+        PathID Child(PathID parent, size_t file_id);
+
+        /// @brief Get id of path without its last file. Parent of root is root
+        PathID Parent(PathID path) const { return _paths[path].parent; }
+
+        /// @brief Get id of the last file of a path
+        size_t FileOf(PathID path) const { return _paths[path].file_id; }
+
+        private:
+        struct Entry
+        {
+            PathID parent;
+            size_t file_id;
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const std::pair<PathID, size_t>& key) const
+            {
+                return std::hash<size_t>()(key.second) * 31 + key.first;
+            }
+        };
+
+        private:
+        std::vector<Entry> _paths;
+        std::unordered_map<std::pair<PathID, size_t>, PathID, KeyHash> _ids;
+    };
+
+    /// @brief Node reached when looking for a path in some version. If the path doesn't exist in that version, it's
+    /// the node of its longest prefix that does
+    struct Resolution
+    {
+        FileTree* node;
+        PathID path; // Path to `node`, a prefix of the path looked for
+    };
+
+    /// @brief Bounded cache of resolutions of paths in versions, evicting the least recently used one when full.
+    /// Versions are immutable once created, so entries never become stale
+    class ResolutionCache
+    {
+        public:
+        /// @brief Create an empty cache
+        /// @param capacity maximum amount of resolutions stored
+        ResolutionCache(size_t capacity = DEFAULT_CAPACITY);
+
+        /// @brief Find resolution of a path in a version, marking it as recently used
+        /// @param version version to look the path in
+        /// @param path path to look for
+        /// @param out_resolution resolution, if found
+        /// @return if resolution was in cache
+        bool Find(size_t version, PathID path, Resolution& out_resolution);
+
+        /// @brief Store resolution of a path in a version, evicting the least recently used one if full
+        /// @param version version the path was looked in
+        /// @param path path looked for
+        /// @param resolution node reached
+        void Insert(size_t version, PathID path, const Resolution& resolution);
+
+        /// @brief Remove every resolution
+        void Clear();
+
+        size_t GetHits() const { return _hits; }
+
+        size_t GetMisses() const { return _misses; }
+
+        static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+        private:
+        using Key = std::pair<size_t, PathID>;
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const
+            {
+                return std::hash<size_t>()(key.first) * 31 + key.second;
+            }
+        };
+
+        struct Entry
+        {
+            Key key;
+            Resolution resolution;
+        };
+
+        private:
+        size_t _capacity;
+        std::list<Entry> _entries; // Most recently used first
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> _index;
+        size_t _hits;
+        size_t _misses;
+    };
+}
+
+#endif
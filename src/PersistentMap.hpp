@@ -0,0 +1,328 @@
+#ifndef PERSISTENT_MAP_HPP
+#define PERSISTENT_MAP_HPP
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+namespace CELV
+{
+    /// @brief Sorted map with structural sharing. Copying a map is O(1), and every modification copies only the
+    /// O(log n) nodes in the path to the modified key, the rest of the nodes are shared with previous copies.
+    /// It's implemented as a treap whose priorities are a hash of the key, so the same set of keys always produces
+    /// the same tree. Nodes use a non atomic reference count: maps sharing nodes can be read concurrently,
+    /// but not copied or modified concurrently.
+    template<typename Key, typename Value, typename Compare = std::less<Key>>
+    class PersistentMap
+    {
+        private:
+        struct Node
+        {
+            std::pair<const Key, Value> value;
+            size_t priority;
+            const Node* left;
+            const Node* right;
+            size_t size; // amount of nodes in the subtree rooted in this node
+            mutable size_t references;
+        };
+
+        public:
+        using value_type = std::pair<const Key, Value>;
+
+        /// @brief In order iterator over the entries of the map
+        class const_iterator
+        {
+            public:
+            const value_type& operator*() const { return _path.back()->value; }
+            const value_type* operator->() const { return &_path.back()->value; }
+
+            const_iterator& operator++()
+            {
+                auto const node = _path.back();
+                _path.pop_back();
+                PushLeftSpine(node->right);
+                return *this;
+            }
+
+            bool operator==(const const_iterator& other) const
+            {
+                return _path.empty() ? other._path.empty() : !other._path.empty() && _path.back() == other._path.back();
+            }
+            bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+            private:
+            friend PersistentMap;
+
+            void PushLeftSpine(const Node* node)
+            {
+                for (; node != nullptr; node = node->left)
+                    _path.push_back(node);
+            }
+
+            // Nodes still to be visited, next one on top
+            std::vector<const Node*> _path;
+        };
+
+        public:
+        PersistentMap() : _root(nullptr) { }
+        PersistentMap(const PersistentMap& other) : _root(Retain(other._root)) { }
+        PersistentMap(PersistentMap&& other) : _root(other._root) { other._root = nullptr; }
+        ~PersistentMap() { Release(_root); }
+
+        PersistentMap& operator=(const PersistentMap& other)
+        {
+            auto const old_root = _root;
+            _root = Retain(other._root);
+            Release(old_root);
+            return *this;
+        }
+
+        PersistentMap& operator=(PersistentMap&& other)
+        {
+            std::swap(_root, other._root);
+            return *this;
+        }
+
+        const_iterator begin() const
+        {
+            const_iterator it;
+            it.PushLeftSpine(_root);
+            return it;
+        }
+
+        const_iterator end() const { return const_iterator(); }
+
+        size_t size() const { return Size(_root); }
+        bool empty() const { return _root == nullptr; }
+
+        /// @brief Search an entry by key
+        /// @param key key to search
+        /// @return iterator to entry with such key, or end() if there's no such entry
+        const_iterator find(const Key& key) const
+        {
+            const_iterator it;
+            auto node = _root;
+            while (node != nullptr)
+            {
+                if (_less(key, node->value.first))
+                {
+                    it._path.push_back(node);
+                    node = node->left;
+                }
+                else if (_less(node->value.first, key))
+                    node = node->right;
+                else
+                {
+                    it._path.push_back(node);
+                    return it;
+                }
+            }
+
+            return end();
+        }
+
+        /// @brief Get an iterator to the entry in position `index` of the sorted map, in O(log n) time
+        /// @param index position of the entry
+        /// @return iterator to such entry, or end() if out of range
+        const_iterator Seek(size_t index) const
+        {
+            const_iterator it;
+            auto node = _root;
+            while (node != nullptr)
+            {
+                auto const left_size = Size(node->left);
+                if (index < left_size)
+                {
+                    it._path.push_back(node);
+                    node = node->left;
+                }
+                else if (index > left_size)
+                {
+                    index -= left_size + 1;
+                    node = node->right;
+                }
+                else
+                {
+                    it._path.push_back(node);
+                    return it;
+                }
+            }
+
+            return end();
+        }
+
+        /// @brief Add an entry to this map, replacing the value if the key already exists
+        /// @param key key of new entry
+        /// @param value value of new entry
+        void Insert(const Key& key, const Value& value)
+        {
+            auto const new_root = Insert(_root, key, value, Priority(key));
+            Release(_root);
+            _root = new_root;
+        }
+
+        /// @brief Remove the entry with the specified key, if any
+        /// @param key key of entry to remove
+        void Erase(const Key& key)
+        {
+            if (find(key) == end())
+                return;
+
+            auto const new_root = Erase(_root, key);
+            Release(_root);
+            _root = new_root;
+        }
+
+        /// @brief Remove every entry of this map
+        void Clear()
+        {
+            Release(_root);
+            _root = nullptr;
+        }
+
+        private:
+        static size_t Size(const Node* node) { return node == nullptr ? 0 : node->size; }
+
+        static size_t Priority(const Key& key)
+        {
+            // Mix bits of hash, as hashes of integers are usually the identity
+            uint64_t x = std::hash<Key>{}(key);
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return static_cast<size_t>(x ^ (x >> 31));
+        }
+
+        static const Node* Retain(const Node* node)
+        {
+            if (node != nullptr)
+                node->references++;
+            return node;
+        }
+
+        static void Release(const Node* node)
+        {
+            while (node != nullptr && --node->references == 0)
+            {
+                Release(node->left);
+                auto const right = node->right;
+                delete node;
+                node = right; // Continue with right child without growing the stack
+            }
+        }
+
+        // The following functions take borrowed nodes and return a new reference owned by the caller
+
+        static const Node* NewNode(const value_type& value, size_t priority, const Node* left, const Node* right)
+        {
+            return new Node{value, priority, Retain(left), Retain(right), Size(left) + Size(right) + 1, 1};
+        }
+
+        const Node* Insert(const Node* node, const Key& key, const Value& value, size_t priority) const
+        {
+            if (node == nullptr)
+                return NewNode({key, value}, priority, nullptr, nullptr);
+
+            if (!_less(key, node->value.first) && !_less(node->value.first, key))
+                return NewNode({key, value}, node->priority, node->left, node->right);
+
+            if (priority > node->priority)
+            {
+                auto const [left, right] = Split(node, key);
+                auto const new_node = NewNode({key, value}, priority, left, right);
+                Release(left);
+                Release(right);
+                return new_node;
+            }
+
+            const Node* new_node;
+            if (_less(key, node->value.first))
+            {
+                auto const left = Insert(node->left, key, value, priority);
+                new_node = NewNode(node->value, node->priority, left, node->right);
+                Release(left);
+            }
+            else
+            {
+                auto const right = Insert(node->right, key, value, priority);
+                new_node = NewNode(node->value, node->priority, node->left, right);
+                Release(right);
+            }
+
+            return new_node;
+        }
+
+        const Node* Erase(const Node* node, const Key& key) const
+        {
+            if (node == nullptr)
+                return nullptr;
+
+            if (_less(key, node->value.first))
+            {
+                auto const left = Erase(node->left, key);
+                auto const new_node = NewNode(node->value, node->priority, left, node->right);
+                Release(left);
+                return new_node;
+            }
+
+            if (_less(node->value.first, key))
+            {
+                auto const right = Erase(node->right, key);
+                auto const new_node = NewNode(node->value, node->priority, node->left, right);
+                Release(right);
+                return new_node;
+            }
+
+            return Merge(node->left, node->right);
+        }
+
+        /// @brief Split tree in nodes with keys lower than `key` and nodes with keys greater than `key`.
+        /// Assumes `key` is not in the tree
+        std::pair<const Node*, const Node*> Split(const Node* node, const Key& key) const
+        {
+            if (node == nullptr)
+                return {nullptr, nullptr};
+
+            if (_less(node->value.first, key))
+            {
+                auto const [left, right] = Split(node->right, key);
+                auto const new_node = NewNode(node->value, node->priority, node->left, left);
+                Release(left);
+                return {new_node, right};
+            }
+
+            auto const [left, right] = Split(node->left, key);
+            auto const new_node = NewNode(node->value, node->priority, right, node->right);
+            Release(right);
+            return {left, new_node};
+        }
+
+        /// @brief Merge two trees, every key in `left` should be lower than any key in `right`
+        static const Node* Merge(const Node* left, const Node* right)
+        {
+            if (left == nullptr)
+                return Retain(right);
+            if (right == nullptr)
+                return Retain(left);
+
+            if (left->priority >= right->priority)
+            {
+                auto const merged = Merge(left->right, right);
+                auto const new_node = NewNode(left->value, left->priority, left->left, merged);
+                Release(merged);
+                return new_node;
+            }
+
+            auto const merged = Merge(left, right->left);
+            auto const new_node = NewNode(right->value, right->priority, merged, right->right);
+            Release(merged);
+            return new_node;
+        }
+
+        private:
+        const Node* _root;
+        Compare _less;
+    };
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include "Rope.hpp"
+#include "BlobStore.hpp"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace CELV
+{
+    std::shared_ptr<const RopeContent> RopeContent::FromContent(const ContentRef& content)
+    {
+        auto rope = std::dynamic_pointer_cast<const RopeContent>(content);
+        if (rope != nullptr)
+            return rope;
+
+        auto blob = content->Materialize();
+        auto const size = blob->Size();
+        return std::shared_ptr<const RopeContent>(new RopeContent(MakeLeaf(std::move(blob), 0, size)));
+    }
+
+    std::shared_ptr<const RopeContent> RopeContent::Append(std::string_view data) const
+    {
+        if (data.empty())
+            return std::shared_ptr<const RopeContent>(new RopeContent(_root));
+
+        // Find last chunk, small appends are merged into it instead of creating tiny chunks
+        auto last = _root;
+        while (last != nullptr && last->left != nullptr)
+            last = last->right;
+
+        if (last == nullptr || last->size + data.size() > CHUNK_SIZE)
+            return std::shared_ptr<const RopeContent>(new RopeContent(Join(_root, MakeLeaf(data))));
+
+        std::string merged;
+        merged.reserve(last->size + data.size());
+        merged.append(last->blob->GetData().substr(last->offset, last->size));
+        merged.append(data);
+
+        auto const prefix = Split(_root, Size() - last->size).first;
+        return std::shared_ptr<const RopeContent>(new RopeContent(Join(prefix, MakeLeaf(merged))));
+    }
+
+    std::shared_ptr<const RopeContent> RopeContent::Write(size_t offset, std::string_view data) const
+    {
+        auto const [prefix, rest] = Split(_root, offset);
+        auto const suffix = Split(rest, data.size()).second;
+        return std::shared_ptr<const RopeContent>(new RopeContent(Join(Join(prefix, MakeLeaf(data)), suffix)));
+    }
+
+    size_t RopeContent::Size() const
+    {
+        return SizeOf(_root);
+    }
+
+    size_t RopeContent::GetChunkCount() const
+    {
+        return _root == nullptr ? 0 : _root->chunks;
+    }
+
+    BlobRef RopeContent::Materialize() const
+    {
+        std::string content;
+        content.reserve(Size());
+
+        // In order traversal of leaves
+        std::vector<const Node*> pending;
+        if (_root != nullptr)
+            pending.push_back(_root.get());
+
+        while (!pending.empty())
+        {
+            auto const node = pending.back();
+            pending.pop_back();
+            if (node->left == nullptr)
+            {
+                content.append(node->blob->GetData().substr(node->offset, node->size));
+                continue;
+            }
+
+            pending.push_back(node->right.get());
+            pending.push_back(node->left.get());
+        }
+
+        return std::make_shared<const Blob>(std::move(content));
+    }
+
+    RopeContent::NodeRef RopeContent::MakeLeaf(BlobRef blob, size_t offset, size_t size)
+    {
+        if (size == 0)
+            return nullptr;
+
+        return std::make_shared<const Node>(Node{std::move(blob), offset, size, 1, 1, nullptr, nullptr});
+    }
+
+    RopeContent::NodeRef RopeContent::MakeLeaf(std::string_view data)
+    {
+        return MakeLeaf(std::make_shared<const Blob>(std::string(data)), 0, data.size());
+    }
+
+    RopeContent::NodeRef RopeContent::MakeNode(NodeRef left, NodeRef right)
+    {
+        if (left == nullptr)
+            return right;
+        if (right == nullptr)
+            return left;
+
+        auto const size = left->size + right->size;
+        auto const chunks = left->chunks + right->chunks;
+        auto const height = std::max(left->height, right->height) + 1;
+        return std::make_shared<const Node>(Node{nullptr, 0, size, chunks, height, std::move(left), std::move(right)});
+    }
+
+    RopeContent::NodeRef RopeContent::Join(const NodeRef& left, const NodeRef& right)
+    {
+        if (left == nullptr)
+            return right;
+        if (right == nullptr)
+            return left;
+
+        // Descend the spine of the taller tree until heights match, then rebalance on the way back
+        if (left->height > right->height + 1)
+            return Balance(left->left, Join(left->right, right));
+        if (right->height > left->height + 1)
+            return Balance(Join(left, right->left), right->right);
+
+        return MakeNode(left, right);
+    }
+
+    RopeContent::NodeRef RopeContent::Balance(const NodeRef& left, const NodeRef& right)
+    {
+        if (HeightOf(left) > HeightOf(right) + 1)
+        {
+            if (HeightOf(left->left) >= HeightOf(left->right))
+                return MakeNode(left->left, MakeNode(left->right, right));
+
+            return MakeNode(MakeNode(left->left, left->right->left), MakeNode(left->right->right, right));
+        }
+
+        if (HeightOf(right) > HeightOf(left) + 1)
+        {
+            if (HeightOf(right->right) >= HeightOf(right->left))
+                return MakeNode(MakeNode(left, right->left), right->right);
+
+            return MakeNode(MakeNode(left, right->left->left), MakeNode(right->left->right, right->right));
+        }
+
+        return MakeNode(left, right);
+    }
+
+    std::pair<RopeContent::NodeRef, RopeContent::NodeRef> RopeContent::Split(const NodeRef& node, size_t at)
+    {
+        if (node == nullptr)
+            return {nullptr, nullptr};
+        if (at == 0)
+            return {nullptr, node};
+        if (at >= node->size)
+            return {node, nullptr};
+
+        // Split a chunk in two slices of the same blob
+        if (node->left == nullptr)
+            return {MakeLeaf(node->blob, node->offset, at), MakeLeaf(node->blob, node->offset + at, node->size - at)};
+
+        auto const left_size = node->left->size;
+        if (at < left_size)
+        {
+            auto const [left, right] = Split(node->left, at);
+            return {left, Join(right, node->right)};
+        }
+
+        auto const [left, right] = Split(node->right, at - left_size);
+        return {Join(node->left, left), right};
+    }
+}
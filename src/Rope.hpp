@@ -0,0 +1,86 @@
+#ifndef ROPE_HPP
+#define ROPE_HPP
+#include <string_view>
+#include <memory>
+#include <utility>
+#include "Content.hpp"
+
+namespace CELV
+{
+    /// @brief Content stored as a persistent rope: a height balanced tree whose leaves are slices of blobs. Ropes are
+    /// immutable, editing one returns a new rope sharing every untouched chunk and subtree with the original, so
+    /// appending to or overwriting a range of a big document costs time and memory proportional to the edited bytes
+    /// plus the height of the tree.
+    class RopeContent : public Content
+    {
+        public:
+        /// @brief Get a rope with the same bytes as `content`. Ropes are returned as they are, any other content
+        /// becomes a single chunk sharing its bytes
+        /// @param content content to convert
+        /// @return rope with such content
+        static std::shared_ptr<const RopeContent> FromContent(const ContentRef& content);
+
+        /// @brief Create a new rope adding bytes at the end of this one
+        /// @param data bytes to add
+        /// @return new rope
+        std::shared_ptr<const RopeContent> Append(std::string_view data) const;
+
+        /// @brief Create a new rope overwriting bytes starting at `offset`, growing it if writing past the end
+        /// @param offset position of first byte to overwrite, should not be greater than size of this rope
+        /// @param data bytes to write
+        /// @return new rope
+        std::shared_ptr<const RopeContent> Write(size_t offset, std::string_view data) const;
+
+        size_t Size() const override;
+
+        /// @brief Concatenate every chunk of this rope
+        /// @return blob with full content
+        BlobRef Materialize() const override;
+
+        /// @brief Get amount of chunks in this rope
+        /// @return amount of leaves
+        size_t GetChunkCount() const;
+
+        /// @brief Appends are merged with the last chunk while the result is not bigger than this
+        static constexpr size_t CHUNK_SIZE = 4096;
+
+        private:
+        struct Node;
+        using NodeRef = std::shared_ptr<const Node>;
+
+        /// @brief Node of the rope. Leaves refer to a slice of a blob, internal nodes have both children
+        struct Node
+        {
+            BlobRef blob;
+            size_t offset;
+            size_t size; // Bytes in this subtree
+            size_t chunks; // Leaves in this subtree
+            int height;
+            NodeRef left;
+            NodeRef right;
+        };
+
+        explicit RopeContent(NodeRef root) : _root(std::move(root)) { }
+
+        static NodeRef MakeLeaf(BlobRef blob, size_t offset, size_t size);
+        static NodeRef MakeLeaf(std::string_view data);
+        static NodeRef MakeNode(NodeRef left, NodeRef right);
+
+        static size_t SizeOf(const NodeRef& node) { return node == nullptr ? 0 : node->size; }
+        static int HeightOf(const NodeRef& node) { return node == nullptr ? 0 : node->height; }
+
+        /// @brief Concatenate two balanced trees into a balanced tree
+        static NodeRef Join(const NodeRef& left, const NodeRef& right);
+
+        /// @brief Make a node from two balanced trees whose heights differ by at most 2, rotating if needed
+        static NodeRef Balance(const NodeRef& left, const NodeRef& right);
+
+        /// @brief Split tree in the first `at` bytes and the rest
+        static std::pair<NodeRef, NodeRef> Split(const NodeRef& node, size_t at);
+
+        private:
+        NodeRef _root; // Null for empty content
+    };
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include "Snapshot.hpp"
+#include "BlobStore.hpp"
+#include "MappedContent.hpp"
+#include <cstring>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace CELV
+{
+    namespace
+    {
+        constexpr char MAGIC[8] = {'C', 'E', 'L', 'V', 'S', 'N', 'A', 'P'};
+
+        // Every range starts at a multiple of this, so records can be read in place from the mapping
+        constexpr uint64_t ALIGNMENT = 8;
+    }
+
+    SnapshotWriter::SnapshotWriter(const std::string& path)
+        : _path(path)
+        , _temporary_path(path + ".tmp")
+        , _file(_temporary_path, std::ios::binary | std::ios::trunc)
+        , _offset(0)
+    {
+        // Header is written at the end, when every table is known
+        SnapshotHeader empty_header{};
+        _file.write(reinterpret_cast<const char*>(&empty_header), sizeof(empty_header));
+        _offset = sizeof(empty_header);
+    }
+
+    SnapshotWriter::~SnapshotWriter()
+    {
+        // Discard temporary file if the snapshot was not finished
+        if (_file.is_open())
+        {
+            _file.close();
+            std::remove(_temporary_path.c_str());
+        }
+    }
+
+    SnapshotRange SnapshotWriter::WriteBytes(std::string_view bytes)
+    {
+        static constexpr char padding[ALIGNMENT] = {};
+        auto const padding_size = (ALIGNMENT - _offset % ALIGNMENT) % ALIGNMENT;
+        _file.write(padding, padding_size);
+        _offset += padding_size;
+
+        SnapshotRange range{_offset, bytes.size()};
+        _file.write(bytes.data(), bytes.size());
+        _offset += bytes.size();
+        return range;
+    }
+
+    uint64_t SnapshotWriter::WriteContent(const ContentRef& content)
+    {
+        if (content == nullptr)
+            return SNAPSHOT_NONE;
+
+        auto const written = _content_index.find(content.get());
+        if (written != _content_index.end())
+            return written->second;
+
+        ContentRecord record{};
+        auto const mapped = dynamic_cast<const MappedContent*>(content.get());
+        if (mapped != nullptr)
+        {
+            // Lazy imports stay lazy, only the reference to the local file is stored
+            record.kind = ContentRecord::LOCAL;
+            record.bytes = WriteBytes(mapped->GetPath());
+            record.size = mapped->Size();
+            record.modification_time = mapped->GetModificationTime();
+        }
+        else
+        {
+            auto const blob = content->Materialize();
+            record.kind = ContentRecord::BYTES;
+            record.bytes = WriteBytes(blob->GetData());
+            record.size = blob->Size();
+        }
+
+        auto const index = _contents.size();
+        _contents.push_back(record);
+        _content_index.emplace(content.get(), index);
+        return index;
+    }
+
+    STATUS SnapshotWriter::Finish(SnapshotHeader header, std::string& out_error_msg)
+    {
+        header.contents = WriteArray(_contents);
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.format_version = SnapshotHeader::FORMAT_VERSION;
+        header.byte_order = SnapshotHeader::BYTE_ORDER_MARK;
+        header.file_size = _offset;
+
+        _file.seekp(0);
+        _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        _file.close();
+
+        // Snapshot must be on disk before replacing the previous one, a journal might be restarted from it
+        auto const fd = ::open(_temporary_path.c_str(), O_RDONLY);
+        auto const synced = fd >= 0 && ::fsync(fd) == 0;
+        if (fd >= 0)
+            ::close(fd);
+
+        if (_file.fail() || !synced)
+        {
+            std::remove(_temporary_path.c_str());
+            out_error_msg = "Could not write snapshot to '" + _temporary_path + "'";
+            return ERROR;
+        }
+
+        if (std::rename(_temporary_path.c_str(), _path.c_str()) != 0)
+        {
+            std::remove(_temporary_path.c_str());
+            out_error_msg = "Could not replace snapshot '" + _path + "'";
+            return ERROR;
+        }
+
+        return SUCCESS;
+    }
+
+    std::shared_ptr<const MappedSnapshot> MappedSnapshot::Open(const std::string& path, std::string& out_error_msg)
+    {
+        auto const fd = ::open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd < 0 || ::fstat(fd, &status) != 0)
+        {
+            if (fd >= 0)
+                ::close(fd);
+
+            out_error_msg = "Could not open snapshot '" + path + "'";
+            return nullptr;
+        }
+
+        auto const size = static_cast<size_t>(status.st_size);
+        if (size < sizeof(SnapshotHeader))
+        {
+            ::close(fd);
+            out_error_msg = "'" + path + "' is not a snapshot";
+            return nullptr;
+        }
+
+        auto const address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps its own reference to the file
+        if (address == MAP_FAILED)
+        {
+            out_error_msg = "Could not map snapshot '" + path + "' to memory";
+            return nullptr;
+        }
+
+        std::shared_ptr<const MappedSnapshot> snapshot(new MappedSnapshot(static_cast<const char*>(address), size));
+        if (!snapshot->IsValid())
+        {
+            out_error_msg = "'" + path + "' is not a valid snapshot or was written by an incompatible version";
+            return nullptr;
+        }
+
+        return snapshot;
+    }
+
+    MappedSnapshot::~MappedSnapshot()
+    {
+        ::munmap(const_cast<char*>(_data), _size);
+    }
+
+    ContentRef MappedSnapshot::GetContent(uint64_t index) const
+    {
+        std::lock_guard<std::mutex> lock(_contents_mutex);
+        auto& cached = _contents[index];
+        if (auto content = cached.lock())
+            return content;
+
+        ContentRef content;
+        auto const& record = Array<ContentRecord>(GetHeader().contents)[index];
+        if (record.kind == ContentRecord::LOCAL)
+            content = std::make_shared<const MappedContent>(std::string(Bytes(record.bytes)), record.size, record.modification_time);
+        else // Bytes are read straight from the mapping, which lives as long as some blob refers to it
+            content = std::make_shared<const Blob>(Bytes(record.bytes), shared_from_this());
+
+        cached = content;
+        return content;
+    }
+
+    bool MappedSnapshot::IsValid() const
+    {
+        auto const& header = GetHeader();
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.format_version != SnapshotHeader::FORMAT_VERSION
+            || header.byte_order != SnapshotHeader::BYTE_ORDER_MARK || header.file_size != _size)
+            return false;
+
+        if (!Contains(header.contents, sizeof(ContentRecord)) || !Contains(header.files, sizeof(FileRecord))
+            || !Contains(header.nodes, sizeof(NodeRecord)) || !Contains(header.celvs, sizeof(CelvRecord))
+            || header.root >= header.nodes.count || !AreValidFiles(header.files))
+            return false;
+
+        // Tables of every celv are checked here, single records are only checked when decoded
+        auto const celvs = Array<CelvRecord>(header.celvs);
+        for (size_t i = 0; i < header.celvs.count; i++)
+        {
+            auto const& celv = celvs[i];
+            auto const& origin = celv.origin;
+            if (!Contains(celv.files, sizeof(FileRecord)) || !Contains(celv.nodes, sizeof(NodeRecord))
+                || !Contains(celv.versions, sizeof(uint64_t)) || !Contains(celv.history, sizeof(ActionRecord))
+                || !Contains(celv.change_boxes, sizeof(ChangeBoxRecord)) || !Contains(celv.node_patches, sizeof(NodePatchRecord))
+                || origin.version + celv.versions.count != celv.next_available_version || celv.current_version >= celv.next_available_version 
+                || celv.working_dir >= origin.node + celv.nodes.count || celv.parent_file >= header.nodes.count
+                || !AreValidFiles(celv.files))
+                return false;
+
+            // Only segments adding to a previous one have something before their tables
+            auto const is_full = origin.node == 0 && origin.file == 0 && origin.version == 0 && origin.action == 0 && origin.change_box == 0;
+            if (header.incremental == 0 && (!is_full || celv.previous != SNAPSHOT_NONE || celv.node_patches.count != 0))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool MappedSnapshot::AreValidFiles(const SnapshotRange& range) const
+    {
+        // A file is never guessed to be a directory, a corrupt record fails the whole load
+        auto const files = Array<FileRecord>(range);
+        auto const content_count = GetHeader().contents.count;
+        for (size_t i = 0; i < range.count; i++)
+        {
+            auto const& file = files[i];
+            if (file.type != FileRecord::DIRECTORY && (file.type != FileRecord::DOCUMENT || file.content >= content_count))
+                return false;
+        }
+
+        return true;
+    }
+}
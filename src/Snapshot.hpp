@@ -0,0 +1,291 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <limits>
+#include <assert.h>
+#include "Core.hpp"
+#include "Content.hpp"
+
+namespace CELV
+{
+    // Binary snapshots of a file system. A snapshot is a header followed by arrays of fixed size records, integers
+    // are stored in the byte order of the machine that wrote them. Records refer to each other by index and to
+    // variable sized data (names, document contents, children of a node) by byte range, so a snapshot can be mapped
+    // to memory and any record read in O(1) without parsing the ones before it.
+
+    /// @brief Index used when a record refers to nothing
+    constexpr uint64_t SNAPSHOT_NONE = std::numeric_limits<uint64_t>::max();
+
+    /// @brief Range of a snapshot: `count` elements starting at byte `offset`
+    struct SnapshotRange
+    {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    /// @brief Reference to a node: index of the celv managing it and index of the node in that celv,
+    /// or index of a node of the global tree if celv is SNAPSHOT_NONE
+    struct SnapshotNodeRef
+    {
+        uint64_t celv;
+        uint64_t node;
+    };
+
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t format_version;
+        uint32_t byte_order; // BYTE_ORDER_MARK as written by the machine that saved the snapshot
+        uint64_t file_size;
+        SnapshotRange contents; // ContentRecord, shared by every file in the snapshot
+        SnapshotRange files; // FileRecord of files not managed by any celv
+        SnapshotRange nodes; // NodeRecord of the tree not managed by any celv
+        SnapshotRange celvs; // CelvRecord
+        uint64_t root; // Index of global root node
+        SnapshotNodeRef working_directory;
+        uint64_t incremental; // 1 if this is a segment of a checkpoint store that only adds to the previous segment
+
+        static constexpr uint32_t FORMAT_VERSION = 3;
+        static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    };
+
+    struct ContentRecord
+    {
+        enum Kind : uint64_t
+        {
+            BYTES, // Full content stored in the snapshot
+            LOCAL // Reference to a local file imported lazily, `bytes` is its path
+        };
+
+        uint64_t kind;
+        SnapshotRange bytes;
+        uint64_t size;
+        int64_t modification_time; // Only for LOCAL
+    };
+
+    struct FileRecord
+    {
+        // Values of type, the same as FileType
+        static constexpr uint64_t DOCUMENT = 0;
+        static constexpr uint64_t DIRECTORY = 1;
+
+        SnapshotRange name;
+        uint64_t type; // FileType
+        uint64_t content; // Index of content in the same snapshot, SNAPSHOT_NONE for directories
+    };
+
+    struct NodeRecord
+    {
+        uint64_t file_id;
+        uint64_t version;
+        uint64_t parent;
+        uint64_t change_box;
+        uint64_t base; // Node whose children are edited by `childs`, SNAPSHOT_NONE if `childs` lists every child
+        SnapshotRange childs; // ChildRecord
+        uint64_t celv; // Celv initialized in this node, only for nodes not managed by any celv
+    };
+
+    /// @brief Child of a node, or an edit to the children of its base node
+    struct ChildRecord
+    {
+        uint64_t file_id;
+        uint64_t node; // SNAPSHOT_NONE to remove this child from the base node
+    };
+
+    struct ActionRecord
+    {
+        uint64_t type; // ActionType
+        uint64_t origin_version;
+        uint64_t new_version;
+        SnapshotRange args; // SnapshotRange of every argument
+    };
+
+    struct ChangeBoxRecord
+    {
+        uint64_t version;
+        uint64_t node;
+    };
+
+    /// @brief Change box filled in a node stored in a previous segment
+    struct NodePatchRecord
+    {
+        uint64_t node;
+        uint64_t change_box;
+    };
+
+    /// @brief Index of the first element of every table of a celv. Tables of an incremental segment only store
+    /// what was added after the previous segment, all of them are zero otherwise
+    struct CelvOrigin
+    {
+        uint64_t node;
+        uint64_t file;
+        uint64_t version;
+        uint64_t action;
+        uint64_t change_box;
+    };
+
+    struct CelvRecord
+    {
+        SnapshotRange files; // FileRecord
+        SnapshotRange nodes; // NodeRecord
+        SnapshotRange versions; // Index of root node of every version
+        SnapshotRange history; // ActionRecord
+        SnapshotRange change_boxes; // ChangeBoxRecord
+        SnapshotRange node_patches; // NodePatchRecord, only in incremental segments
+        CelvOrigin origin;
+        uint64_t previous; // Index of this celv in the previous segment, SNAPSHOT_NONE if it's fully stored here
+        uint64_t current_version;
+        uint64_t next_available_version;
+        uint64_t storage_mode; // StorageMode
+        uint64_t persistence_mode; // PersistenceMode
+        uint64_t working_dir; // Node of this celv
+        uint64_t parent_file; // Node not managed by any celv where this celv was initialized
+    };
+
+    /// @brief Get where the tables of a celv end, which is where they start in the next incremental segment
+    /// @param record record of celv
+    /// @return index after the last element of every table
+    inline CelvOrigin GetTableEnd(const CelvRecord& record)
+    {
+        auto const& origin = record.origin;
+        return CelvOrigin{origin.node + record.nodes.count, origin.file + record.files.count, origin.version + record.versions.count, 
+                          origin.action + record.history.count, origin.change_box + record.change_boxes.count};
+    }
+
+    /// @brief Write a snapshot sequentially. Data is written to a temporary file next to the destination, which
+    /// replaces it only when the whole snapshot was written, so a failed save never corrupts a previous snapshot
+    class SnapshotWriter
+    {
+        public:
+        /// @brief Start writing a snapshot
+        /// @param path where to store the snapshot
+        SnapshotWriter(const std::string& path);
+
+        ~SnapshotWriter();
+
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+        /// @brief Write bytes to the snapshot
+        /// @param bytes bytes to write
+        /// @return range of written bytes
+        SnapshotRange WriteBytes(std::string_view bytes);
+
+        /// @brief Write an array of records to the snapshot
+        /// @param records records to write
+        /// @return range of written records
+        template<typename T>
+        SnapshotRange WriteArray(const std::vector<T>& records)
+        {
+            auto range = WriteBytes(std::string_view(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T)));
+            range.count = records.size();
+            return range;
+        }
+
+        /// @brief Write a document content, unless it was already written. Contents are deduplicated by identity,
+        /// so files sharing a content share its record too
+        /// @param content content to write
+        /// @return index of its record
+        uint64_t WriteContent(const ContentRef& content);
+
+        /// @brief Write the table of contents and the header, and replace the destination file
+        /// @param header header of the snapshot, its content table, magic and sizes are filled by the writer
+        /// @param out_error_msg error message in case of error
+        /// @return Success status
+        STATUS Finish(SnapshotHeader header, std::string& out_error_msg);
+
+        private:
+        std::string _path;
+        std::string _temporary_path;
+        std::ofstream _file;
+        uint64_t _offset;
+        std::vector<ContentRecord> _contents;
+        std::unordered_map<const Content*, uint64_t> _content_index; // Contents already written, by address
+    };
+
+    /// @brief A snapshot mapped to memory. Pages are loaded by the system the first time they're accessed, so opening
+    /// a snapshot only reads its tables of contents. Contents of documents refer to the mapping instead of copying
+    /// it, they keep it alive as long as needed
+    class MappedSnapshot : public std::enable_shared_from_this<MappedSnapshot>
+    {
+        public:
+        /// @brief Map a snapshot to memory, checking its header and tables
+        /// @param path path to snapshot
+        /// @param out_error_msg error message in case of error
+        /// @return mapped snapshot, nullptr in case of error
+        static std::shared_ptr<const MappedSnapshot> Open(const std::string& path, std::string& out_error_msg);
+
+        ~MappedSnapshot();
+
+        MappedSnapshot(const MappedSnapshot&) = delete;
+        MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+        const SnapshotHeader& GetHeader() const { return *reinterpret_cast<const SnapshotHeader*>(_data); }
+
+        /// @brief Get an array of records
+        /// @param range range of records
+        /// @return pointer to first record
+        template<typename T>
+        const T* Array(const SnapshotRange& range) const
+        {
+            assert(Contains(range, sizeof(T)) && "Range out of snapshot");
+            return reinterpret_cast<const T*>(_data + range.offset);
+        }
+
+        /// @brief Get a range of bytes
+        /// @param range range of bytes
+        /// @return bytes in range, empty if out of snapshot
+        std::string_view Bytes(const SnapshotRange& range) const
+        {
+            return Contains(range, 1) ? std::string_view(_data + range.offset, range.count) : std::string_view();
+        }
+
+        /// @brief Build content of a document, without copying bytes stored in the snapshot. Content is the same
+        /// for every call while some document refers to it, so documents sharing it when saved still share it
+        /// @param index index of content record
+        /// @return content of document
+        ContentRef GetContent(uint64_t index) const;
+
+        /// @brief Check if a range is inside of this snapshot and aligned to store its elements
+        /// @param range range to check
+        /// @param element_size size of every element of the range
+        /// @return if range is valid
+        bool Contains(const SnapshotRange& range, size_t element_size) const
+        {
+            return range.offset <= _size && range.offset % (element_size < 8 ? element_size : 8) == 0 && range.count <= (_size - range.offset) / element_size;
+        }
+
+        private:
+        MappedSnapshot(const char* data, size_t size) : _data(data), _size(size) { }
+
+        /// @brief Check that every table of this snapshot is inside of it, and that every file has a known type and
+        /// refers to a content of this snapshot if it's a document
+        bool IsValid() const;
+
+        /// @brief Check type and content of every file record in a range
+        bool AreValidFiles(const SnapshotRange& range) const;
+
+        private:
+        const char* _data;
+        size_t _size;
+        mutable std::mutex _contents_mutex;
+        mutable std::unordered_map<uint64_t, std::weak_ptr<const Content>> _contents; // Weak, blobs keep the snapshot alive
+    };
+
+    /// @brief Tables of a celv in one snapshot. A celv stored in a checkpoint store is spread across a layer per
+    /// segment, each one adding to the previous ones
+    struct SnapshotLayer
+    {
+        std::shared_ptr<const MappedSnapshot> snapshot;
+        CelvRecord record;
+    };
+}
+
+#endif
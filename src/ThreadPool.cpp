@@ -0,0 +1,133 @@
+#include "ThreadPool.hpp"
+#include <chrono>
+#include <algorithm>
+
+namespace CELV
+{
+    namespace
+    {
+        // Pool and queue of the worker running in this thread, if any
+        thread_local const ThreadPool* current_pool = nullptr;
+        thread_local size_t current_queue = 0;
+    }
+
+    ThreadPool::ThreadPool(size_t thread_count)
+        : _queues()
+        , _workers()
+        , _queued(0)
+        , _pending(0)
+        , _next_queue(0)
+        , _stopping(false)
+    {
+        if (thread_count == 0)
+            thread_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+        for (size_t i = 0; i < thread_count; i++)
+            _queues.push_back(std::make_unique<WorkQueue>());
+
+        for (size_t i = 0; i < thread_count; i++)
+            _workers.emplace_back(&ThreadPool::Work, this, i);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Wait();
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _work_available.notify_all();
+
+        for (auto& worker : _workers)
+            worker.join();
+    }
+
+    void ThreadPool::Submit(Task task)
+    {
+        auto const index = current_pool == this ? current_queue : _next_queue++ % _queues.size();
+        _pending++;
+
+        {
+            // Increment before publishing the task, so a worker taking it can't decrement the counter below zero.
+            // Done under lock so a worker about to sleep can't miss it
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queued++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+            _queues[index]->tasks.push_back(std::move(task));
+        }
+        _work_available.notify_one();
+    }
+
+    void ThreadPool::Wait()
+    {
+        auto const index = current_pool == this ? current_queue : 0;
+        while (_pending > 0)
+        {
+            if (TryRunTask(index))
+                continue;
+
+            // Remaining tasks are running in other workers, and might still submit more tasks
+            std::unique_lock<std::mutex> lock(_mutex);
+            _work_available.wait_for(lock, std::chrono::milliseconds(1), [this] { return _queued > 0 || _pending == 0; });
+        }
+    }
+
+    void ThreadPool::Work(size_t index)
+    {
+        current_pool = this;
+        current_queue = index;
+
+        while (true)
+        {
+            if (TryRunTask(index))
+                continue;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _work_available.wait(lock, [this] { return _queued > 0 || _stopping; });
+            if (_stopping && _queued == 0)
+                return;
+        }
+    }
+
+    bool ThreadPool::TryRunTask(size_t index)
+    {
+        Task task;
+        for (size_t i = 0; i < _queues.size() && !task; i++)
+        {
+            auto& queue = *_queues[(index + i) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+
+            // Own tasks are taken newest first, stolen tasks oldest first
+            if (i == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+
+        if (!task)
+            return false;
+
+        _queued--;
+        task();
+
+        if (--_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _work_available.notify_all();
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+namespace CELV
+{
+    /// @brief Pool of worker threads with work stealing. Every worker has its own queue of tasks: tasks submitted from
+    /// a worker go to its own queue, and are run in LIFO order by that worker. An idle worker steals the oldest task
+    /// from the queue of another worker, so recursive workloads (a task submitting more tasks) spread across workers
+    /// without contending on a single queue.
+    class ThreadPool
+    {
+        public:
+        using Task = std::function<void()>;
+
+        /// @brief Create a new pool and start its workers
+        /// @param thread_count amount of worker threads. 0 to use one per hardware thread
+        explicit ThreadPool(size_t thread_count = 0);
+
+        /// @brief Wait for every pending task and stop workers
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// @brief Schedule a task to run in some worker
+        /// @param task task to run
+        void Submit(Task task);
+
+        /// @brief Block until every task submitted so far, and every task submitted by them, has finished.
+        /// The calling thread helps running tasks while waiting
+        void Wait();
+
+        /// @brief Get amount of worker threads in this pool
+        /// @return amount of workers
+        size_t GetThreadCount() const { return _workers.size(); }
+
+        private:
+        /// @brief Queue of tasks owned by a worker
+        struct WorkQueue
+        {
+            std::deque<Task> tasks;
+            std::mutex mutex;
+        };
+
+        /// @brief Main loop of a worker thread
+        /// @param index index of this worker
+        void Work(size_t index);
+
+        /// @brief Try to run a single task, from queue `index` first, then stealing from other queues
+        /// @param index queue to look at first
+        /// @return if some task was run
+        bool TryRunTask(size_t index);
+
+        private:
+        std::vector<std::unique_ptr<WorkQueue>> _queues;
+        std::vector<std::thread> _workers;
+        std::atomic<size_t> _queued; // tasks waiting in some queue
+        std::atomic<size_t> _pending; // tasks submitted and not finished yet
+        std::atomic<size_t> _next_queue; // queue for next task submitted from outside the pool
+        std::mutex _mutex;
+        std::condition_variable _work_available;
+        bool _stopping;
+    };
+}
+
+#endif
@@ -1,16 +1,42 @@
 #include <iostream>
+#include <string>
 #include "Client.hpp"
 
 int main(int argc, char** argv)
 {
     CELV::Client client;
 
-    if (argc == 1)
+    // `--cargar snapshot` restores a saved session before running, `--diario journal [--sincronizar policy]`
+    // recovers the session stored in a journal and keeps recording in it
+    std::string snapshot, journal, sync_policy = "siempre";
+    int first_argument = 1;
+    while (first_argument + 1 < argc)
+    {
+        std::string const option = argv[first_argument];
+        if (option == "--cargar")
+            snapshot = argv[first_argument + 1];
+        else if (option == "--diario")
+            journal = argv[first_argument + 1];
+        else if (option == "--sincronizar")
+            sync_policy = argv[first_argument + 1];
+        else
+            break;
+        first_argument += 2;
+    }
+
+    if (!snapshot.empty() && client.Load(snapshot) == ERROR)
+        return 1;
+
+    if (!journal.empty() && client.Journal(journal, sync_policy) == ERROR)
+        return 1;
+
+    auto const arguments = argc - first_argument;
+    if (arguments == 0)
         client.Run();
-    else if (argc == 2)
-        client.Run(argv[1]);
+    else if (arguments == 1)
+        client.Run(argv[first_argument]);
     else
         std::cerr << "Too many arguments!" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}